@@ -0,0 +1,609 @@
+/**
+ * @file
+ *
+ * Batched file access: io_uring backend with a synchronous fallback. See
+ * batch_io.h for an overview.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "batch_io.h"
+#include "debug.h"
+#include "stats.h"
+
+/* Operation tags stored in the low bits of each SQE's user_data */
+#define OP_OPEN  0
+#define OP_READ  1
+#define OP_CLOSE 2
+#define OP_STAT  3
+#define OP_BITS  2
+
+/**
+ * Memory-mapped submission and completion rings of one io_uring instance.
+ */
+struct uring {
+    int fd;
+    unsigned int sq_entries;
+    unsigned int *sq_head;
+    unsigned int *sq_tail;
+    unsigned int *sq_mask;
+    unsigned int *sq_array;
+    unsigned int *cq_head;
+    unsigned int *cq_tail;
+    unsigned int *cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+
+    /* Local copy of the SQ tail: SQEs up to here are filled in but not yet
+     * published to the kernel. */
+    unsigned int sqe_tail;
+
+    void *sq_ptr;
+    void *cq_ptr;
+    size_t sq_len;
+    size_t cq_len;
+    size_t sqes_len;
+};
+
+/**
+ * In-flight state for one request. A slot also owns the direct descriptor
+ * with the same index in the ring's registered file table.
+ */
+struct slot {
+    size_t req;
+    int pending;
+    int open_res;
+    int read_res;
+    struct statx stx;
+};
+
+struct io_batch {
+    enum io_backend backend;
+    int dir;
+    struct uring ring;
+    struct slot *slots;
+    unsigned int nslots;
+    unsigned int *free_slots;
+    unsigned int nfree;
+};
+
+static int sys_io_uring_setup(unsigned int entries, struct io_uring_params *p)
+{
+    return (int) syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int sys_io_uring_enter(int fd, unsigned int to_submit,
+        unsigned int min_complete, unsigned int flags)
+{
+    return (int) syscall(__NR_io_uring_enter, fd, to_submit, min_complete,
+            flags, NULL, 0);
+}
+
+static int sys_io_uring_register(int fd, unsigned int opcode, void *arg,
+        unsigned int nr_args)
+{
+    return (int) syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+static void ring_unmap(struct uring *r)
+{
+    if (r->sqes != NULL && r->sqes != MAP_FAILED) {
+        munmap(r->sqes, r->sqes_len);
+    }
+    if (r->cq_ptr != NULL && r->cq_ptr != MAP_FAILED
+            && r->cq_ptr != r->sq_ptr) {
+        munmap(r->cq_ptr, r->cq_len);
+    }
+    if (r->sq_ptr != NULL && r->sq_ptr != MAP_FAILED) {
+        munmap(r->sq_ptr, r->sq_len);
+    }
+    if (r->fd >= 0) {
+        close(r->fd);
+    }
+    memset(r, 0, sizeof(*r));
+    r->fd = -1;
+}
+
+/**
+ * Creates the ring and maps it into our address space. Returns 0 on success
+ * or -1 if io_uring is unavailable or too old for what we need.
+ */
+static int ring_setup(struct uring *r, unsigned int entries)
+{
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    memset(r, 0, sizeof(*r));
+    r->fd = -1;
+
+    int fd = sys_io_uring_setup(entries, &p);
+    if (fd < 0) {
+        LOG("io_uring_setup: %s\n", strerror(errno));
+        return -1;
+    }
+    r->fd = fd;
+
+    /* Opening into (and closing) direct descriptors arrived in 5.15 and cannot
+     * be probed for directly. IORING_FEAT_CQE_SKIP (5.17) is the oldest feature
+     * flag that guarantees it. */
+    if ((p.features & IORING_FEAT_CQE_SKIP) == 0) {
+        LOGP("io_uring lacks direct descriptor support\n");
+        ring_unmap(r);
+        return -1;
+    }
+
+    r->sq_len = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+    r->cq_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    bool single_mmap = (p.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single_mmap) {
+        if (r->cq_len > r->sq_len) {
+            r->sq_len = r->cq_len;
+        }
+        r->cq_len = r->sq_len;
+    }
+
+    r->sq_ptr = mmap(NULL, r->sq_len, PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if (r->sq_ptr == MAP_FAILED) {
+        ring_unmap(r);
+        return -1;
+    }
+
+    if (single_mmap) {
+        r->cq_ptr = r->sq_ptr;
+    } else {
+        r->cq_ptr = mmap(NULL, r->cq_len, PROT_READ | PROT_WRITE,
+                MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+        if (r->cq_ptr == MAP_FAILED) {
+            ring_unmap(r);
+            return -1;
+        }
+    }
+
+    r->sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+    r->sqes = mmap(NULL, r->sqes_len, PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (r->sqes == MAP_FAILED) {
+        ring_unmap(r);
+        return -1;
+    }
+
+    char *sq = r->sq_ptr;
+    char *cq = r->cq_ptr;
+    r->sq_entries = p.sq_entries;
+    r->sq_head = (unsigned int *) (sq + p.sq_off.head);
+    r->sq_tail = (unsigned int *) (sq + p.sq_off.tail);
+    r->sq_mask = (unsigned int *) (sq + p.sq_off.ring_mask);
+    r->sq_array = (unsigned int *) (sq + p.sq_off.array);
+    r->cq_head = (unsigned int *) (cq + p.cq_off.head);
+    r->cq_tail = (unsigned int *) (cq + p.cq_off.tail);
+    r->cq_mask = (unsigned int *) (cq + p.cq_off.ring_mask);
+    r->cqes = (struct io_uring_cqe *) (cq + p.cq_off.cqes);
+
+    /* SQEs are always consumed in order, so the indirection array can be an
+     * identity mapping set up once. */
+    for (unsigned int i = 0; i < p.sq_entries; ++i) {
+        r->sq_array[i] = i;
+    }
+    r->sqe_tail = *r->sq_tail;
+
+    return 0;
+}
+
+/**
+ * Returns the next free SQE, zeroed, or NULL if the submission ring is full.
+ */
+static struct io_uring_sqe *ring_get_sqe(struct uring *r)
+{
+    unsigned int head = __atomic_load_n(r->sq_head, __ATOMIC_ACQUIRE);
+    if (r->sqe_tail - head >= r->sq_entries) {
+        return NULL;
+    }
+
+    struct io_uring_sqe *sqe = &r->sqes[r->sqe_tail & *r->sq_mask];
+    r->sqe_tail++;
+    memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+}
+
+static unsigned int ring_sq_space(struct uring *r)
+{
+    unsigned int head = __atomic_load_n(r->sq_head, __ATOMIC_ACQUIRE);
+    return r->sq_entries - (r->sqe_tail - head);
+}
+
+/**
+ * Publishes queued SQEs and waits for at least min_complete completions.
+ * SQEs the kernel did not take (it stops early when the completion queue is
+ * backed up) stay between the kernel's head and the tail, and are submitted
+ * by the next call.
+ */
+static int ring_submit_and_wait(struct uring *r, unsigned int min_complete)
+{
+    __atomic_store_n(r->sq_tail, r->sqe_tail, __ATOMIC_RELEASE);
+
+    unsigned int flags = min_complete > 0 ? IORING_ENTER_GETEVENTS : 0;
+    for (;;) {
+        unsigned int to_submit = r->sqe_tail
+            - __atomic_load_n(r->sq_head, __ATOMIC_ACQUIRE);
+        if (to_submit == 0 && min_complete == 0) {
+            return 0;
+        }
+        int ret = sys_io_uring_enter(r->fd, to_submit, min_complete, flags);
+        TRACE(TRACE_VERBOSE, "io_uring_enter", to_submit, ret);
+        stats_add(STAT_SYSCALLS, 1);
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EBUSY) {
+                /* Completion queue is backed up: let the caller reap. */
+                return 0;
+            }
+            return -1;
+        }
+        if ((unsigned int) ret >= to_submit) {
+            return 0;
+        }
+    }
+}
+
+/**
+ * Queues a read of the rest of a request's buffer from the slot's direct
+ * descriptor, starting where the previous reads stopped.
+ */
+static void queue_read_at(struct io_batch *b, struct io_req *req,
+        unsigned int s)
+{
+    size_t off = (size_t) b->slots[s].read_res;
+    struct io_uring_sqe *sqe = ring_get_sqe(&b->ring);
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = (int) s;
+    sqe->addr = (uint64_t) (uintptr_t) (req->buf + off);
+    sqe->len = (unsigned int) (req->size - 1 - off);
+    sqe->off = off;
+    sqe->flags = IOSQE_FIXED_FILE;
+    sqe->user_data = ((uint64_t) s << OP_BITS) | OP_READ;
+    b->slots[s].pending++;
+}
+
+static void queue_close(struct io_batch *b, unsigned int s)
+{
+    struct io_uring_sqe *sqe = ring_get_sqe(&b->ring);
+    sqe->opcode = IORING_OP_CLOSE;
+    sqe->file_index = s + 1;
+    sqe->user_data = ((uint64_t) s << OP_BITS) | OP_CLOSE;
+    b->slots[s].pending++;
+}
+
+static void queue_read(struct io_batch *b, struct io_req *req, unsigned int s)
+{
+    /* The hard link starts the first read even if the open fails (it then
+     * fails with EBADF). Further reads and the close are queued as the
+     * reads complete; see read_done(). */
+    struct io_uring_sqe *sqe = ring_get_sqe(&b->ring);
+    sqe->opcode = IORING_OP_OPENAT;
+    sqe->fd = b->dir;
+    sqe->addr = (uint64_t) (uintptr_t) req->path;
+    sqe->open_flags = O_RDONLY;
+    sqe->file_index = s + 1;
+    sqe->flags = IOSQE_IO_HARDLINK;
+    sqe->user_data = ((uint64_t) s << OP_BITS) | OP_OPEN;
+
+    b->slots[s].pending = 1;
+    queue_read_at(b, req, s);
+}
+
+static void queue_stat(struct io_batch *b, struct io_req *req, unsigned int s)
+{
+    struct io_uring_sqe *sqe = ring_get_sqe(&b->ring);
+    sqe->opcode = IORING_OP_STATX;
+    sqe->fd = b->dir;
+    sqe->addr = (uint64_t) (uintptr_t) req->path;
+    sqe->len = STATX_UID;
+    sqe->off = (uint64_t) (uintptr_t) &b->slots[s].stx;
+    sqe->user_data = ((uint64_t) s << OP_BITS) | OP_STAT;
+
+    b->slots[s].pending = 1;
+}
+
+static void finish_slot(struct io_batch *b, struct io_req *reqs, unsigned int s)
+{
+    struct slot *slot = &b->slots[s];
+    struct io_req *req = &reqs[slot->req];
+
+    if (req->kind == IO_REQ_STAT) {
+        if (slot->open_res < 0) {
+            req->result = slot->open_res;
+        } else {
+            req->uid = slot->stx.stx_uid;
+            req->result = 0;
+        }
+    } else if (slot->open_res < 0) {
+        req->result = slot->open_res;
+    } else {
+        req->result = slot->read_res;
+        if (slot->read_res >= 0) {
+            req->buf[slot->read_res] = '\0';
+        }
+        stats_add(STAT_FILES_OPENED, 1);
+        stats_add(STAT_BYTES_READ, slot->read_res > 0 ? slot->read_res : 0);
+    }
+
+    b->free_slots[b->nfree++] = s;
+}
+
+/**
+ * Handles a completed read. Like the synchronous backend, a short read is
+ * followed by another one until the buffer is full or a read returns 0 (end
+ * of file) or fails; a failure only counts if nothing was read before it.
+ */
+static void read_done(struct io_batch *b, struct io_req *req, unsigned int s,
+        int res)
+{
+    struct slot *slot = &b->slots[s];
+    if (slot->open_res < 0) {
+        /* Nothing to read from or close */
+        return;
+    }
+
+    if (res > 0) {
+        slot->read_res += res;
+        if ((size_t) slot->read_res < req->size - 1) {
+            queue_read_at(b, req, s);
+            return;
+        }
+    } else if (res < 0 && slot->read_res == 0) {
+        slot->read_res = res;
+    }
+    queue_close(b, s);
+}
+
+/**
+ * Drains the completion ring. Returns the number of requests that finished.
+ */
+static size_t reap(struct io_batch *b, struct io_req *reqs)
+{
+    struct uring *r = &b->ring;
+    unsigned int head = *r->cq_head;
+    unsigned int tail = __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE);
+    size_t finished = 0;
+
+    while (head != tail) {
+        struct io_uring_cqe *cqe = &r->cqes[head & *r->cq_mask];
+        unsigned int s = (unsigned int) (cqe->user_data >> OP_BITS);
+        struct slot *slot = &b->slots[s];
+
+        switch (cqe->user_data & ((1 << OP_BITS) - 1)) {
+            case OP_OPEN:
+            case OP_STAT:
+                slot->open_res = cqe->res;
+                break;
+            case OP_READ:
+                read_done(b, &reqs[slot->req], s, cqe->res);
+                break;
+            default:
+                break;
+        }
+
+        if (--slot->pending == 0) {
+            finish_slot(b, reqs, s);
+            finished++;
+        }
+        head++;
+    }
+
+    __atomic_store_n(r->cq_head, head, __ATOMIC_RELEASE);
+    return finished;
+}
+
+/**
+ * Services a batch through the ring. Returns 0 on success, or -1 if the ring
+ * itself failed, in which case the requests in the slots still in use and
+ * those from *next on have not completed.
+ */
+static int submit_uring(struct io_batch *b, struct io_req *reqs, size_t n,
+        size_t *next)
+{
+    size_t done = 0;
+
+    while (done < n) {
+        /* Keep the ring as full as free slots allow, then wait for whatever
+         * completes first and refill. */
+        while (*next < n && b->nfree > 0) {
+            unsigned int need = reqs[*next].kind == IO_REQ_READ ? 2 : 1;
+            if (ring_sq_space(&b->ring) < need) {
+                break;
+            }
+
+            unsigned int s = b->free_slots[--b->nfree];
+            b->slots[s].req = *next;
+            b->slots[s].open_res = 0;
+            b->slots[s].read_res = 0;
+            if (reqs[*next].kind == IO_REQ_READ) {
+                queue_read(b, &reqs[*next], s);
+            } else {
+                queue_stat(b, &reqs[*next], s);
+            }
+            (*next)++;
+        }
+
+        if (ring_submit_and_wait(&b->ring, 1) == -1) {
+            return -1;
+        }
+        done += reap(b, reqs);
+    }
+    return 0;
+}
+
+static void sync_one(struct io_batch *b, struct io_req *req)
+{
+    if (req->kind == IO_REQ_STAT) {
+        struct stat st;
+        stats_add(STAT_SYSCALLS, 1);
+        if (fstatat(b->dir, req->path, &st, 0) == -1) {
+            req->result = -errno;
+        } else {
+            req->uid = st.st_uid;
+            req->result = 0;
+        }
+        return;
+    }
+
+    int fd = openat(b->dir, req->path, O_RDONLY);
+    stats_add(STAT_SYSCALLS, 1);
+    if (fd == -1) {
+        req->result = -errno;
+        return;
+    }
+    stats_add(STAT_FILES_OPENED, 1);
+
+    /* Read until the buffer is full or end of file; an error only counts if
+     * nothing was read before it (see read_done()) */
+    size_t total = 0;
+    ssize_t read_sz = 0;
+    while (total < req->size - 1) {
+        read_sz = read(fd, req->buf + total, req->size - 1 - total);
+        stats_add(STAT_SYSCALLS, 1);
+        if (read_sz <= 0) {
+            break;
+        }
+        total += read_sz;
+    }
+    req->result = read_sz < 0 && total == 0 ? -errno : (ssize_t) total;
+    req->buf[total] = '\0';
+    close(fd);
+    stats_add(STAT_SYSCALLS, 1);
+    stats_add(STAT_BYTES_READ, total);
+}
+
+/**
+ * Gives up on the ring after a failed io_uring_enter and services whatever
+ * had not completed synchronously. Closing the ring cancels the requests
+ * still in flight, which would only have stored the same file contents.
+ */
+static void fall_back_to_sync(struct io_batch *b, struct io_req *reqs,
+        size_t n, size_t next)
+{
+    const char *err = strerror(errno);
+    LOG("io_uring_enter: %s; falling back to synchronous reads\n", err);
+    ring_unmap(&b->ring);
+    b->backend = IO_SYNC;
+
+    for (unsigned int s = 0; s < b->nslots; ++s) {
+        if (b->slots[s].pending > 0) {
+            sync_one(b, &reqs[b->slots[s].req]);
+        }
+    }
+    for (size_t i = next; i < n; ++i) {
+        sync_one(b, &reqs[i]);
+    }
+}
+
+struct io_batch *io_batch_create(enum io_backend want, int dir,
+        unsigned int depth)
+{
+    struct io_batch *b = calloc(1, sizeof(struct io_batch));
+    if (b == NULL) {
+        return NULL;
+    }
+    b->backend = IO_SYNC;
+    b->dir = dir;
+    b->ring.fd = -1;
+
+    if (want == IO_SYNC || depth == 0) {
+        return b;
+    }
+
+    /* A slot has at most two SQEs queued at once: openat and the first read,
+     * then one further read or the close at a time */
+    if (ring_setup(&b->ring, depth * 2) == -1) {
+        return b;
+    }
+
+    b->nslots = depth;
+    b->slots = calloc(depth, sizeof(struct slot));
+    b->free_slots = calloc(depth, sizeof(unsigned int));
+    int *fds = malloc(depth * sizeof(int));
+    if (b->slots == NULL || b->free_slots == NULL || fds == NULL) {
+        free(fds);
+        io_batch_destroy(b);
+        return NULL;
+    }
+
+    /* Register an empty (sparse) file table to open direct descriptors into */
+    for (unsigned int i = 0; i < depth; ++i) {
+        fds[i] = -1;
+        b->free_slots[i] = depth - 1 - i;
+    }
+    b->nfree = depth;
+    int ret = sys_io_uring_register(b->ring.fd, IORING_REGISTER_FILES,
+            fds, depth);
+    free(fds);
+    if (ret == -1) {
+        LOG("io_uring_register: %s\n", strerror(errno));
+        ring_unmap(&b->ring);
+        return b;
+    }
+
+    b->backend = IO_URING;
+    return b;
+}
+
+void io_batch_submit(struct io_batch *batch, struct io_req *reqs, size_t n)
+{
+    TRACE(TRACE_DEBUG, "io_batch_submit", n, batch->backend);
+    if (batch->backend == IO_URING) {
+        size_t next = 0;
+        if (submit_uring(batch, reqs, n, &next) == -1) {
+            fall_back_to_sync(batch, reqs, n, next);
+        }
+        return;
+    }
+    for (size_t i = 0; i < n; ++i) {
+        sync_one(batch, &reqs[i]);
+    }
+}
+
+const char *io_batch_backend_name(const struct io_batch *batch)
+{
+    return batch->backend == IO_URING ? "io_uring" : "sync";
+}
+
+void io_batch_destroy(struct io_batch *batch)
+{
+    if (batch == NULL) {
+        return;
+    }
+    if (batch->ring.fd >= 0) {
+        ring_unmap(&batch->ring);
+    }
+    free(batch->slots);
+    free(batch->free_slots);
+    free(batch);
+}
+
+int io_backend_parse(const char *name, enum io_backend *out)
+{
+    if (strcmp(name, "auto") == 0) {
+        *out = IO_AUTO;
+    } else if (strcmp(name, "sync") == 0) {
+        *out = IO_SYNC;
+    } else if (strcmp(name, "uring") == 0) {
+        *out = IO_URING;
+    } else {
+        return -1;
+    }
+    return 0;
+}
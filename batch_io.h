@@ -0,0 +1,95 @@
+/**
+ * @file
+ *
+ * Batched file access for procfs scans. A batch is a list of independent
+ * requests (read a whole file, or look up a file's owner) that are handed to
+ * the kernel together. When io_uring is available, each file read is
+ * submitted as a linked openat/read pair using direct descriptors, with the
+ * close (or the next read, after a short read) queued when the read
+ * completes, so a batch of hundreds of files costs a handful of system calls
+ * instead of three per file. Otherwise the requests are serviced one at a
+ * time with the plain synchronous calls.
+ *
+ * Setting up a ring is not free (io_uring_setup, three mmaps, and a file
+ * table registration), so a batch context is meant to be created once and
+ * reused for every scan of the same directory.
+ */
+
+#ifndef _BATCH_IO_H_
+#define _BATCH_IO_H_
+
+#include <stddef.h>
+#include <sys/types.h>
+
+/**
+ * Selects the implementation used to service batches.
+ */
+enum io_backend {
+    IO_AUTO,  /**< io_uring if the kernel supports it, else synchronous */
+    IO_SYNC,  /**< open/read/close and stat for every request */
+    IO_URING, /**< io_uring; falls back to synchronous if unavailable */
+};
+
+/**
+ * Kinds of requests a batch can carry.
+ */
+enum io_req_kind {
+    IO_REQ_READ, /**< Read up to size - 1 bytes of path into buf */
+    IO_REQ_STAT, /**< Retrieve the owner of path into uid */
+};
+
+/**
+ * A single request in a batch. Paths are resolved relative to the directory
+ * the batch was created for.
+ */
+struct io_req {
+    enum io_req_kind kind;
+    const char *path;
+    char *buf;
+    size_t size;
+    uid_t uid;
+
+    /**
+     * Set when the batch completes: number of bytes read (READ), 0 (STAT), or
+     * a negative errno value on failure. Successful reads are NUL-terminated.
+     */
+    ssize_t result;
+};
+
+struct io_batch;
+
+/**
+ * Creates a batch context for requests relative to the directory fd 'dir'
+ * (which must stay open until the batch is destroyed). 'depth' bounds the
+ * number of file reads that are in flight at once. Never returns NULL unless
+ * out of memory; if io_uring cannot be set up the context silently uses the
+ * synchronous backend.
+ */
+struct io_batch *io_batch_create(enum io_backend want, int dir,
+        unsigned int depth);
+
+/**
+ * Services every request in reqs[0..n) and fills in the results. Returns once
+ * all of them have completed. Both backends read until the buffer is full or
+ * end of file. If the ring fails, the context switches to the synchronous
+ * backend for this and every later batch.
+ */
+void io_batch_submit(struct io_batch *batch, struct io_req *reqs, size_t n);
+
+/**
+ * Returns a printable name for the backend actually in use.
+ */
+const char *io_batch_backend_name(const struct io_batch *batch);
+
+/**
+ * Tears down the context, unmapping the rings if io_uring was in use.
+ */
+void io_batch_destroy(struct io_batch *batch);
+
+/**
+ * Parses a backend name ("auto", "sync", or "uring"). Returns 0 on success or
+ * -1 if the name is not recognized.
+ */
+int io_backend_parse(const char *name, enum io_backend *out);
+
+#endif
@@ -0,0 +1,169 @@
+/**
+ * @file
+ *
+ * Generates a synthetic procfs tree for benchmarking the task list: a
+ * directory containing one numbered subdirectory per task, each holding
+ * stat, statm, and status files shaped like the kernel's.
+ *
+ * Usage: ./mkprocfs <dir> <num_tasks>
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const char *states[] = {
+    "R (running)", "S (sleeping)", "D (disk sleep)", "I (idle)",
+};
+
+/**
+ * Writes a whole buffer to a new file at path. Returns 0 on success.
+ */
+static int write_file(const char *path, const char *buf, int len)
+{
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0444);
+    if (fd == -1) {
+        perror("open");
+        return -1;
+    }
+
+    int ret = write(fd, buf, len) == len ? 0 : -1;
+    if (ret == -1) {
+        perror("write");
+    }
+    close(fd);
+    return ret;
+}
+
+/**
+ * Writes the stat and statm files for the given PID.
+ */
+static int write_stat(int pid)
+{
+    char path[64];
+    char buf[512];
+    int len = snprintf(buf, sizeof(buf),
+            "%d (worker-%d) %c %d %d %d 0 -1 4194560 1021 0 0 0 %d %d 0 0 "
+            "20 0 %d 0 %d 108060672 2583 18446744073709551615 1 1 0 0 0 0 "
+            "671173123 4096 1260 0 0 0 17 %d 0 0 0 0 0\n",
+            pid, pid, states[pid % 4][0], pid > 1 ? pid / 2 : 0, pid, pid,
+            pid % 97, pid % 31, 1 + pid % 8, pid * 10, pid % 4);
+    snprintf(path, sizeof(path), "%d/stat", pid);
+    if (write_file(path, buf, len) == -1) {
+        return -1;
+    }
+
+    len = snprintf(buf, sizeof(buf), "26382 2583 1956 222 0 4738 0\n");
+    snprintf(path, sizeof(path), "%d/statm", pid);
+    return write_file(path, buf, len);
+}
+
+/**
+ * Writes the status file for the given PID. The body mirrors the set and
+ * order of fields a 5.x kernel produces so parsing costs are realistic.
+ */
+static int write_status(int pid)
+{
+    char path[64];
+    char buf[2048];
+    int len = snprintf(buf, sizeof(buf),
+            "Name:\tworker-%d\n"
+            "Umask:\t0022\n"
+            "State:\t%s\n"
+            "Tgid:\t%d\n"
+            "Ngid:\t0\n"
+            "Pid:\t%d\n"
+            "PPid:\t%d\n"
+            "TracerPid:\t0\n"
+            "Uid:\t0\t0\t0\t0\n"
+            "Gid:\t0\t0\t0\t0\n"
+            "FDSize:\t64\n"
+            "Groups:\t \n"
+            "NStgid:\t%d\n"
+            "NSpid:\t%d\n"
+            "NSpgid:\t%d\n"
+            "NSsid:\t%d\n"
+            "VmPeak:\t  170076 kB\n"
+            "VmSize:\t  105528 kB\n"
+            "VmLck:\t       0 kB\n"
+            "VmPin:\t       0 kB\n"
+            "VmHWM:\t   13252 kB\n"
+            "VmRSS:\t   10332 kB\n"
+            "RssAnon:\t    2508 kB\n"
+            "RssFile:\t    7824 kB\n"
+            "RssShmem:\t       0 kB\n"
+            "VmData:\t   18812 kB\n"
+            "VmStk:\t     132 kB\n"
+            "VmExe:\t     888 kB\n"
+            "VmLib:\t    9348 kB\n"
+            "VmPTE:\t      88 kB\n"
+            "VmSwap:\t       0 kB\n"
+            "HugetlbPages:\t       0 kB\n"
+            "CoreDumping:\t0\n"
+            "THP_enabled:\t1\n"
+            "Threads:\t%d\n"
+            "SigQ:\t0/7823\n"
+            "SigPnd:\t0000000000000000\n"
+            "ShdPnd:\t0000000000000000\n"
+            "SigBlk:\t7be3c0fe28014a03\n"
+            "SigIgn:\t0000000000001000\n"
+            "SigCgt:\t00000001800004ec\n"
+            "CapInh:\t0000000000000000\n"
+            "CapPrm:\t000001ffffffffff\n"
+            "CapEff:\t000001ffffffffff\n"
+            "CapBnd:\t000001ffffffffff\n"
+            "CapAmb:\t0000000000000000\n"
+            "NoNewPrivs:\t0\n"
+            "Seccomp:\t0\n"
+            "Speculation_Store_Bypass:\tthread vulnerable\n"
+            "Cpus_allowed:\tf\n"
+            "Cpus_allowed_list:\t0-3\n"
+            "Mems_allowed:\t00000000,00000001\n"
+            "Mems_allowed_list:\t0\n"
+            "voluntary_ctxt_switches:\t%d\n"
+            "nonvoluntary_ctxt_switches:\t%d\n",
+            pid, states[pid % 4], pid, pid, pid > 1 ? pid / 2 : 0,
+            pid, pid, pid, pid, 1 + pid % 8, pid * 3, pid % 17);
+
+    snprintf(path, sizeof(path), "%d/status", pid);
+    return write_file(path, buf, len);
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc != 3) {
+        fprintf(stderr, "Usage: %s <dir> <num_tasks>\n", argv[0]);
+        return 1;
+    }
+
+    const char *root = argv[1];
+    int tasks = atoi(argv[2]);
+
+    if (mkdir(root, 0755) == -1 && errno != EEXIST) {
+        perror("mkdir");
+        return 1;
+    }
+    if (chdir(root) == -1) {
+        perror("chdir");
+        return 1;
+    }
+
+    for (int pid = 1; pid <= tasks; ++pid) {
+        char path[64];
+        snprintf(path, sizeof(path), "%d", pid);
+        if (mkdir(path, 0755) == -1 && errno != EEXIST) {
+            perror("mkdir");
+            return 1;
+        }
+
+        if (write_stat(pid) == -1 || write_status(pid) == -1) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
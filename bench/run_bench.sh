@@ -0,0 +1,43 @@
+#!/usr/bin/env bash
+# Compares the synchronous and io_uring task list backends on synthetic procfs
+# trees. Usage: bench/run_bench.sh [task counts...] (default: 10000 100000)
+
+set -e
+
+root="$(cd "$(dirname "$0")/.." && pwd)"
+inspector="${root}/inspector"
+mkprocfs="${root}/bench/mkprocfs"
+work="$(mktemp -d "${TMPDIR:-/tmp}/inspector-bench.XXXXXX")"
+runs="${RUNS:-5}"
+
+trap 'chmod -R u+w "${work}"; rm -rf "${work}"' EXIT
+
+counts=("$@")
+if [[ ${#counts[@]} -eq 0 ]]; then
+    counts=(10000 100000)
+fi
+
+# Prints the best wall-clock time (in ms) of $runs runs of the task list
+best_ms() {
+    local best=""
+    for ((i = 0; i < runs; ++i)); do
+        local start end ms
+        start=$(date +%s%N)
+        "${inspector}" -t -p "$1" --io="$2" > /dev/null 2>&1
+        end=$(date +%s%N)
+        ms=$(( (end - start) / 1000000 ))
+        if [[ -z "${best}" || ${ms} -lt ${best} ]]; then
+            best=${ms}
+        fi
+    done
+    echo "${best}"
+}
+
+printf "%10s | %10s | %10s\n" "Tasks" "sync (ms)" "uring (ms)"
+printf -- "-----------+------------+-----------\n"
+for n in "${counts[@]}"; do
+    tree="${work}/proc-${n}"
+    "${mkprocfs}" "${tree}" "${n}"
+    printf "%10d | %10d | %10d\n" "${n}" \
+        "$(best_ms "${tree}" sync)" "$(best_ms "${tree}" uring)"
+done
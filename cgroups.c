@@ -0,0 +1,494 @@
+/**
+ * @file
+ *
+ * Per-cgroup resource usage. See cgroups.h for an overview.
+ */
+
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cgroups.h"
+#include "json.h"
+
+/**
+ * Cached cgroup of one PID. A PID of 0 marks an empty slot.
+ */
+struct pid_entry {
+    int pid;
+    unsigned long long start_time;
+    struct cgroup *cgroup;
+    unsigned long read_at; /**< Sample in which the cgroup file was read */
+    unsigned long seen;    /**< Last sample that looked the entry up */
+};
+
+/* Open-addressing hash tables, kept at or below half full. Every thread
+ * inspects its own procfs root (with its own PID namespace), so each has
+ * its own tables. */
+static __thread struct cgroup **groups;
+static __thread size_t groups_cap;
+static __thread size_t groups_count;
+
+static __thread struct pid_entry *pids;
+static __thread size_t pids_cap;
+static __thread size_t pids_count;
+
+/* Incremented by every cgroups_sample() call */
+static __thread unsigned long current_sample;
+
+static size_t path_hash(const char *path, size_t len)
+{
+    /* FNV-1a */
+    uint64_t h = 14695981039346656037ull;
+    for (size_t i = 0; i < len; ++i) {
+        h = (h ^ (unsigned char) path[i]) * 1099511628211ull;
+    }
+    return (size_t) h;
+}
+
+static size_t pid_hash(int pid, size_t mask)
+{
+    /* Fibonacci hashing spreads consecutive PIDs across the table */
+    return ((uint32_t) pid * 2654435769u) & mask;
+}
+
+/**
+ * Inserts a cgroup into a table that has room for it.
+ */
+static void groups_insert(struct cgroup **slots, size_t cap,
+        struct cgroup *cg)
+{
+    size_t h = path_hash(cg->path, strlen(cg->path)) & (cap - 1);
+    while (slots[h] != NULL) {
+        h = (h + 1) & (cap - 1);
+    }
+    slots[h] = cg;
+}
+
+static int groups_grow(void)
+{
+    size_t cap = groups_cap > 0 ? groups_cap * 2 : 64;
+    struct cgroup **slots = calloc(cap, sizeof(struct cgroup *));
+    if (slots == NULL) {
+        return -1;
+    }
+
+    for (size_t i = 0; i < groups_cap; ++i) {
+        if (groups[i] != NULL) {
+            groups_insert(slots, cap, groups[i]);
+        }
+    }
+
+    free(groups);
+    groups = slots;
+    groups_cap = cap;
+    return 0;
+}
+
+/**
+ * Returns the cgroup with the given path (not NUL-terminated), creating it if
+ * needed.
+ */
+static struct cgroup *cgroup_intern(const char *path, size_t len)
+{
+    if ((groups_count + 1) * 2 > groups_cap && groups_grow() == -1) {
+        return NULL;
+    }
+
+    size_t mask = groups_cap - 1;
+    size_t h = path_hash(path, len) & mask;
+    while (groups[h] != NULL) {
+        if (strncmp(groups[h]->path, path, len) == 0
+                && groups[h]->path[len] == '\0') {
+            return groups[h];
+        }
+        h = (h + 1) & mask;
+    }
+
+    struct cgroup *cg = calloc(1, sizeof(struct cgroup));
+    if (cg == NULL || (cg->path = strndup(path, len)) == NULL) {
+        free(cg);
+        return NULL;
+    }
+    cg->usage_usec = -1;
+    cg->memory_bytes = -1;
+    cg->rbytes = -1;
+    cg->wbytes = -1;
+
+    groups[h] = cg;
+    groups_count++;
+    return cg;
+}
+
+/**
+ * Moves the PID cache to a table of cap slots. Entries that have not been
+ * looked up for a full refresh period belong to tasks that most likely
+ * exited and are dropped.
+ */
+static int pids_rehash(size_t cap)
+{
+    struct pid_entry *slots = calloc(cap, sizeof(struct pid_entry));
+    if (slots == NULL) {
+        return -1;
+    }
+
+    pids_count = 0;
+    for (size_t i = 0; i < pids_cap; ++i) {
+        if (pids[i].pid != 0
+                && current_sample - pids[i].seen < CGROUP_REFRESH_SAMPLES) {
+            size_t h = pid_hash(pids[i].pid, cap - 1);
+            while (slots[h].pid != 0) {
+                h = (h + 1) & (cap - 1);
+            }
+            slots[h] = pids[i];
+            pids_count++;
+        }
+    }
+
+    free(pids);
+    pids = slots;
+    pids_cap = cap;
+    return 0;
+}
+
+/**
+ * Drops the cached PIDs and the interned cgroups that have not been looked
+ * up for a full refresh period, so that a long-running sampler does not keep
+ * every cgroup it has ever seen. A lookup marks both the PID entry and its
+ * cgroup, so no entry that survives points to a dropped cgroup.
+ */
+static void cache_evict(void)
+{
+    if (pids_cap > 0 && pids_rehash(pids_cap) == -1) {
+        return;
+    }
+    if (groups_cap == 0) {
+        return;
+    }
+
+    struct cgroup **slots = calloc(groups_cap, sizeof(struct cgroup *));
+    if (slots == NULL) {
+        return;
+    }
+
+    groups_count = 0;
+    for (size_t i = 0; i < groups_cap; ++i) {
+        struct cgroup *cg = groups[i];
+        if (cg == NULL) {
+            continue;
+        }
+        if (current_sample - cg->seen >= CGROUP_REFRESH_SAMPLES) {
+            free(cg->path);
+            free(cg);
+        } else {
+            groups_insert(slots, groups_cap, cg);
+            groups_count++;
+        }
+    }
+
+    free(groups);
+    groups = slots;
+}
+
+/**
+ * Returns the cache slot of a PID: either its entry or the empty slot where
+ * it would be inserted.
+ */
+static struct pid_entry *pid_slot(int pid)
+{
+    size_t mask = pids_cap - 1;
+    size_t h = pid_hash(pid, mask);
+    while (pids[h].pid != 0 && pids[h].pid != pid) {
+        h = (h + 1) & mask;
+    }
+    return &pids[h];
+}
+
+struct cgroup *cgroup_cache_lookup(int pid, unsigned long long start_time)
+{
+    if (pids_cap == 0) {
+        return NULL;
+    }
+
+    struct pid_entry *entry = pid_slot(pid);
+    if (entry->pid != pid || entry->start_time != start_time
+            || current_sample - entry->read_at >= CGROUP_REFRESH_SAMPLES) {
+        return NULL;
+    }
+    entry->seen = current_sample;
+    entry->cgroup->seen = current_sample;
+    return entry->cgroup;
+}
+
+struct cgroup *cgroup_cache_store(int pid, unsigned long long start_time,
+        const char *buf)
+{
+    /* The unified hierarchy is the "0::/path" line; with cgroup v1 there
+     * may be other lines before it, or none at all. */
+    const char *line = buf;
+    while (line != NULL && strncmp(line, "0::", 3) != 0) {
+        line = strchr(line, '\n');
+        if (line != NULL) {
+            line++;
+        }
+    }
+    if (line == NULL) {
+        return NULL;
+    }
+    line += 3;
+
+    struct cgroup *cg = cgroup_intern(line, strcspn(line, "\n"));
+    if (cg == NULL) {
+        return NULL;
+    }
+
+    cg->seen = current_sample;
+    if ((pids_count + 1) * 2 > pids_cap
+            && pids_rehash(pids_cap > 0 ? pids_cap * 2 : 1024) == -1) {
+        return cg;
+    }
+    struct pid_entry *entry = pid_slot(pid);
+    if (entry->pid == 0) {
+        pids_count++;
+    }
+    entry->pid = pid;
+    entry->start_time = start_time;
+    entry->cgroup = cg;
+    entry->read_at = current_sample;
+    entry->seen = current_sample;
+    return cg;
+}
+
+void cgroup_cache_free(void)
+{
+    for (size_t i = 0; i < groups_cap; ++i) {
+        if (groups[i] != NULL) {
+            free(groups[i]->path);
+            free(groups[i]);
+        }
+    }
+    free(groups);
+    groups = NULL;
+    groups_cap = 0;
+    groups_count = 0;
+
+    free(pids);
+    pids = NULL;
+    pids_cap = 0;
+    pids_count = 0;
+}
+
+/**
+ * Reads a cgroup interface file into buf. Returns false if it does not exist
+ * or cannot be read.
+ */
+static bool read_cgroup_file(const char *root, const struct cgroup *cg,
+        const char *file, struct file_buf *buf)
+{
+    char path[PATH_MAX];
+    int len = snprintf(path, sizeof(path), "%s%s/%s", root,
+            strcmp(cg->path, "/") == 0 ? "" : cg->path, file);
+    return len < (int) sizeof(path) && file_buf_read(buf, AT_FDCWD, path) != -1;
+}
+
+/**
+ * Sums the rbytes= and wbytes= fields of every device line in io.stat.
+ */
+static void parse_io_stat(char *buf, struct cgroup *cg)
+{
+    cg->rbytes = 0;
+    cg->wbytes = 0;
+
+    char *save;
+    for (char *tok = strtok_r(buf, " \n", &save); tok != NULL;
+            tok = strtok_r(NULL, " \n", &save)) {
+        if (strncmp(tok, "rbytes=", 7) == 0) {
+            cg->rbytes += atoll(tok + 7);
+        } else if (strncmp(tok, "wbytes=", 7) == 0) {
+            cg->wbytes += atoll(tok + 7);
+        }
+    }
+}
+
+/**
+ * Moves the counters of a cgroup to its previous sample and reads new ones.
+ */
+static void cgroup_read(struct cgroup *cg, const char *root,
+        struct file_buf *buf)
+{
+    cg->has_prev = cg->usage_usec != -1 || cg->rbytes != -1;
+    cg->prev_usage_usec = cg->usage_usec;
+    cg->prev_rbytes = cg->rbytes;
+    cg->prev_wbytes = cg->wbytes;
+    cg->prev_time = cg->time;
+
+    cg->usage_usec = -1;
+    cg->memory_bytes = -1;
+    cg->rbytes = -1;
+    cg->wbytes = -1;
+    clock_gettime(CLOCK_MONOTONIC, &cg->time);
+
+    if (read_cgroup_file(root, cg, "cpu.stat", buf)) {
+        /* "usage_usec N" is the first line */
+        sscanf(buf->data, "usage_usec %lld", &cg->usage_usec);
+    }
+    if (read_cgroup_file(root, cg, "memory.current", buf)) {
+        sscanf(buf->data, "%lld", &cg->memory_bytes);
+    }
+    if (read_cgroup_file(root, cg, "io.stat", buf)) {
+        parse_io_stat(buf->data, cg);
+    }
+}
+
+static int compare_paths(const void *a, const void *b)
+{
+    const struct cgroup *const *x = a;
+    const struct cgroup *const *y = b;
+    return strcmp((*x)->path, (*y)->path);
+}
+
+int cgroups_sample(struct cgroup_sample *sample, int root,
+        const char *cgroup_root, const struct task_filter *filter,
+        enum io_backend backend)
+{
+    if (sample->scanner == NULL
+            && (sample->scanner = task_scanner_create(root, backend)) == NULL) {
+        return -1;
+    }
+    current_sample++;
+
+    struct task *tasks;
+    size_t ntasks = task_scanner_scan(sample->scanner, SRC_STAT | SRC_CGROUP,
+            filter, &tasks);
+    if (tasks == NULL) {
+        return -1;
+    }
+
+    sample->n = 0;
+    sample->tasks = ntasks;
+    for (size_t i = 0; i < ntasks; ++i) {
+        struct cgroup *cg = tasks[i].cgroup;
+        if (cg == NULL) {
+            continue;
+        }
+
+        if (cg->sample != current_sample) {
+            if (sample->n == sample->cap) {
+                size_t cap = sample->cap > 0 ? sample->cap * 2 : 64;
+                struct cgroup **list = realloc(sample->groups,
+                        cap * sizeof(struct cgroup *));
+                if (list == NULL) {
+                    free(tasks);
+                    return -1;
+                }
+                sample->groups = list;
+                sample->cap = cap;
+            }
+            sample->groups[sample->n++] = cg;
+            cg->sample = current_sample;
+            cg->tasks = 0;
+            cg->threads = 0;
+        }
+
+        cg->tasks++;
+        if (tasks[i].threads > 0) {
+            cg->threads += tasks[i].threads;
+        }
+    }
+    free(tasks);
+
+    for (size_t i = 0; i < sample->n; ++i) {
+        cgroup_read(sample->groups[i], cgroup_root, &sample->buf);
+    }
+    if (sample->n > 0) {
+        qsort(sample->groups, sample->n, sizeof(struct cgroup *),
+                compare_paths);
+    }
+
+    if (current_sample % CGROUP_REFRESH_SAMPLES == 0) {
+        cache_evict();
+    }
+    return 0;
+}
+
+/**
+ * Formats a rate from counter_rate() with two decimals, or "-" if unknown.
+ */
+static void format_rate(double rate, char *buf, size_t sz)
+{
+    if (rate < 0) {
+        snprintf(buf, sz, "-");
+    } else {
+        snprintf(buf, sz, "%.2f", rate);
+    }
+}
+
+int cgroups_print(FILE *out, const struct cgroup_sample *sample)
+{
+    fprintf(out, "Tasks | Threads |   CPU %% |   Memory | Read MB/s "
+            "| Write MB/s | Cgroup\n");
+    fprintf(out, "------+---------+---------+----------+-----------"
+            "+------------+--------\n");
+    int lines = 2;
+
+    for (size_t i = 0; i < sample->n; ++i) {
+        const struct cgroup *cg = sample->groups[i];
+        double dt = cg->has_prev ? elapsed_sec(&cg->prev_time, &cg->time) : 0;
+
+        char cpu[32];
+        char mem[32];
+        char rd[32];
+        char wr[32];
+        format_rate(counter_rate(cg->prev_usage_usec, cg->usage_usec, dt,
+                    100 / 1e6), cpu, sizeof(cpu));
+        format_kb(cg->memory_bytes >= 0 ? cg->memory_bytes / 1024 : -1,
+                mem, sizeof(mem));
+        format_rate(counter_rate(cg->prev_rbytes, cg->rbytes, dt, 1 / 1e6),
+                rd, sizeof(rd));
+        format_rate(counter_rate(cg->prev_wbytes, cg->wbytes, dt, 1 / 1e6),
+                wr, sizeof(wr));
+
+        fprintf(out, "%5zu | %7lld | %7s | %8s | %9s | %10s | %s\n",
+                cg->tasks, cg->threads, cpu, mem, rd, wr, cg->path);
+        lines++;
+    }
+
+    return lines;
+}
+
+void cgroups_print_json(FILE *out, const struct cgroup_sample *sample)
+{
+    fprintf(out, "[");
+    for (size_t i = 0; i < sample->n; ++i) {
+        const struct cgroup *cg = sample->groups[i];
+        double dt = cg->has_prev ? elapsed_sec(&cg->prev_time, &cg->time) : 0;
+
+        fprintf(out, "%s{\"cgroup\":", i > 0 ? "," : "");
+        json_string(out, cg->path);
+        fprintf(out, ",\"tasks\":%zu,\"threads\":%lld,\"cpu_pct\":",
+                cg->tasks, cg->threads);
+        json_number(out, counter_rate(cg->prev_usage_usec, cg->usage_usec,
+                    dt, 100 / 1e6));
+        fprintf(out, ",\"memory_bytes\":");
+        json_int(out, cg->memory_bytes);
+        fprintf(out, ",\"read_mb_per_sec\":");
+        json_number(out, counter_rate(cg->prev_rbytes, cg->rbytes, dt,
+                    1 / 1e6));
+        fprintf(out, ",\"write_mb_per_sec\":");
+        json_number(out, counter_rate(cg->prev_wbytes, cg->wbytes, dt,
+                    1 / 1e6));
+        fprintf(out, "}");
+    }
+    fprintf(out, "]");
+}
+
+void cgroup_sample_free(struct cgroup_sample *sample)
+{
+    free(sample->groups);
+    file_buf_free(&sample->buf);
+    task_scanner_destroy(sample->scanner);
+    memset(sample, 0, sizeof(*sample));
+}
@@ -0,0 +1,121 @@
+/**
+ * @file
+ *
+ * Per-cgroup resource usage (cgroup v2). Tasks are mapped to their cgroup
+ * through /proc/[pid]/cgroup as part of the regular task scan, and the
+ * cgroup's own cpu.stat, memory.current, and io.stat are read from the
+ * cgroupfs root.
+ *
+ * Cgroups are interned in a hash table keyed by path, so every task in the
+ * same cgroup points at the same record and aggregation is a single pass
+ * over the scan results. The cgroup of each PID is cached along with the
+ * task's start time: on later samples only new (or reused) PIDs have their
+ * cgroup file read, and cached entries are re-read every
+ * CGROUP_REFRESH_SAMPLES samples to pick up migrations. Cgroups and PIDs
+ * that have not been looked up for as long are dropped from the tables.
+ */
+
+#ifndef _CGROUPS_H_
+#define _CGROUPS_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "batch_io.h"
+#include "procfs.h"
+#include "tasks.h"
+
+/* Number of samples a cached PID to cgroup mapping stays valid */
+#define CGROUP_REFRESH_SAMPLES 10
+
+/**
+ * A cgroup and its most recent counters. Counters that could not be read
+ * (e.g., memory.current does not exist in the root cgroup) are -1.
+ */
+struct cgroup {
+    char *path; /**< Relative to the cgroupfs root, e.g., "/system.slice" */
+
+    /* Member tasks and their threads in the last sample */
+    size_t tasks;
+    long long threads;
+    unsigned long sample;
+    unsigned long seen; /**< Last sample that looked the cgroup up */
+
+    long long usage_usec;
+    long long memory_bytes;
+    long long rbytes;
+    long long wbytes;
+    struct timespec time;
+
+    /* Counters from the sample before, if has_prev */
+    bool has_prev;
+    long long prev_usage_usec;
+    long long prev_rbytes;
+    long long prev_wbytes;
+    struct timespec prev_time;
+};
+
+/**
+ * The cgroups that had member tasks in one sample, sorted by path.
+ * Zero-initialize before first use.
+ */
+struct cgroup_sample {
+    struct cgroup **groups;
+    size_t n;
+    size_t cap;
+    size_t tasks;
+    struct file_buf buf;
+    struct task_scanner *scanner; /**< Created by the first sample */
+};
+
+/**
+ * Returns the cached cgroup of a task, or NULL if the task's cgroup file has
+ * to be read (the PID is new, was reused, or its entry is due a refresh).
+ */
+struct cgroup *cgroup_cache_lookup(int pid, unsigned long long start_time);
+
+/**
+ * Parses the contents of /proc/[pid]/cgroup and caches the result for the
+ * task. Returns the task's cgroup, or NULL if the file has no cgroup v2
+ * entry or memory is exhausted.
+ */
+struct cgroup *cgroup_cache_store(int pid, unsigned long long start_time,
+        const char *buf);
+
+/**
+ * Frees every cached PID mapping and interned cgroup of the calling thread.
+ */
+void cgroup_cache_free(void);
+
+/**
+ * Scans the tasks below the procfs root directory fd 'root' that pass the
+ * filter, groups them by cgroup, and reads the counters of each cgroup below
+ * cgroup_root. The task scanner is kept in the sample for the next call, so
+ * root and backend must be the same every time. Returns 0 on success or -1
+ * on failure.
+ */
+int cgroups_sample(struct cgroup_sample *sample, int root,
+        const char *cgroup_root, const struct task_filter *filter,
+        enum io_backend backend);
+
+/**
+ * Prints a table of the cgroups in a sample to out. Rates are computed
+ * against each cgroup's previous sample, and shown as "-" if it had none.
+ * Returns the number of lines printed.
+ */
+int cgroups_print(FILE *out, const struct cgroup_sample *sample);
+
+/**
+ * Writes the same values as cgroups_print() as a JSON array of objects, one
+ * per cgroup, with null for values that are unknown.
+ */
+void cgroups_print_json(FILE *out, const struct cgroup_sample *sample);
+
+/**
+ * Frees the memory held by a sample (but not the cgroups it refers to).
+ */
+void cgroup_sample_free(struct cgroup_sample *sample);
+
+#endif
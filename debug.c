@@ -0,0 +1,164 @@
+/**
+ * @file
+ *
+ * Per-thread trace event buffers. See debug.h for an overview.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <time.h>
+
+#include "debug.h"
+
+/* Number of events a thread buffers before flushing */
+#define TRACE_RING_SZ 4096
+
+/* Size of the text buffer a flush formats events into */
+#define TRACE_OUT_SZ 65536
+
+/* Longest formatted event; longer ones are truncated */
+#define TRACE_LINE_SZ 512
+
+/**
+ * A recorded event. Formatting is deferred to the flush, so recording costs
+ * one clock read and a few stores.
+ */
+struct trace_event {
+    uint64_t ns;
+    const struct trace_site *site;
+    uint64_t args[2];
+};
+
+/**
+ * A thread's events. Only the owning thread reads or writes its ring, so no
+ * locks or atomics are needed.
+ */
+struct trace_ring {
+    struct trace_event events[TRACE_RING_SZ];
+    size_t n;
+    long tid;
+};
+
+static __thread struct trace_ring *ring;
+
+static pthread_key_t ring_key;
+static pthread_once_t ring_once = PTHREAD_ONCE_INIT;
+
+/**
+ * Writes all of buf to stderr, retrying short writes.
+ */
+static void write_all(const char *buf, size_t len)
+{
+    while (len > 0) {
+        ssize_t written = write(STDERR_FILENO, buf, len);
+        if (written == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return;
+        }
+        buf += written;
+        len -= written;
+    }
+}
+
+/**
+ * Formats one event as a line of at most TRACE_LINE_SZ - 1 bytes, ending in a
+ * newline even if truncated. Returns its length.
+ */
+static size_t format_event(char *line, const struct trace_event *ev, long tid)
+{
+    int n = snprintf(line, TRACE_LINE_SZ,
+            "[trace] %llu.%09llu %ld %s:%d:%s(): %s %llu %llu\n",
+            (unsigned long long) (ev->ns / 1000000000),
+            (unsigned long long) (ev->ns % 1000000000),
+            tid, ev->site->file, ev->site->line, ev->site->func,
+            ev->site->name, (unsigned long long) ev->args[0],
+            (unsigned long long) ev->args[1]);
+    if (n < 0) {
+        return 0;
+    }
+    if (n >= TRACE_LINE_SZ) {
+        line[TRACE_LINE_SZ - 2] = '\n';
+        return TRACE_LINE_SZ - 1;
+    }
+    return (size_t) n;
+}
+
+void trace_flush(void)
+{
+    if (ring == NULL || ring->n == 0) {
+        return;
+    }
+
+    char out[TRACE_OUT_SZ];
+    char line[TRACE_LINE_SZ];
+    size_t len = 0;
+    for (size_t i = 0; i < ring->n; ++i) {
+        size_t line_len = format_event(line, &ring->events[i], ring->tid);
+        if (TRACE_OUT_SZ - len < line_len) {
+            write_all(out, len);
+            len = 0;
+        }
+        memcpy(out + len, line, line_len);
+        len += line_len;
+    }
+    write_all(out, len);
+    ring->n = 0;
+}
+
+/**
+ * Flushes and frees the ring of an exiting thread.
+ */
+static void ring_release(void *arg)
+{
+    trace_flush();
+    free(ring);
+    ring = NULL;
+}
+
+/**
+ * Thread-specific data destructors do not run for the main thread, so the
+ * events it recorded are written when the program exits.
+ */
+static void main_exit(void)
+{
+    trace_flush();
+}
+
+static void ring_init_once(void)
+{
+    pthread_key_create(&ring_key, ring_release);
+    atexit(main_exit);
+}
+
+void trace_record(const struct trace_site *site, uint64_t a, uint64_t b)
+{
+    if (ring == NULL) {
+        pthread_once(&ring_once, ring_init_once);
+        ring = malloc(sizeof(struct trace_ring));
+        if (ring == NULL) {
+            return;
+        }
+        ring->n = 0;
+        ring->tid = syscall(SYS_gettid);
+        /* Any non-NULL value makes the destructor run at thread exit */
+        pthread_setspecific(ring_key, ring);
+    }
+
+    if (ring->n == TRACE_RING_SZ) {
+        trace_flush();
+    }
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    struct trace_event *ev = &ring->events[ring->n++];
+    ev->ns = (uint64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+    ev->site = site;
+    ev->args[0] = a;
+    ev->args[1] = b;
+}
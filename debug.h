@@ -4,11 +4,20 @@
  * Helps facilitate debugging by providing basic logging functionality. Unlike
  * printf-style debugging, the log messages can be enabled/disabled by changing 
  * the value of DEBUG.
+ *
+ * For instrumentation that has to stay cheap enough for timing runs there is
+ * also TRACE(), which records a binary event (timestamp, call site, and two
+ * integer arguments) in a per-thread ring buffer. Nothing is formatted or
+ * written until the ring fills up, the thread exits, or the program exits;
+ * then the whole batch is formatted and written to stderr at once. Sites
+ * above the compile-time TRACE_LEVEL compile to nothing.
  */
 
 #ifndef _DEBUG_H_
 #define _DEBUG_H_
 
+#include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <unistd.h>
 
@@ -27,12 +36,81 @@
 #define DEBUG_COLOR 1
 #endif
 
+/**
+ * Trace levels, from the coarsest (once per phase or scan) to the finest.
+ * TRACE_LEVEL is the most detailed level that is recorded; it defaults to
+ * TRACE_OFF, which compiles every TRACE() out.
+ */
+#define TRACE_OFF     0
+#define TRACE_INFO    1 /**< Once per section, scan, or live view tick */
+#define TRACE_DEBUG   2 /**< Once per batch of tasks or I/O requests */
+#define TRACE_VERBOSE 3 /**< Once per system call */
+
+#ifndef TRACE_LEVEL
+#define TRACE_LEVEL TRACE_OFF
+#endif
+
 #if DEBUG_COLOR
 #define COLOR_RED   "\033[0;31m"
 #define COLOR_BLUE  "\033[1;34m"
 #define COLOR_RESET "\033[0m"
 #endif
 
+/**
+ * A TRACE() call site. Each site has one static instance, and its address is
+ * the site id stored in the events.
+ */
+struct trace_site {
+    const char *file;
+    int line;
+    const char *func;
+    const char *name;
+};
+
+/**
+ * Appends an event to the calling thread's ring buffer, flushing the buffer
+ * first if it is full. Use TRACE() rather than calling this directly.
+ */
+void trace_record(const struct trace_site *site, uint64_t a, uint64_t b);
+
+/**
+ * Formats and writes the calling thread's buffered events to stderr.
+ */
+void trace_flush(void);
+
+/**
+ * Returns whether stderr is a terminal. The answer is looked up once, so log
+ * messages do not cost an extra system call each.
+ */
+static inline bool debug_isatty(void)
+{
+    /* -1 until checked; a race only means checking twice */
+    static int tty = -1;
+
+    int cached = __atomic_load_n(&tty, __ATOMIC_RELAXED);
+    if (cached == -1) {
+        cached = isatty(STDERR_FILENO);
+        __atomic_store_n(&tty, cached, __ATOMIC_RELAXED);
+    }
+    return cached;
+}
+
+/**
+ * Records a trace event with two integer arguments if level is at most
+ * TRACE_LEVEL.
+ *
+ * Example Usage:
+ * TRACE(TRACE_DEBUG, "io_batch_submit", n, backend);
+ */
+#define TRACE(level, name, a, b) \
+    do { \
+        if ((level) <= TRACE_LEVEL) { \
+            static const struct trace_site trace_site_ = { \
+                __FILE__, __LINE__, __func__, name }; \
+            trace_record(&trace_site_, (uint64_t) (a), (uint64_t) (b)); \
+        } \
+    } while (0)
+
 /**
  * Prints an unformatted log message (single string).
  *
@@ -43,7 +121,7 @@
     do { \
         if (DEBUG) { \
             if (DEBUG_COLOR) { \
-                if (isatty(STDERR_FILENO)) { \
+                if (debug_isatty()) { \
                     fprintf(stderr, "%s%s%s:%d:%s%s()%s: %s", \
                             COLOR_RED, __FILE__, COLOR_RESET, \
                             __LINE__, \
@@ -67,7 +145,7 @@
     do { \
         if (DEBUG) { \
             if (DEBUG_COLOR) { \
-                if (isatty(STDERR_FILENO)) { \
+                if (debug_isatty()) { \
                     fprintf(stderr, "%s%s%s:%d:%s%s()%s: " fmt, \
                             COLOR_RED, __FILE__, COLOR_RESET, \
                             __LINE__, \
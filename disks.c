@@ -0,0 +1,300 @@
+/**
+ * @file
+ *
+ * Disk I/O statistics from /proc/diskstats. See disks.h for an overview.
+ */
+
+#include <ctype.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "disks.h"
+#include "json.h"
+
+/* Size of a sector as reported in diskstats, regardless of the device */
+#define SECTOR_SZ 512
+
+static const char *virtual_prefixes[] = { "loop", "ram", "zram" };
+
+void disk_select_init(struct disk_select *sel, const char *arg)
+{
+    sel->all = arg != NULL && strcmp(arg, "all") == 0;
+    sel->names = (arg != NULL && !sel->all) ? arg : NULL;
+}
+
+/**
+ * Returns true if name is a partition of disk. The kernel names partitions
+ * after their disk with the partition number appended, and a 'p' in between
+ * if the disk name ends in a digit: sda1 of sda, nvme0n1p2 of nvme0n1, but
+ * not nvme0n10 of nvme0n1.
+ */
+static bool is_partition_of(const char *name, const char *disk)
+{
+    size_t len = strlen(disk);
+    if (len == 0 || strncmp(name, disk, len) != 0) {
+        return false;
+    }
+
+    const char *suffix = name + len;
+    if (isdigit((unsigned char) disk[len - 1])) {
+        if (*suffix != 'p') {
+            return false;
+        }
+        suffix++;
+    }
+    return *suffix != '\0' && strspn(suffix, "0123456789") == strlen(suffix);
+}
+
+static bool is_virtual(const char *name)
+{
+    for (size_t i = 0;
+            i < sizeof(virtual_prefixes) / sizeof(virtual_prefixes[0]); ++i) {
+        if (strncmp(name, virtual_prefixes[i],
+                    strlen(virtual_prefixes[i])) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+int disks_sample(struct disk_sample *sample, int root,
+        const struct disk_select *sel)
+{
+    if (file_buf_read(&sample->buf, root, "diskstats") == -1) {
+        return -1;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &sample->time);
+
+    sample->n = 0;
+
+    /* The kernel lists the partitions of a disk right after the disk
+     * itself, so remembering the last whole disk is enough to spot them. */
+    size_t last_disk = SIZE_MAX;
+
+    char *line = sample->buf.data;
+    while (line != NULL && *line != '\0') {
+        char *end = strchr(line, '\n');
+        if (end != NULL) {
+            *end = '\0';
+        }
+
+        if (sample->n == sample->cap) {
+            size_t cap = sample->cap > 0 ? sample->cap * 2 : 32;
+            struct disk_stat *disks = realloc(sample->disks,
+                    cap * sizeof(struct disk_stat));
+            if (disks == NULL) {
+                return -1;
+            }
+            sample->disks = disks;
+            sample->cap = cap;
+        }
+
+        struct disk_stat *d = &sample->disks[sample->n];
+        int matched = sscanf(line,
+                "%*u %*u %31s %llu %*u %llu %llu %llu %*u %llu %llu %*u %llu",
+                d->name, &d->rd_ios, &d->rd_sectors, &d->rd_ticks,
+                &d->wr_ios, &d->wr_sectors, &d->wr_ticks, &d->io_ticks);
+        line = (end != NULL) ? end + 1 : NULL;
+        if (matched != 8) {
+            continue;
+        }
+
+        bool partition = last_disk != SIZE_MAX
+            && is_partition_of(d->name, sample->disks[last_disk].name);
+        if (!partition) {
+            last_disk = sample->n;
+        }
+
+        if (sel->all) {
+            d->shown = true;
+        } else if (sel->names != NULL) {
+            d->shown = list_contains(sel->names, d->name);
+        } else {
+            d->shown = !partition && !is_virtual(d->name);
+        }
+        sample->n++;
+    }
+
+    return 0;
+}
+
+/**
+ * Finds the device in prev that corresponds to cur->disks[i]. Devices rarely
+ * change between samples, so the same index is tried first.
+ */
+static const struct disk_stat *find_prev(const struct disk_sample *prev,
+        const struct disk_stat *disk, size_t i)
+{
+    if (i < prev->n && strcmp(prev->disks[i].name, disk->name) == 0) {
+        return &prev->disks[i];
+    }
+    for (size_t j = 0; j < prev->n; ++j) {
+        if (strcmp(prev->disks[j].name, disk->name) == 0) {
+            return &prev->disks[j];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Rates of one device between two samples, or -1 where unknown.
+ */
+struct disk_rates {
+    double rd_s;
+    double wr_s;
+    double rmb_s;
+    double wmb_s;
+    double await_ms;
+    double util;
+};
+
+/**
+ * Computes the rates of a device between two samples dt seconds apart. The
+ * counters start over when a device is removed and added again under the
+ * same name, so a rate whose counter went backwards is unknown, and so is
+ * the wait time if any counter behind it is.
+ */
+static void disk_rates(const struct disk_stat *p, const struct disk_stat *d,
+        double dt, struct disk_rates *r)
+{
+    r->rd_s = counter_rate(p->rd_ios, d->rd_ios, dt, 1);
+    r->wr_s = counter_rate(p->wr_ios, d->wr_ios, dt, 1);
+    r->rmb_s = counter_rate(p->rd_sectors, d->rd_sectors, dt,
+            SECTOR_SZ / 1e6);
+    r->wmb_s = counter_rate(p->wr_sectors, d->wr_sectors, dt,
+            SECTOR_SZ / 1e6);
+
+    /* Milliseconds waited per I/O: the ratio of the rates is the ratio of
+     * the differences */
+    double rd_ticks = counter_rate(p->rd_ticks, d->rd_ticks, dt, 1);
+    double wr_ticks = counter_rate(p->wr_ticks, d->wr_ticks, dt, 1);
+    if (r->rd_s < 0 || r->wr_s < 0 || rd_ticks < 0 || wr_ticks < 0) {
+        r->await_ms = -1;
+    } else if (r->rd_s + r->wr_s > 0) {
+        r->await_ms = (rd_ticks + wr_ticks) / (r->rd_s + r->wr_s);
+    } else {
+        r->await_ms = 0;
+    }
+
+    r->util = counter_rate(p->io_ticks, d->io_ticks, dt, 100 / 1000.0);
+    if (r->util > 100) {
+        r->util = 100;
+    }
+}
+
+/**
+ * Formats a rate with the given number of decimals and suffix, or "-" if
+ * unknown.
+ */
+static void format_rate(double rate, int decimals, const char *suffix,
+        char *buf, size_t sz)
+{
+    if (rate < 0) {
+        snprintf(buf, sz, "-");
+    } else {
+        snprintf(buf, sz, "%.*f%s", decimals, rate, suffix);
+    }
+}
+
+/**
+ * Writes a rate as a JSON member with the given number of decimals, or null
+ * if unknown.
+ */
+static void json_rate(FILE *out, const char *name, double rate, int decimals)
+{
+    fprintf(out, ",\"%s\":", name);
+    if (rate < 0) {
+        fprintf(out, "null");
+    } else {
+        fprintf(out, "%.*f", decimals, rate);
+    }
+}
+
+/**
+ * Returns the seconds between two samples, or 1 if the clock did not move.
+ */
+static double sample_interval(const struct disk_sample *prev,
+        const struct disk_sample *cur)
+{
+    double dt = elapsed_sec(&prev->time, &cur->time);
+    return dt > 0 ? dt : 1;
+}
+
+int disks_print(FILE *out, const struct disk_sample *prev,
+        const struct disk_sample *cur)
+{
+    double dt = sample_interval(prev, cur);
+
+    fprintf(out, "Device           |     r/s |     w/s |   rMB/s |   wMB/s "
+            "| await ms |   Util\n");
+    fprintf(out, "-----------------+---------+---------+---------+---------"
+            "+----------+--------\n");
+    int lines = 2;
+
+    for (size_t i = 0; i < cur->n; ++i) {
+        const struct disk_stat *d = &cur->disks[i];
+        const struct disk_stat *p = find_prev(prev, d, i);
+        if (!d->shown || p == NULL) {
+            continue;
+        }
+
+        struct disk_rates r;
+        disk_rates(p, d, dt, &r);
+        char rd[16];
+        char wr[16];
+        char rmb[16];
+        char wmb[16];
+        char await[16];
+        char util[16];
+        format_rate(r.rd_s, 1, "", rd, sizeof(rd));
+        format_rate(r.wr_s, 1, "", wr, sizeof(wr));
+        format_rate(r.rmb_s, 2, "", rmb, sizeof(rmb));
+        format_rate(r.wmb_s, 2, "", wmb, sizeof(wmb));
+        format_rate(r.await_ms, 2, "", await, sizeof(await));
+        format_rate(r.util, 1, "%", util, sizeof(util));
+        fprintf(out, "%-16s | %7s | %7s | %7s | %7s | %8s | %6s\n",
+                d->name, rd, wr, rmb, wmb, await, util);
+        lines++;
+    }
+
+    return lines;
+}
+
+void disks_print_json(FILE *out, const struct disk_sample *prev,
+        const struct disk_sample *cur)
+{
+    double dt = sample_interval(prev, cur);
+    bool first = true;
+
+    fprintf(out, "[");
+    for (size_t i = 0; i < cur->n; ++i) {
+        const struct disk_stat *d = &cur->disks[i];
+        const struct disk_stat *p = find_prev(prev, d, i);
+        if (!d->shown || p == NULL) {
+            continue;
+        }
+
+        struct disk_rates r;
+        disk_rates(p, d, dt, &r);
+        fprintf(out, "%s{\"device\":", first ? "" : ",");
+        json_string(out, d->name);
+        json_rate(out, "reads_per_sec", r.rd_s, 2);
+        json_rate(out, "writes_per_sec", r.wr_s, 2);
+        json_rate(out, "read_mb_per_sec", r.rmb_s, 3);
+        json_rate(out, "write_mb_per_sec", r.wmb_s, 3);
+        json_rate(out, "await_ms", r.await_ms, 2);
+        json_rate(out, "util_pct", r.util, 1);
+        fprintf(out, "}");
+        first = false;
+    }
+    fprintf(out, "]");
+}
+
+void disk_sample_free(struct disk_sample *sample)
+{
+    free(sample->disks);
+    file_buf_free(&sample->buf);
+    memset(sample, 0, sizeof(*sample));
+}
@@ -0,0 +1,89 @@
+/**
+ * @file
+ *
+ * Disk I/O statistics from /proc/diskstats. Each sample reads the file once
+ * into a reusable buffer and parses every device into a reusable array;
+ * rates (IOPS, throughput, latency, utilization) are computed from the
+ * difference between two samples.
+ */
+
+#ifndef _DISKS_H_
+#define _DISKS_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "procfs.h"
+
+/**
+ * Cumulative counters of a single block device.
+ */
+struct disk_stat {
+    char name[32];
+    bool shown;
+    unsigned long long rd_ios;
+    unsigned long long rd_sectors;
+    unsigned long long rd_ticks;
+    unsigned long long wr_ios;
+    unsigned long long wr_sectors;
+    unsigned long long wr_ticks;
+    unsigned long long io_ticks;
+};
+
+/**
+ * All devices at one point in time. Zero-initialize before first use.
+ */
+struct disk_sample {
+    struct disk_stat *disks;
+    size_t n;
+    size_t cap;
+    struct timespec time;
+    struct file_buf buf;
+};
+
+/**
+ * Selects the devices to display. By default loop, RAM, and zram devices
+ * and partitions are skipped.
+ */
+struct disk_select {
+    bool all;          /**< Show every device */
+    const char *names; /**< Comma-separated device names to show, or NULL */
+};
+
+/**
+ * Parses the argument of --disks: "all", a comma-separated list of device
+ * names, or NULL for the default selection.
+ */
+void disk_select_init(struct disk_select *sel, const char *arg);
+
+/**
+ * Reads diskstats below the procfs root directory fd 'root' into sample.
+ * Returns 0 on success or -1 (with errno set) on failure, which is left to
+ * the caller to report so that a sampling loop can do it once.
+ */
+int disks_sample(struct disk_sample *sample, int root,
+        const struct disk_select *sel);
+
+/**
+ * Prints a table of per-device rates between two samples to out. A rate
+ * whose counters went backwards (the device was removed and added again) is
+ * shown as "-". Returns the number of lines printed.
+ */
+int disks_print(FILE *out, const struct disk_sample *prev,
+        const struct disk_sample *cur);
+
+/**
+ * Writes the same rates as disks_print() as a JSON array of objects, one per
+ * device, with null for unknown rates.
+ */
+void disks_print_json(FILE *out, const struct disk_sample *prev,
+        const struct disk_sample *cur);
+
+/**
+ * Frees the memory held by a sample.
+ */
+void disk_sample_free(struct disk_sample *sample);
+
+#endif
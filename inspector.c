@@ -9,26 +9,96 @@
  */
 
 #include <ctype.h>
+#include <errno.h>
 #include <dirent.h>
 #include <fcntl.h>
+#include <getopt.h>
 #include <limits.h>
 #include <math.h>
+#include <pthread.h>
 #include <pwd.h>
+#include <signal.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
 
+#include "batch_io.h"
+#include "cgroups.h"
 #include "debug.h"
+#include "disks.h"
+#include "json.h"
+#include "libinspector.h"
+#include "net.h"
+#include "numa.h"
+#include "psi.h"
+#include "rules.h"
+#include "sched.h"
+#include "stats.h"
+#include "tasks.h"
+#include "tree.h"
+
+/* Maximum number of procfs roots inspected at the same time */
+#define MAX_ROOT_THREADS 8
+
+/* Size of the stdout buffer in batch mode, flushed once per iteration */
+#define BATCH_BUF_SZ (1 << 20)
+
+/* Identifiers of options that only have a long form */
+enum long_opts {
+    OPT_IO = 256,
+    OPT_COLUMNS,
+    OPT_USER,
+    OPT_STATE,
+    OPT_NAME,
+    OPT_PID_RANGE,
+    OPT_TREE,
+    OPT_DISKS,
+    OPT_NET,
+    OPT_CGROUPS,
+    OPT_CGROUP_ROOT,
+    OPT_PSI,
+    OPT_NUMA,
+    OPT_SYSFS_ROOT,
+    OPT_STATS,
+    OPT_FORMAT,
+    OPT_WATCH,
+    OPT_WAITERS,
+};
+
+/* Output formats of batch and watch mode */
+enum output_format {
+    FORMAT_TEXT,
+    FORMAT_JSON,
+};
 
-#define BUF_SZ 1024
+/* Set by SIGINT and SIGTERM to end the live view, batch mode, or watch mode */
+static volatile sig_atomic_t stop_requested;
 
 
 /* Function prototypes */
 void print_usage(char *argv[]);
+void hardware_print(FILE *out, struct inspector *ins,
+        const struct cpu_times *prev, const struct cpu_times *cur);
+void print_bar(FILE *out, int filled);
+void cpu_usage(FILE *out, const struct cpu_times *prev,
+        const struct cpu_times *cur);
+void memory_usage(FILE *out, struct inspector *ins);
+void load_average(FILE *out, struct inspector *ins);
+void stall_bars(FILE *out, const struct psi_sample *prev,
+        const struct psi_sample *cur);
+void task_info(FILE *out, struct inspector *ins,
+        const struct column *const *cols, int ncols,
+        const struct task_filter *filter, const struct task_sample *rated);
+void task_list_print(FILE *out, struct inspector *ins,
+        const struct column *const *cols, int ncols,
+        const struct task_sample *sample, const struct task_filter *filter);
+void tree_info(FILE *out, struct inspector *ins,
+        const struct task_filter *filter);
 
 /**
  * This struct is a collection of booleans that controls whether or not the
@@ -39,774 +109,1377 @@ struct view_opts {
     bool live_view;
     bool system;
     bool task_list;
+    bool task_tree;
+    bool disks;
+    bool net;
+    bool cgroups;
+    bool psi;
+    bool numa;
+    bool waiters;
+};
+
+/**
+ * The sections to show and their settings. A single instance is shared,
+ * read-only, by the threads inspecting different procfs roots.
+ */
+struct inspect_opts {
+    struct view_opts views;
+    const struct column *columns[MAX_COLUMNS];
+    int ncols;
+    struct task_filter filter;
+    enum io_backend backend;
+    struct disk_select disk_sel;
+    struct net_select net_sel;
+    const char *sysfs_root;
+    const char *cgroup_root;
+    long nwaiters;
+
+    /* Batch mode (-b) and the sampling loop it shares with the live view */
+    bool batch;
+    long iterations;
+    long interval_ms;
+    enum output_format format;
+
+    /* Watch mode (--watch): rules evaluated on every tick of the loop */
+    const char *watch_path;
+    struct rule_set *rules;
 };
 
+/**
+ * A procfs root given with -p and, once inspected, its report.
+ */
+struct root_job {
+    const char *path;
+    struct inspector *ins;
+    char *report;
+    size_t report_len;
+};
+
+
+/**
+* Function to find and print the system info from the proc file system (default or other)
+* System info: Hostname, kernel version, uptime
+*/
+void sys_info(FILE *out, struct inspector *ins)
+{
+    fprintf(out, "System Information\n------------------\n");
+    struct system_info sys;
+    if (inspector_system(ins, &sys) == -1)
+    {
+        perror("system info");
+        return;
+    }
+    fprintf(out, "Hostname: %s\n", sys.hostname);
+    fprintf(out, "Kernel Version: %s\n", sys.kernel);
+    fprintf(out, "Uptime: ");
+
+    //convert seconds into years, days, hours, minutes, seconds
+    int time = (int) sys.uptime_sec;
+    int y, d, h, m, s;
+    y = time/60/60/24/365;
+    time -= y*60*60*24*365;
+    d = time/(24*60*60);
+    time -= d*24*60*60;
+    h = time/3600;
+    time -= h*3600;
+    m = time/60;
+    time -= m*60;
+    s = time;
+    //need to handle edge cases (0's) when printing
+    if (y != 0) {
+        fprintf(out, "%d years, ", y);
+    }
+    if (d == 0) {
+        if (h == 0) {
+            fprintf(out, "%d minutes, %d seconds\n", m, s);
+        } else {
+            fprintf(out, "%d hours, %d minutes, %d seconds\n", h, m, s);
+        }
+    } else {
+        if (h == 0) {
+            fprintf(out, " %d days, %d minutes, %d seconds\n", d, m, s);
+        } else {
+            fprintf(out, "%d days, %d hours, %d minutes, %d seconds\n", d, h, m, s);
+        }
+    }
+}
+
+/**
+* Function to get and print hardware info.
+* Information needed: CPU Model, Processing Units, Load Average, CPU Usage, and Memory Usage
+*/
+void hardware_info(FILE *out, struct inspector *ins)
+{
+    //calculate cpu usage: /proc/stat
+    //read from stat-- all the numbers in the first line are the total, the 4th column is the idle
+    //1 - ( (idle2 - idle1) / (total2 - total1) )
+    struct cpu_times cpu[2];
+    inspector_cpu_times(ins, &cpu[0]);
+    stats_sleep (1);
+    inspector_cpu_times(ins, &cpu[1]);
+    hardware_print(out, ins, &cpu[0], &cpu[1]);
+}
+
+/**
+ * Prints the hardware section, with the CPU usage between two samples.
+ */
+void hardware_print(FILE *out, struct inspector *ins,
+        const struct cpu_times *prev, const struct cpu_times *cur)
+{
+    fprintf(out, "Hardware Information\n");
+    fprintf(out, "--------------------\n");
+
+    struct cpu_info info = { "", 0 };
+    if (inspector_cpu_info(ins, &info) == -1)
+    {
+        perror("cpuinfo");
+    }
+    fprintf(out, "CPU Model: %s\n", info.model);
+    fprintf(out, "Processing Units: %d\n", info.units);
+
+    load_average(out, ins);
+    cpu_usage(out, prev, cur);
+    memory_usage(out, ins);
+}
+
+/**
+ * Prints the inside of a 20 character usage bar with 'filled' #s.
+ */
+void print_bar(FILE *out, int filled)
+{
+    for (int i = 0; i < 100; i+=5)
+    {
+        if (filled > 0)
+        {
+            fprintf(out, "#");
+            filled--;
+        } else
+        {
+            fprintf(out, "-");
+        }
+    }
+}
+
+/**
+ * Prints the CPU usage bar for the interval between two samples.
+ */
+void cpu_usage(FILE *out, const struct cpu_times *prev,
+        const struct cpu_times *cur)
+{
+    float c_usage = cpu_times_usage(prev, cur);
+    fprintf(out, "CPU Usage:    [");
+    print_bar(out, (int) c_usage / 5);
+    fprintf(out, "] %.1f%%\n", c_usage);
+}
+
+/**
+ * Prints the memory usage bar: active memory out of the total from
+ * /proc/meminfo.
+ */
+void memory_usage(FILE *out, struct inspector *ins)
+{
+    struct memory_info mem;
+    float tot = 0;
+    float active = 0;
+    if (inspector_memory(ins, &mem) == 0 && mem.total_kb > 0)
+    {
+        //convert kb to gb
+        tot = mem.total_kb / 1024.0 / 1024.0;
+        active = mem.active_kb > 0 ? mem.active_kb / 1024.0 / 1024.0 : 0;
+    }
+    float mem_usage = tot > 0 ? 100 * (active/tot) : 0;
+
+    fprintf(out, "Memory Usage: [");
+    print_bar(out, round(mem_usage) / 5);
+    fprintf(out, "] %.1f%% (%.1f GB / %.1f GB)\n", mem_usage, active, tot);
+}
+
+/**
+ * Prints the load average line.
+ */
+void load_average(FILE *out, struct inspector *ins)
+{
+    fprintf(out, "Load Average (1/5/15 min): ");
+    struct load_avg load;
+    if (inspector_load(ins, &load) == 0)
+    {
+        fprintf(out, "%.2f %.2f %.2f", load.avg[0], load.avg[1], load.avg[2]);
+    }
+    fprintf(out, "\n");
+}
+
+/**
+* Function to display disk I/O rates, measured over one second
+*/
+void disk_info(FILE *out, int root, const struct disk_select *sel)
+{
+    fprintf(out, "Disk I/O\n");
+    fprintf(out, "--------\n");
+
+    struct disk_sample disks[2] = { { 0 } };
+    if (disks_sample(&disks[0], root, sel) == -1)
+    {
+        perror("diskstats");
+    }
+    else
+    {
+        stats_sleep (1);
+        if (disks_sample(&disks[1], root, sel) == -1)
+        {
+            perror("diskstats");
+        }
+        else
+        {
+            disks_print(out, &disks[0], &disks[1]);
+        }
+    }
+    disk_sample_free(&disks[0]);
+    disk_sample_free(&disks[1]);
+}
 
-/** 
-* Function that reads each line in a file using the read system call.
+/**
+* Function to display network interface rates, measured over one second
 */
-int read_line(char *str, size_t size, int fd)
+void net_info(FILE *out, int root, const struct net_select *sel)
+{
+    fprintf(out, "Network Interfaces\n");
+    fprintf(out, "------------------\n");
+
+    struct net_sample ifaces[2] = { { 0 } };
+    if (net_sample(&ifaces[0], root, sel) == -1)
+    {
+        perror("net/dev");
+    }
+    else
+    {
+        stats_sleep (1);
+        if (net_sample(&ifaces[1], root, sel) == -1)
+        {
+            perror("net/dev");
+        }
+        else
+        {
+            net_print(out, &ifaces[0], &ifaces[1]);
+        }
+    }
+    net_sample_free(&ifaces[0]);
+    net_sample_free(&ifaces[1]);
+}
+
+/**
+ * Signal handler that asks the live view, batch mode, or watch mode to stop
+ * after the current tick.
+ */
+void request_stop(int sig)
+{
+    stop_requested = 1;
+}
+
+/**
+ * Counters sampled on every tick of the live view and batch mode. Rates are
+ * computed between consecutive ticks, which alternate between the two
+ * entries of each array.
+ */
+struct tick_state {
+    struct cpu_times cpu[2];
+    struct psi_sample psi[2];
+    struct disk_sample disks[2];
+    struct net_sample ifaces[2];
+    struct numa_sample nodes[2];
+    struct cgroup_sample cgroups;
+    struct task_sample tasks[2];   /**< Only for task list rate columns */
+    struct task_sample waiters[2];
+    bool has_psi;
+    bool has_numa;
+    bool disks_failed; /**< diskstats failed and was reported */
+    bool net_failed;   /**< net/dev failed and was reported */
+    bool numa_failed;  /**< NUMA sampling failed and was reported */
+};
+
+/**
+ * Scans the tasks that pass a filter into a sample, replacing its previous
+ * contents. stat is always read for the start times that task_rates() uses
+ * to tell reused PIDs apart.
+ */
+void task_sample_take(struct inspector *ins, unsigned int sources,
+        const struct task_filter *filter, struct task_sample *sample)
+{
+    task_sample_free(sample);
+    sample->n = inspector_tasks(ins, sources | SRC_STAT, filter,
+            &sample->tasks);
+    clock_gettime(CLOCK_MONOTONIC, &sample->time);
+}
+
+/**
+ * Returns the sources of the system-wide scans behind the waiters summary.
+ * If the task list has rate columns too, the same pair of scans serves it,
+ * so they also read what the list and its filter need.
+ */
+unsigned int waiters_sources(const struct inspect_opts *opts)
+{
+    unsigned int sources = SRC_SCHEDSTAT;
+    if (opts->views.task_list && columns_rates(opts->columns, opts->ncols))
+    {
+        sources |= columns_sources(opts->columns, opts->ncols)
+            | task_filter_sources(&opts->filter);
+    }
+    return sources;
+}
+
+/**
+ * Returns the tick's scan behind the task list's rate columns: the waiters
+ * scan if the summary is shown, whose tasks the list filters itself. NULL
+ * if the list has no rate columns.
+ */
+const struct task_sample *rated_tasks(const struct inspect_opts *opts,
+        const struct tick_state *t, int cur)
+{
+    if (!opts->views.task_list || !columns_rates(opts->columns, opts->ncols))
+    {
+        return NULL;
+    }
+    return opts->views.waiters ? &t->waiters[cur] : &t->tasks[cur];
+}
+
+/**
+ * Samples every counter the selected views need into entry i of the tick
+ * state. The first call decides whether PSI and NUMA are available.
+ */
+void tick_sample(struct inspector *ins, const struct inspect_opts *opts,
+        struct tick_state *t, int i, bool first)
+{
+    int root = inspector_root(ins);
+    const struct view_opts *views = &opts->views;
+
+    inspector_cpu_times(ins, &t->cpu[i]);
+    if (first)
+    {
+        /* The live view shows stall bars whenever PSI is available */
+        bool psi_rules = opts->rules != NULL && (rules_metrics(opts->rules)
+                & (1u << METRIC_PSI_CPU | 1u << METRIC_PSI_MEMORY
+                    | 1u << METRIC_PSI_IO));
+        t->has_psi = (views->psi || views->live_view || psi_rules)
+            && psi_sample(&t->psi[i], root) == 0;
+        t->has_numa = views->numa
+            && numa_sample(&t->nodes[i], root, opts->sysfs_root) == 0;
+        if (views->numa && !t->has_numa)
+        {
+            perror("NUMA nodes");
+            t->numa_failed = true;
+        }
+    }
+    else
+    {
+        if (t->has_psi)
+        {
+            psi_sample(&t->psi[i], root);
+        }
+        if (t->has_numa
+                && numa_sample(&t->nodes[i], root, opts->sysfs_root) == -1
+                && !t->numa_failed)
+        {
+            perror("NUMA nodes");
+            t->numa_failed = true;
+        }
+    }
+    if (views->disks && disks_sample(&t->disks[i], root, &opts->disk_sel) == -1
+            && !t->disks_failed)
+    {
+        perror("diskstats");
+        t->disks_failed = true;
+    }
+    if (views->net && net_sample(&t->ifaces[i], root, &opts->net_sel) == -1
+            && !t->net_failed)
+    {
+        perror("net/dev");
+        t->net_failed = true;
+    }
+    if (views->cgroups)
+    {
+        /* Cgroups keep their own previous counters */
+        cgroups_sample(&t->cgroups, root, opts->cgroup_root, &opts->filter,
+                opts->backend);
+    }
+    if (views->waiters)
+    {
+        /* The summary is system-wide; task filters do not apply */
+        struct task_filter all;
+        task_filter_init(&all);
+        task_sample_take(ins, waiters_sources(opts), &all, &t->waiters[i]);
+        if (!first)
+        {
+            task_rates(&t->waiters[!i], &t->waiters[i]);
+        }
+    }
+    else if (views->task_list && columns_rates(opts->columns, opts->ncols))
+    {
+        task_sample_take(ins, columns_sources(opts->columns, opts->ncols),
+                &opts->filter, &t->tasks[i]);
+        if (!first)
+        {
+            task_rates(&t->tasks[!i], &t->tasks[i]);
+        }
+    }
+}
+
+/**
+ * Frees the samples held by a tick state.
+ */
+void tick_free(struct tick_state *t)
+{
+    for (int i = 0; i < 2; ++i)
+    {
+        disk_sample_free(&t->disks[i]);
+        net_sample_free(&t->ifaces[i]);
+        numa_sample_free(&t->nodes[i]);
+        psi_sample_free(&t->psi[i]);
+        task_sample_free(&t->tasks[i]);
+        task_sample_free(&t->waiters[i]);
+    }
+    cgroup_sample_free(&t->cgroups);
+}
+
+/**
+ * Prints one tick of the live view: load average, CPU and memory bars, stall
+ * bars, and any of the sections the live view can show. Returns the number
+ * of lines printed.
+ */
+int live_print(FILE *out, struct inspector *ins,
+        const struct inspect_opts *opts, const struct tick_state *t,
+        int prev, int cur)
+{
+    const struct view_opts *views = &opts->views;
+
+    load_average(out, ins);
+    cpu_usage(out, &t->cpu[prev], &t->cpu[cur]);
+    memory_usage(out, ins);
+    int lines = 3;
+    if (t->has_psi)
+    {
+        stall_bars(out, &t->psi[prev], &t->psi[cur]);
+        lines += 3;
+    }
+
+    if (views->disks)
+    {
+        fprintf(out, "\n");
+        lines += 1 + disks_print(out, &t->disks[prev], &t->disks[cur]);
+    }
+    if (views->net)
+    {
+        fprintf(out, "\n");
+        lines += 1 + net_print(out, &t->ifaces[prev], &t->ifaces[cur]);
+    }
+    if (t->has_numa)
+    {
+        fprintf(out, "\n");
+        lines += 1 + numa_print(out, &t->nodes[prev], &t->nodes[cur]);
+    }
+    if (views->cgroups)
+    {
+        fprintf(out, "\n");
+        lines += 1 + cgroups_print(out, &t->cgroups);
+    }
+    return lines;
+}
+
+/**
+ * Prints a section title and a line of dashes under it.
+ */
+void print_heading(FILE *out, const char *title)
+{
+    fprintf(out, "%s\n%.*s\n", title, (int) strlen(title),
+            "----------------------------------------");
+}
+
+/**
+ * Prints one batch mode iteration as plain text: every selected section,
+ * with rates measured since the previous iteration.
+ */
+void batch_print_text(FILE *out, struct inspector *ins,
+        const struct inspect_opts *opts, const struct tick_state *t,
+        int prev, int cur, long iteration)
+{
+    const struct view_opts *views = &opts->views;
+
+    char when[32];
+    time_t now = time(NULL);
+    struct tm tm;
+    strftime(when, sizeof(when), "%Y-%m-%d %H:%M:%S",
+            localtime_r(&now, &tm));
+    fprintf(out, "%s==> iteration %ld at %s <==\n", iteration > 1 ? "\n" : "",
+            iteration, when);
+
+    if (views->system)
+    {
+        sys_info(out, ins);
+    }
+    if (views->hardware)
+    {
+        hardware_print(out, ins, &t->cpu[prev], &t->cpu[cur]);
+    }
+    if (views->psi)
+    {
+        print_heading(out, "Pressure Stall Information");
+        if (t->has_psi)
+        {
+            psi_print(out, &t->psi[prev], &t->psi[cur]);
+        }
+        else
+        {
+            fprintf(out, "Not available\n");
+        }
+    }
+    if (views->disks)
+    {
+        print_heading(out, "Disk I/O");
+        disks_print(out, &t->disks[prev], &t->disks[cur]);
+    }
+    if (views->net)
+    {
+        print_heading(out, "Network Interfaces");
+        net_print(out, &t->ifaces[prev], &t->ifaces[cur]);
+    }
+    if (views->numa)
+    {
+        print_heading(out, "NUMA Nodes");
+        if (t->has_numa)
+        {
+            numa_print(out, &t->nodes[prev], &t->nodes[cur]);
+        }
+        else
+        {
+            fprintf(out, "Not available\n");
+        }
+    }
+    if (views->cgroups)
+    {
+        print_heading(out, "Cgroups");
+        fprintf(out, "Tasks: %zu in %zu cgroup(s)\n\n", t->cgroups.tasks,
+                t->cgroups.n);
+        cgroups_print(out, &t->cgroups);
+    }
+    if (views->waiters)
+    {
+        print_heading(out, "Top Run Queue Waiters");
+        waiters_print(out, &t->waiters[cur], opts->nwaiters);
+    }
+    if (views->task_list)
+    {
+        /* Rate columns use the tasks scanned with the tick */
+        task_info(out, ins, opts->columns, opts->ncols, &opts->filter,
+                rated_tasks(opts, t, cur));
+    }
+    if (views->task_tree)
+    {
+        tree_info(out, ins, &opts->filter);
+    }
+}
+
+/**
+ * Writes the system and hardware sections as JSON members.
+ */
+void system_json(FILE *out, struct inspector *ins,
+        const struct view_opts *views, const struct tick_state *t,
+        int prev, int cur)
+{
+    if (views->system)
+    {
+        struct system_info sys;
+        fprintf(out, ",\"system\":");
+        if (inspector_system(ins, &sys) == 0)
+        {
+            fprintf(out, "{\"hostname\":");
+            json_string(out, sys.hostname);
+            fprintf(out, ",\"kernel\":");
+            json_string(out, sys.kernel);
+            fprintf(out, ",\"uptime_sec\":%.2f}", sys.uptime_sec);
+        }
+        else
+        {
+            fprintf(out, "null");
+        }
+    }
+
+    if (views->hardware)
+    {
+        struct cpu_info info = { "", 0 };
+        struct load_avg load = { { -1, -1, -1 } };
+        struct memory_info mem = { -1, -1, -1, -1 };
+        inspector_cpu_info(ins, &info);
+        inspector_load(ins, &load);
+        inspector_memory(ins, &mem);
+
+        fprintf(out, ",\"hardware\":{\"cpu_model\":");
+        json_string(out, info.model);
+        fprintf(out, ",\"processing_units\":%d,\"load\":[", info.units);
+        for (int i = 0; i < 3; ++i)
+        {
+            fprintf(out, "%s", i > 0 ? "," : "");
+            json_number(out, load.avg[i]);
+        }
+        fprintf(out, "],\"cpu_pct\":");
+        json_number(out, cpu_times_usage(&t->cpu[prev], &t->cpu[cur]));
+        fprintf(out, ",\"memory\":{\"total_kb\":");
+        json_int(out, mem.total_kb);
+        fprintf(out, ",\"free_kb\":");
+        json_int(out, mem.free_kb);
+        fprintf(out, ",\"available_kb\":");
+        json_int(out, mem.available_kb);
+        fprintf(out, ",\"active_kb\":");
+        json_int(out, mem.active_kb);
+        fprintf(out, "}}");
+    }
+}
+
+/**
+ * Writes the task list (as "tasks") and process tree (as "tree") sections as
+ * JSON members. The list uses the tasks of 'rated' if it is not NULL (see
+ * rated_tasks()).
+ */
+void tasks_json(FILE *out, struct inspector *ins,
+        const struct inspect_opts *opts, const struct task_sample *rated)
+{
+    const struct view_opts *views = &opts->views;
+    struct task *tasks;
+
+    if (views->task_list)
+    {
+        size_t count;
+        if (rated != NULL)
+        {
+            count = rated->n;
+            tasks = rated->tasks;
+        }
+        else
+        {
+            unsigned int sources = columns_sources(opts->columns,
+                    opts->ncols);
+            count = inspector_tasks(ins, sources, &opts->filter, &tasks);
+        }
+        fprintf(out, ",\"tasks\":[");
+        bool first = true;
+        for (size_t i = 0; i < count; ++i)
+        {
+            if (!task_filter_matches(&opts->filter, &tasks[i]))
+            {
+                continue;
+            }
+            fprintf(out, "%s", first ? "" : ",");
+            columns_print_json(out, inspector_users(ins), opts->columns,
+                    opts->ncols, &tasks[i]);
+            first = false;
+        }
+        fprintf(out, "]");
+        if (rated == NULL)
+        {
+            free(tasks);
+        }
+    }
+
+    if (views->task_tree)
+    {
+        size_t count = inspector_tasks(ins, SRC_STAT | SRC_STATM,
+                &opts->filter, &tasks);
+        struct task_tree tree;
+        fprintf(out, ",\"tree\":");
+        if (task_tree_build(tasks, count, &tree) == -1)
+        {
+            fprintf(out, "null");
+            free(tasks);
+            return;
+        }
+
+        fprintf(out, "[");
+        for (size_t i = 0; i < tree.norder; ++i)
+        {
+            int node = tree.order[i];
+            fprintf(out, "%s{\"pid\":%d,\"depth\":%d,\"threads\":%lld"
+                    ",\"cpu_ticks\":%llu,\"rss_kb\":", i > 0 ? "," : "",
+                    tasks[node].pid, tree.depth[node],
+                    tree.sub_threads[node], tree.sub_ticks[node]);
+            json_int(out, tree.sub_rss_kb[node]);
+            fprintf(out, ",\"name\":");
+            json_string(out, tasks[node].name);
+            fprintf(out, "}");
+        }
+        fprintf(out, "]");
+        task_tree_free(&tree);
+        free(tasks);
+    }
+}
+
+/**
+ * Prints one batch mode iteration as a single line holding a JSON object,
+ * with a member per selected section.
+ */
+void batch_print_json(FILE *out, struct inspector *ins,
+        const struct inspect_opts *opts, const struct tick_state *t,
+        int prev, int cur, long iteration)
+{
+    const struct view_opts *views = &opts->views;
+
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    fprintf(out, "{\"iteration\":%ld,\"time\":%lld.%03ld", iteration,
+            (long long) now.tv_sec, now.tv_nsec / 1000000);
+
+    system_json(out, ins, views, t, prev, cur);
+    if (views->psi)
+    {
+        fprintf(out, ",\"psi\":");
+        if (t->has_psi)
+        {
+            psi_print_json(out, &t->psi[prev], &t->psi[cur]);
+        }
+        else
+        {
+            fprintf(out, "null");
+        }
+    }
+    if (views->disks)
+    {
+        fprintf(out, ",\"disks\":");
+        disks_print_json(out, &t->disks[prev], &t->disks[cur]);
+    }
+    if (views->net)
+    {
+        fprintf(out, ",\"net\":");
+        net_print_json(out, &t->ifaces[prev], &t->ifaces[cur]);
+    }
+    if (views->numa)
+    {
+        fprintf(out, ",\"numa\":");
+        if (t->has_numa)
+        {
+            numa_print_json(out, &t->nodes[prev], &t->nodes[cur]);
+        }
+        else
+        {
+            fprintf(out, "null");
+        }
+    }
+    if (views->cgroups)
+    {
+        fprintf(out, ",\"cgroups\":");
+        cgroups_print_json(out, &t->cgroups);
+    }
+    if (views->waiters)
+    {
+        fprintf(out, ",\"waiters\":");
+        waiters_print_json(out, &t->waiters[cur], opts->nwaiters);
+    }
+    tasks_json(out, ins, opts, rated_tasks(opts, t, cur));
+    fprintf(out, "}\n");
+}
+
+/**
+ * Evaluates the watch mode rules against one tick and prints the rules that
+ * started or stopped firing. Only the metrics the rules use are read, and
+ * tasks are only scanned if a rule counts them.
+ */
+void watch_eval(FILE *out, struct inspector *ins,
+        const struct inspect_opts *opts, const struct tick_state *t,
+        int prev, int cur)
+{
+    unsigned int used = rules_metrics(opts->rules);
+    struct rule_input in;
+    memset(&in, 0, sizeof(in));
+    for (int m = 0; m < RULE_METRICS; ++m)
+    {
+        in.values[m] = -1;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &in.time);
+
+    in.values[METRIC_CPU] = cpu_times_usage(&t->cpu[prev], &t->cpu[cur]);
+
+    struct memory_info mem;
+    if ((used & (1u << METRIC_MEM_AVAILABLE | 1u << METRIC_MEM_FREE
+                    | 1u << METRIC_MEM_USED | 1u << METRIC_MEM_PCT))
+            && inspector_memory(ins, &mem) == 0
+            && mem.total_kb > 0 && mem.available_kb >= 0)
+    {
+        in.values[METRIC_MEM_AVAILABLE] = mem.available_kb * 1024.0;
+        in.values[METRIC_MEM_FREE] = mem.free_kb * 1024.0;
+        in.values[METRIC_MEM_USED] =
+            (mem.total_kb - mem.available_kb) * 1024.0;
+        in.values[METRIC_MEM_PCT] =
+            100.0 * (mem.total_kb - mem.available_kb) / mem.total_kb;
+    }
+
+    struct load_avg load;
+    if ((used & (1u << METRIC_LOAD1 | 1u << METRIC_LOAD5
+                    | 1u << METRIC_LOAD15))
+            && inspector_load(ins, &load) == 0)
+    {
+        in.values[METRIC_LOAD1] = load.avg[0];
+        in.values[METRIC_LOAD5] = load.avg[1];
+        in.values[METRIC_LOAD15] = load.avg[2];
+    }
+
+    if (t->has_psi)
+    {
+        in.values[METRIC_PSI_CPU] = psi_stall_pct(&t->psi[prev],
+                &t->psi[cur], PSI_CPU, false);
+        in.values[METRIC_PSI_MEMORY] = psi_stall_pct(&t->psi[prev],
+                &t->psi[cur], PSI_MEMORY, false);
+        in.values[METRIC_PSI_IO] = psi_stall_pct(&t->psi[prev],
+                &t->psi[cur], PSI_IO, false);
+    }
+
+    struct task *tasks = NULL;
+    if (used & (1u << METRIC_TASKS))
+    {
+        /* One scan of every task serves all of the selectors */
+        struct task_filter all;
+        task_filter_init(&all);
+        in.ntasks = inspector_tasks(ins, rules_task_sources(opts->rules),
+                &all, &tasks);
+        in.tasks = tasks;
+    }
+
+    if (rules_eval(opts->rules, &in) > 0)
+    {
+        struct timespec now;
+        clock_gettime(CLOCK_REALTIME, &now);
+        if (opts->format == FORMAT_JSON)
+        {
+            rules_print_events_json(out, opts->rules, &now);
+        }
+        else
+        {
+            rules_print_events(out, opts->rules, &now);
+        }
+    }
+    free(tasks);
+}
+
+/**
+ * Runs the live view (redrawn in place), batch mode (appended to stdout), or
+ * watch mode (events only) on one procfs root. Every interval the counters
+ * are sampled once and the rates since the previous sample are printed or
+ * tested, for the requested number of iterations (0 for no limit) or until
+ * SIGINT or SIGTERM.
+ */
+void sample_loop(struct inspector *ins, const struct inspect_opts *opts)
+{
+    FILE *out = stdout;
+    bool live = opts->views.live_view;
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = request_stop;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    if (live)
+    {
+        fprintf(out, "Live CPU/Memory View\n");
+        fprintf(out, "--------------------\n");
+        fprintf(out, "\033[?25l");
+    }
+
+    struct tick_state t;
+    memset(&t, 0, sizeof(t));
+    struct stats_timer timer;
+    struct timespec next;
+    int prev = 0;
+    int lines = 0;
+
+    tick_sample(ins, opts, &t, prev, true);
+    clock_gettime(CLOCK_MONOTONIC, &next);
+
+    for (long iteration = 1; !stop_requested
+            && (opts->iterations == 0 || iteration <= opts->iterations);
+            ++iteration)
+    {
+        /* Sleep to an absolute deadline so that the interval does not
+         * drift by the time each tick takes */
+        next.tv_sec += opts->interval_ms / 1000;
+        next.tv_nsec += (opts->interval_ms % 1000) * 1000000;
+        if (next.tv_nsec >= 1000000000)
+        {
+            next.tv_sec++;
+            next.tv_nsec -= 1000000000;
+        }
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL)
+                == EINTR && !stop_requested)
+        {
+        }
+        if (stop_requested)
+        {
+            break;
+        }
+
+        stats_begin(&timer);
+        int cur = !prev;
+        tick_sample(ins, opts, &t, cur, false);
+
+        if (live)
+        {
+            /* Move back over the previous tick's output and clear it, since
+             * the number of lines can change (e.g., a disk appears) */
+            if (lines > 0)
+            {
+                fprintf(out, "\033[%dA\r\033[J", lines);
+            }
+            lines = live_print(out, ins, opts, &t, prev, cur);
+        }
+        else if (opts->rules != NULL)
+        {
+            watch_eval(out, ins, opts, &t, prev, cur);
+        }
+        else if (opts->format == FORMAT_JSON)
+        {
+            batch_print_json(out, ins, opts, &t, prev, cur, iteration);
+        }
+        else
+        {
+            batch_print_text(out, ins, opts, &t, prev, cur, iteration);
+        }
+
+        /* The only flush of the iteration: batch output goes through a large
+         * stdout buffer */
+        fflush(out);
+        stats_end(live ? PHASE_LIVE_TICK : opts->rules != NULL
+                ? PHASE_WATCH_TICK : PHASE_BATCH_ITERATION, &timer);
+        TRACE(TRACE_INFO, "tick", iteration, lines);
+        prev = cur;
+    }
+
+    if (live)
+    {
+        /* Show the cursor again */
+        fprintf(out, "\033[?25h");
+        fflush(out);
+    }
+
+    tick_free(&t);
+    cgroup_cache_free();
+}
+
+
+/**
+ * Prints a bar per resource with the share of time some tasks were stalled
+ * on it between two samples, and the share of "full" stalls after it.
+ */
+void stall_bars(FILE *out, const struct psi_sample *prev,
+        const struct psi_sample *cur)
+{
+    static const char *labels[PSI_RESOURCES] = {
+        "CPU Stall:    ", "Memory Stall: ", "I/O Stall:    ",
+    };
+
+    for (int r = 0; r < PSI_RESOURCES; ++r)
+    {
+        double some = psi_stall_pct(prev, cur, r, false);
+        double full = psi_stall_pct(prev, cur, r, true);
+
+        fprintf(out, "%s[", labels[r]);
+        print_bar(out, some > 0 ? (int) round(some) / 5 : 0);
+        if (some < 0)
+        {
+            fprintf(out, "] -\n");
+        }
+        else if (full < 0)
+        {
+            fprintf(out, "] %.1f%%\n", some);
+        }
+        else
+        {
+            fprintf(out, "] %.1f%% (full %.1f%%)\n", some, full);
+        }
+    }
+}
+
+/**
+ * Displays pressure stall information with stall rates measured over one
+ * second.
+ */
+void psi_info(FILE *out, int root)
+{
+    fprintf(out, "Pressure Stall Information\n");
+    fprintf(out, "--------------------------\n");
+
+    struct psi_sample psi[2] = { { { { 0 } } } };
+    if (psi_sample(&psi[0], root) == 0)
+    {
+        stats_sleep (1);
+        psi_sample(&psi[1], root);
+        psi_print(out, &psi[0], &psi[1]);
+    }
+    else
+    {
+        fprintf(out, "Not available (kernel without PSI support or psi=0)\n");
+    }
+    psi_sample_free(&psi[0]);
+    psi_sample_free(&psi[1]);
+}
+
+/**
+ * Displays memory use and CPU usage (over one second) per NUMA node.
+ */
+void numa_info(FILE *out, int root, const char *sysfs_root)
+{
+    fprintf(out, "NUMA Nodes\n");
+    fprintf(out, "----------\n");
+
+    struct numa_sample nodes[2] = { { 0 } };
+    if (numa_sample(&nodes[0], root, sysfs_root) == 0)
+    {
+        stats_sleep (1);
+        if (numa_sample(&nodes[1], root, sysfs_root) == -1)
+        {
+            perror("NUMA nodes");
+        }
+        else
+        {
+            numa_print(out, &nodes[0], &nodes[1]);
+        }
+    }
+    else
+    {
+        fprintf(out, "Not available (no %s/devices/system/node)\n",
+                sysfs_root);
+    }
+    numa_sample_free(&nodes[0]);
+    numa_sample_free(&nodes[1]);
+}
+
+/**
+ * Displays resource usage per cgroup, with rates measured over one second.
+ */
+void cgroup_info(FILE *out, int root, const char *cgroup_root,
+        const struct task_filter *filter, enum io_backend backend)
+{
+    fprintf(out, "Cgroups\n");
+    fprintf(out, "-------\n");
+
+    struct cgroup_sample cgroups = { 0 };
+    if (cgroups_sample(&cgroups, root, cgroup_root, filter, backend) == 0)
+    {
+        stats_sleep (1);
+        if (cgroups_sample(&cgroups, root, cgroup_root, filter, backend) == 0)
+        {
+            fprintf(out, "Cgroup root: %s\n", cgroup_root);
+            fprintf(out, "Tasks: %zu in %zu cgroup(s)\n\n", cgroups.tasks,
+                    cgroups.n);
+            cgroups_print(out, &cgroups);
+        }
+    }
+    cgroup_sample_free(&cgroups);
+}
+
+/**
+ * Displays the tasks that waited longest on a run queue, with rates
+ * measured over one second. The later of the two scans (which read the
+ * given sources of every task) is left in *rated for the task list.
+ */
+void waiters_info(FILE *out, struct inspector *ins, long k,
+        unsigned int sources, struct task_sample *rated)
 {
-    int i = 0;
-    ssize_t read_sz;
-    while ((read_sz = read(fd, &str[i], 1)) > 0 && i < size)
+    fprintf(out, "Top Run Queue Waiters\n");
+    fprintf(out, "---------------------\n");
+
+    struct task_filter all;
+    task_filter_init(&all);
+    struct task_sample first = { 0 };
+    task_sample_take(ins, sources, &all, &first);
+    stats_sleep (1);
+    task_sample_take(ins, sources, &all, rated);
+    if (task_rates(&first, rated) == 0)
     {
-        if (str[i] == '\n' || str[i] == '\0')
-        {
-            i++;
-            break;
-        }
-        i++;
+        waiters_print(out, rated, k);
     }
-    return i;
+    task_sample_free(&first);
 }
 
+
 /**
-* Function that uses read_line to read a line in a file
+* Function to display task info
 */
-char * read_file(char *file)
+void task_info(FILE *out, struct inspector *ins,
+        const struct column *const *cols, int ncols,
+        const struct task_filter *filter, const struct task_sample *rated)
 {
-
-    int fd = open(file, O_RDONLY);
-    if (fd == -1) {
-        perror("open");
+    if (rated != NULL)
+    {
+        /* The rates were measured by a scan the caller already made */
+        task_list_print(out, ins, cols, ncols, rated, filter);
+        return;
     }
 
-    static char buf[BUF_SZ];
-    ssize_t read_sz;
-    while ((read_sz = read_line(buf, BUF_SZ, fd)) > 0) 
+    unsigned int sources = columns_sources(cols, ncols);
+    struct task_sample samples[2] = { { 0 } };
+
+    if (columns_rates(cols, ncols))
     {
-        buf[read_sz+1] = '\0';
-        buf[strcspn(buf, "\n")] = ' ';
+        /* Rate columns are measured over one second */
+        task_sample_take(ins, sources, filter, &samples[0]);
+        stats_sleep (1);
+        task_sample_take(ins, sources, filter, &samples[1]);
+        task_rates(&samples[0], &samples[1]);
+    }
+    else
+    {
+        samples[1].n = inspector_tasks(ins, sources, filter,
+                &samples[1].tasks);
     }
 
-    close(fd);
-    return buf;
+    task_list_print(out, ins, cols, ncols, &samples[1], filter);
+    task_sample_free(&samples[0]);
+    task_sample_free(&samples[1]);
 }
 
 /**
- * Retrieves the next token from a string.
- *
- * Parameters:
- * - str_ptr: maintains context in the string, i.e., where the next token in the
- *   string will be. If the function returns token N, then str_ptr will be
- *   updated to point to token N+1. To initialize, declare a char * that points
- *   to the string being tokenized. The pointer will be updated after each
- *   successive call to next_token.
- *
- * - delim: the set of characters to use as delimiters
- *
- * Returns: char pointer to the next token in the string.
+ * Prints the task information section for the tasks of a sample that pass
+ * the filter (the sample may hold every task; see waiters_sources()).
  */
-char *next_token(char **str_ptr, const char *delim)
+void task_list_print(FILE *out, struct inspector *ins,
+        const struct column *const *cols, int ncols,
+        const struct task_sample *sample, const struct task_filter *filter)
 {
-    if (*str_ptr == NULL) {
-        return NULL;
-    }
-
-    size_t tok_start = strspn(*str_ptr, delim);
-    size_t tok_end = strcspn(*str_ptr + tok_start, delim);
+    fprintf(out, "Task Information\n");
+    fprintf(out, "----------------\n");
 
-    /* Zero length token. We must be finished. */
-    if (tok_end  == 0) {
-        *str_ptr = NULL;
-        return NULL;
+    size_t shown = 0;
+    for (size_t i = 0; i < sample->n; ++i)
+    {
+        shown += task_filter_matches(filter, &sample->tasks[i]);
     }
+    fprintf(out, "Tasks Running: %zu\n\n", shown);
 
-    /* Take note of the start of the current token. We'll return it later. */
-    char *current_ptr = *str_ptr + tok_start;
+    columns_print_header(out, cols, ncols);
+    for (size_t i = 0; i < sample->n; ++i)
+    {
+        if (task_filter_matches(filter, &sample->tasks[i]))
+        {
+            columns_print_row(out, inspector_users(ins), cols, ncols,
+                    &sample->tasks[i]);
+        }
+    }
+}
 
-    /* Shift pointer forward (to the end of the current token) */
-    *str_ptr += tok_start + tok_end;
+/**
+ * Displays the process tree. Each row shows the totals for the task and all
+ * of its descendants: thread count, CPU time, and resident memory.
+ */
+void tree_info(FILE *out, struct inspector *ins,
+        const struct task_filter *filter)
+{
+    fprintf(out, "Process Tree\n");
+    fprintf(out, "------------\n");
 
-    if (**str_ptr == '\0') {
-        /* If the end of the current token is also the end of the string, we
-         * must be at the last token. */
-        *str_ptr = NULL;
-    } else {
-        /* Replace the matching delimiter with a NUL character to terminate the
-         * token string. */
-        **str_ptr = '\0';
+    struct task *tasks;
+    size_t tasks_count = inspector_tasks(ins, SRC_STAT | SRC_STATM, filter,
+            &tasks);
 
-        /* Shift forward one character over the newly-placed NUL so that
-         * next_pointer now points at the first character of the next token. */
-        (*str_ptr)++;
+    struct task_tree tree;
+    if (task_tree_build(tasks, tasks_count, &tree) == -1)
+    {
+        perror("task_tree_build");
+        free(tasks);
+        return;
     }
 
-    return current_ptr;
-}
+    fprintf(out, "Tasks: %zu\n\n", tasks_count);
+    fprintf(out, "  PID | Threads |  CPU Time |      RSS | Task Name\n");
+    fprintf(out, "------+---------+-----------+----------+-----------\n");
 
-/**
-* Function to find and print the system info from the proc file system (default or other)
-* System info: Hostname, kernel version, uptime
-*/
-void sys_info()
-{
-    //call read_file on each relative path
-    printf("System Information\n------------------\n");
-    //Hostname: /proc/sys/kernel/hostname
-    printf("Hostname: ");
-    printf("%s\n", read_file ("sys/kernel/hostname"));
-    //Kernel version: /proc/version
-    printf ("Kernel Version: ");
-    printf ("%s\n", read_file ("sys/kernel/osrelease"));
-    //Uptime: /proc/uptime
-    printf ("Uptime: ");
-    int time;
-    int tokens = 0;
-    char *curr_tok;
-    char *next_tok_up =read_file ("uptime");
-    while ((curr_tok = next_token(&next_tok_up, " |,?!\n")) != NULL) {
-        if (tokens++ == 0)
-        {
-            //format into an integer (seconds)
-            time = atoi(curr_tok);
-            //convert seconds into years, days, hours, minutes, seconds
-            int y, d, h, m, s;
-            y = time/60/60/24/365;
-            time -= y*60*60*24*365;
-            d = time/(24*60*60);
-            time -= d*24*60*60;
-            h = time/3600;
-            time -= h*3600;
-            m = time/60;
-            time -= m*60;
-            s = time;
-            //need to handle edge cases (0's) when printing
-            if (y == 0) {
-                if (d == 0) {
-                    if (h == 0) {
-                        printf("%d minutes, %d seconds\n", m, s);
-                    } else {
-                        printf("%d hours, %d minutes, %d seconds\n", h, m, s);
-                    } 
-                } else {
-                    if (h == 0) {
-                        printf(" %d days, %d minutes, %d seconds\n", d, m, s);
-                    } else {
-                        printf("%d days, %d hours, %d minutes, %d seconds\n", d, h, m, s);
-                    } 
-                }
-            } else {
-                printf("%d years, ", y);
-
-                if (d == 0) {
-                    if (h == 0) {
-                        printf("%d minutes, %d seconds\n", m, s);
-                    } else {
-                        printf("%d hours, %d minutes, %d seconds\n", h, m, s);
-                    } 
-                } else {
-                    if (h == 0) {
-                        printf(" %d days, %d minutes, %d seconds\n", d, m, s);
-                    } else {
-                        printf("%d days, %d hours, %d minutes, %d seconds\n", d, h, m, s);
-                    } 
-                }
-            }
-        }
+    for (size_t i = 0; i < tree.norder; ++i)
+    {
+        int node = tree.order[i];
+        char cpu[32];
+        char rss[32];
+        format_ticks(tree.sub_ticks[node], cpu, sizeof(cpu));
+        format_kb(tree.sub_rss_kb[node], rss, sizeof(rss));
+
+        fprintf(out, "%5d | %7lld | %9s | %8s | %*s%s%s\n",
+                tasks[node].pid, tree.sub_threads[node], cpu, rss,
+                tree.depth[node] * 2, "", tree.depth[node] > 0 ? "`- " : "",
+                tasks[node].name);
     }
+
+    task_tree_free(&tree);
+    free(tasks);
 }
 
 /**
-* Function to get and print hardware info.
-* Information needed: CPU Model, Processing Units, Load Average, CPU Usage, and Memory Usage
-*/
-void hardware_info()
+ * Prints every selected (non-live) section for one procfs root.
+ */
+void inspect_root(FILE *out, struct inspector *ins,
+        const struct inspect_opts *opts)
 {
-    printf ("Hardware Information\n");
-    printf ("--------------------\n");
+    const struct view_opts *views = &opts->views;
+    int root = inspector_root(ins);
+    struct stats_timer timer;
 
-    printf ("CPU Model: ");
-    int fd = open("cpuinfo", O_RDONLY);
-    if (fd == -1) {
-        perror("open");
+    if (views->system)
+    {
+        stats_begin(&timer);
+        sys_info(out, ins);
+        stats_end(PHASE_SYS_INFO, &timer);
     }
 
-    static char buf[BUF_SZ];
-    size_t read_sz;
-    int units = 0;
-    while ((read_sz = read_line(buf, BUF_SZ, fd)) > 0) 
+    if (views->hardware)
     {
-        buf[read_sz+1] = '\0';
-        buf[strcspn(buf, "\n")] = ' ';
-        if (strstr (buf, "model name"))
-        {
-            int tokens = 0;
-            char *curr_tok;
-            char *next_tok_cpu = buf;
-            while ((curr_tok = next_token(&next_tok_cpu, " :,?!")) != NULL) 
-            {
-                if (tokens++ == 2)
-                {
-                    printf ("%s", curr_tok);
-                    printf (" %s", next_tok_cpu);
-                }
-            }
-            break;
-        }
+        stats_begin(&timer);
+        hardware_info(out, ins);
+        stats_end(PHASE_HARDWARE_INFO, &timer);
     }
-    close (fd);
 
-    fd = open("cpuinfo", O_RDONLY);
-    if (fd == -1) {
-        perror("open");
-    }
-    while ((read_sz = read_line(buf, BUF_SZ, fd)) > 0) 
-    {   
-        if (strstr(buf, "processor"))
-        {
-            units++;
-        }
+    if (views->psi)
+    {
+        stats_begin(&timer);
+        psi_info(out, root);
+        stats_end(PHASE_PSI, &timer);
     }
-    close(fd);
-    printf ("\n");
-    printf ("Processing Units: %d\n", units);
 
-    printf ("Load Average (1/5/15 min): ");
-    int tokens = 0;
-    char *curr_tok;
-    char *next_tok_load = read_file("loadavg");
-    while ((curr_tok = next_token(&next_tok_load, " ")) != NULL) 
+    if (views->disks)
     {
-        if (tokens++ < 3)
-        {
-            printf ("%s", curr_tok);
-        }
+        stats_begin(&timer);
+        disk_info(out, root, &opts->disk_sel);
+        stats_end(PHASE_DISKS, &timer);
     }
-    
-    printf ("\n");
-
-    //calculate cpu usage: /proc/stat
-    //read from stat-- all the numbers in the first line are the total, the 4th column is the idle
-    //1 - ( (idle2 - idle1) / (total2 - total1) )
 
-    printf ("CPU Usage:    [");
-    int total[2]={0};
-    int idle[2]={0};
-    for (int i = 0; i < 2; i++)
+    if (views->net)
     {
-        if (i == 1)
-        {
-            sleep (1);
-        }
-        static char buf_1[BUF_SZ];
-        fd = open("stat", O_RDONLY);
-        if (fd == -1) {
-            perror("open");
-        }
-        while ((read_sz = read_line(buf_1, BUF_SZ, fd)) > 0) 
-        {   
-            if (strstr(buf_1, "cpu"))
-            {
-                //token buf_1 and get the total and idle times for each loop
-                int tok = 0;
-                char *next_tok_usage = buf_1;
-                char *curr_tok_usage;
-                /* Tokenize. Note that ' ,?!' will all be removed. */
-                while ((curr_tok_usage = next_token(&next_tok_usage, " ,?!\n")) != NULL) 
-                {
-                    if (tok>0 && tok<10)
-                    {
-                        total[i] += atoi(curr_tok_usage);
-                        if (tok == 4)
-                        {
-                            idle[i] = atoi (curr_tok_usage);
-                        }
-                        tok++;
-                    }
-                    else
-                    {
-                        tok++;
-                    }
-                }
-            break;
-            }
-        }
-        close(fd);
+        stats_begin(&timer);
+        net_info(out, root, &opts->net_sel);
+        stats_end(PHASE_NET, &timer);
     }
 
-    int t_diff = (total[1] - total[0]);
-    int i_diff = (idle[1] - idle[0]);
-
-    float cpu_usage;
-    cpu_usage = ((float) i_diff / (float) t_diff);
-
-    float c_usage;
-
-    if (isnan(cpu_usage)) 
-    {
-        c_usage = 0;
-    } else 
+    if (views->numa)
     {
-        c_usage = ((float) 1 - cpu_usage) * 100;
+        stats_begin(&timer);
+        numa_info(out, root, opts->sysfs_root);
+        stats_end(PHASE_NUMA, &timer);
     }
 
-    int count = (int) c_usage / 5;
-
-    for (int i = 0; i < 100; i+=5)
+    if (views->cgroups)
     {
-        if (count != 0) 
-        {
-            printf("#");
-            count --;
-        } else 
-        {
-            printf("-");
-        }
+        stats_begin(&timer);
+        cgroup_info(out, root, opts->cgroup_root, &opts->filter,
+                opts->backend);
+        stats_end(PHASE_CGROUPS, &timer);
     }
 
-    printf ("] %.1f%%\n", c_usage);
-
-    float tot;
-    float active;
-    static char buf_2[BUF_SZ];
-    fd = open("meminfo", O_RDONLY);
-    if (fd == -1) 
+    /* With rate columns, the task list reuses the waiters scans */
+    struct task_sample rated = { 0 };
+    if (views->waiters)
     {
-        perror("open");
+        stats_begin(&timer);
+        waiters_info(out, ins, opts->nwaiters, waiters_sources(opts),
+                &rated);
+        stats_end(PHASE_WAITERS, &timer);
     }
 
-    while ((read_sz = read_line(buf_2, BUF_SZ, fd)) > 0) 
-    {   
-        if (strstr(buf_2, "MemTotal:"))
-        {
-            //tokenize buf_2 and get total mem
-            int tok_m = 0;
-            char *next_tok_mem = buf_2;
-            char *curr_tok_mem;
-            /* Tokenize. Note that ' ,?!' will all be removed. */
-            while ((curr_tok_mem = next_token(&next_tok_mem, " ,?!\n")) != NULL) 
-            {
-                if (tok_m == 1)
-                {
-                    tot = atof(curr_tok_mem);
-                    tok_m++;
-                }
-                else
-                {
-                    tok_m++;
-                }
-            }
-        }
-        if (strstr(buf_2, "Active:"))
-        {
-            //tokenize buf_2 and get active mem
-            int tok_a = 0;
-            char *next_tok_act = buf_2;
-            char *curr_tok_act;
-            /* Tokenize. Note that ' ,?!' will all be removed. */
-            while ((curr_tok_act = next_token(&next_tok_act, " ,?!\n")) != NULL) 
-            {
-                if (tok_a == 1)
-                {
-                    active = atof(curr_tok_act);
-                    tok_a++;
-                }
-                else
-                {
-                    tok_a++;
-                }
-            }
-        }
+    if (views->task_list)
+    {
+        bool shared = views->waiters
+            && columns_rates(opts->columns, opts->ncols);
+        stats_begin(&timer);
+        task_info(out, ins, opts->columns, opts->ncols, &opts->filter,
+                shared ? &rated : NULL);
+        stats_end(PHASE_TASK_INFO, &timer);
     }
-    //convert kb to gb
-    tot = tot/1024/1024;
-    active = active/1024/1024;
-    float mem_usage = 100 * (active/tot);
-
-    printf ("Memory Usage: [");
-    int countm = round(mem_usage) / 5;
+    task_sample_free(&rated);
 
-    for (int j = 0; j < 100; j+=5)
+    if (views->task_tree)
     {
-        if (countm != 0) 
-        {
-            printf("#");
-            countm --;
-        } else 
-        {
-            printf("-");
-        }
+        stats_begin(&timer);
+        tree_info(out, ins, &opts->filter);
+        stats_end(PHASE_TREE, &timer);
     }
-    //printf ("%f\n", (mem_usage/100)*tot);
-    printf ("] %.1f%% (%.1f GB / %.1f GB)\n", mem_usage, active, tot);
+
+    cgroup_cache_free();
+    TRACE(TRACE_INFO, "inspect_root", root, 0);
 }
 
 /**
-* Function to display live view
-*/
-void live_info()
+ * Roots waiting to be inspected. Worker threads claim them one at a time, so
+ * a slow root does not hold up the others.
+ */
+struct root_queue {
+    struct root_job *jobs;
+    size_t njobs;
+    size_t next;
+    const struct inspect_opts *opts;
+};
+
+/**
+ * Thread body: inspects roots from the queue into in-memory reports until
+ * none are left.
+ */
+void *root_worker(void *arg)
 {
-    printf ("Live CPU/Memory View\n");
-    printf ("--------------------\n");
-    printf ("\033[?25l");
+    struct root_queue *queue = arg;
 
-    //infinite while loop printing load average, cpu usage, and memory usage
-    int i = 0;
-    int fd;
     while (true)
     {
-        int idle[2]={0};
-        int total[2]={0};
-        printf ("Load Average (1/5/15 min): ");
-        int tokens = 0;
-        ssize_t read_sz;
-        char *curr_tok;
-        char *next_tok_load = read_file("loadavg");
-        while ((curr_tok = next_token(&next_tok_load, " ")) != NULL) 
-        {
-            if (tokens++ < 3)
-            {
-                printf ("%s ", curr_tok);
-            }
-            else
-            {
-                break;
-            }
-        }
-        
-        printf ("\n");
-
-        //cpu usage
-        printf ("CPU Usage:    [");
-        
-        for (i = 0; i < 2; i++)
-        {
-            if (i == 1)
-            {
-                sleep (1);
-            }
-            static char buf_1[BUF_SZ];
-            fd = open("stat", O_RDONLY);
-            if (fd == -1) {
-                perror("open");
-            }
-            while ((read_sz = read_line(buf_1, BUF_SZ, fd)) > 0) 
-            {   
-                if (strstr(buf_1, "cpu"))
-                {
-                    //printf ("%s", buf_1);
-                    //token buf_1 and get the total and idle times for each loop
-                    int tok = 0;
-                    char *next_tok_usage = buf_1;
-                    char *curr_tok_usage;
-                    /* Tokenize. Note that ' ,?!' will all be removed. */
-                    while ((curr_tok_usage = next_token(&next_tok_usage, " ,?!\n")) != NULL) 
-                    {
-                        if (tok>0 && tok<10)
-                        {
-                            total[i] += atoi(curr_tok_usage);
-                            if (tok == 4)
-                            {
-                                idle[i] = atoi (curr_tok_usage);
-                            }
-                            tok++;
-                        }
-                        else
-                        {
-                            tok++;
-                        }
-                    }
-                break;
-                }
-            }
-            close(fd);
-        }
-        int t_diff = (total[1] - total[0]);
-        int i_diff = (idle[1] - idle[0]);
-
-        float cpu_usage;
-        cpu_usage = ((float) i_diff / (float) t_diff);
-
-        float c_usage;
-
-        if (isnan(cpu_usage)) 
-        {
-            c_usage = 0;
-        } else 
-        {
-            c_usage = ((float) 1 - cpu_usage) * 100;
-        }
-
-        int count = (int) c_usage / 5;
-
-        for (int k = 0; k < 100; k+=5)
+        size_t i = __atomic_fetch_add(&queue->next, 1, __ATOMIC_RELAXED);
+        if (i >= queue->njobs)
         {
-            if (count != 0) 
-            {
-                printf("#");
-                count --;
-            } else 
-            {
-                printf("-");
-            }
-        }
-        printf ("] %.1f%%\n", c_usage);
-
-        //memory usage
-        float tot;
-        float active;
-        static char buf_2[BUF_SZ];
-        fd = open("meminfo", O_RDONLY);
-        if (fd == -1) 
-        {
-            perror("open");
-        }
-
-        while ((read_sz = read_line(buf_2, BUF_SZ, fd)) > 0) 
-        {   
-            if (strstr(buf_2, "MemTotal:"))
-            {
-                //tokenize buf_2 and get total mem
-                int tok_m = 0;
-                char *next_tok_mem = buf_2;
-                char *curr_tok_mem;
-                /* Tokenize. Note that ' ,?!' will all be removed. */
-                while ((curr_tok_mem = next_token(&next_tok_mem, " ,?!\n")) != NULL) 
-                {
-                    if (tok_m == 1)
-                    {
-                        tot = atof(curr_tok_mem);
-                        tok_m++;
-                    }
-                    else
-                    {
-                        tok_m++;
-                    }
-                }
-            }
-            if (strstr(buf_2, "Active:"))
-            {
-                //tokenize buf_2 and get active mem
-                int tok_a = 0;
-                char *next_tok_act = buf_2;
-                char *curr_tok_act;
-                /* Tokenize. Note that ' ,?!' will all be removed. */
-                while ((curr_tok_act = next_token(&next_tok_act, " ,?!\n")) != NULL) 
-                {
-                    if (tok_a == 1)
-                    {
-                        active = atof(curr_tok_act);
-                        tok_a++;
-                    }
-                    else
-                    {
-                        tok_a++;
-                    }
-                }
-            }
+            break;
         }
-        //convert kb to gb
-        
-        tot = tot/1024/1024;
-        active = active/1024/1024;
-        float mem_usage = 100 * (active/tot);
 
-        printf ("Memory Usage: [");
-        int countm = round(mem_usage) / 5;
-
-        for (int j = 0; j < 100; j+=5)
+        struct root_job *job = &queue->jobs[i];
+        FILE *out = open_memstream(&job->report, &job->report_len);
+        if (out == NULL)
         {
-            if (countm != 0) 
-            {
-                printf("#");
-                countm --;
-            } else 
-            {
-                printf("-");
-            }
+            perror("open_memstream");
+            continue;
         }
-        printf ("] %.1f%% (%.1f GB / %.1f GB)\n\033[A\033[A\033[A\r", mem_usage, active, tot);
+        inspect_root(out, job->ins, queue->opts);
+        fclose(out);
     }
+    return NULL;
 }
 
-
 /**
-* Function to display task info
-*/
-void task_info()
+ * Inspects several roots in parallel, leaving each one's output in its job.
+ */
+void inspect_roots(struct root_job *jobs, size_t njobs,
+        const struct inspect_opts *opts)
 {
-    printf ("Task Information\n");
-    printf ("----------------\n");
-
-    //readdir
-
-    DIR *directory;
-    if ((directory = opendir(".")) == NULL) {
-        perror("opendir");
-    }
+    struct root_queue queue = { jobs, njobs, 0, opts };
 
-    int tasks_count=0;
-    int fd=0;
-    static char buf_t[BUF_SZ];
-
-    struct dirent *entry;
-    while ((entry = readdir(directory)) != NULL) 
+    size_t nthreads = njobs < MAX_ROOT_THREADS ? njobs : MAX_ROOT_THREADS;
+    pthread_t threads[MAX_ROOT_THREADS];
+    size_t started = 0;
+    for (; started < nthreads; ++started)
     {
-        if (atoi(entry->d_name) !=0)
+        if (pthread_create(&threads[started], NULL, root_worker, &queue) != 0)
         {
-            char path[1000];
-            char status[10] = ("/status");
-            strcpy(path, entry->d_name);
-            strcat(path, status);
-            //printf ("%s\n", path);
-            fd = open(path, O_RDONLY);
-            if (fd == -1) 
-            {
-                //perror("open");
-                continue;
-            }
-            else
-            {
-                tasks_count++;
-            }
+            break;
         }
-        close(fd);
-    }
-    closedir(directory);
-    if ((directory = opendir(".")) == NULL) {
-        perror("opendir");
     }
 
-    printf ("Tasks Running: %d\n\n", tasks_count);
-
-    printf ("  PID |        State |                 Task Name |            User | Tasks\n");
-    printf ("------+--------------+---------------------------+-----------------+-------\n");
-
-
-    while ((entry = readdir(directory)) != NULL)
+    if (started == 0)
     {
-        ssize_t read_sz=0;
-        char threads[10];
-        char pid[20];
-        char name[26];
-        char state[100];
-    
-        //printf ("%s\n", entry->d_name);
-        char path[1000];
-        char status[10] = ("/status");
-        strcpy(path, entry->d_name);
-        strcat(path, status);
-        //printf ("%s\n", path);
- 
-
-        struct passwd *pw;
-        struct stat stat_buf;
-        stat(path, &stat_buf);
-        pw = getpwuid(stat_buf.st_uid);
-
-        fd = open(path, O_RDONLY);
-        if (fd == -1)
-        {
-            continue;
-        }
-
-
-        while ((read_sz = read_line(buf_t, BUF_SZ, fd)) > 0)
-        {
-            if (strstr(buf_t, "Name:"))
-            {
-                //tokeninze and get token 2 (task name)
-                //printf ("%s\n", buf_t);
-                int tok_n = 0;
-                char *next_tok_n = buf_t;
-                char *curr_tok_n;
-                /* Tokenize. Note that ' ,?!' will all be removed. */
-                while ((curr_tok_n = next_token(&next_tok_n, "\t ():,?!\n")) != NULL) 
-                {
-                    if (tok_n == 1)
-                    {
-                        strcpy(name, curr_tok_n);
-                        if (strlen(curr_tok_n) > 25)
-                        {
-                            name[25] = '\0';
-                        }
-                        //printf ("%s\n", name);
-                        //printf ("%s\n", curr_tok_n);
-                        tok_n++;
-                    }
-                    else
-                    {
-                        tok_n++;
-                    }
-                }
-            }
-            if (strstr(buf_t, "State:"))
-            {
-                //tokeninze and get token 2 (task name)
-                //printf ("%s\n", buf);
-                int tok_s = 0;
-                char *next_tok_s = buf_t;
-                char *curr_tok_s;
-                /* Tokenize. Note that ' ,?!' will all be removed. */
-                while ((curr_tok_s = next_token(&next_tok_s, "\t():,?!\n")) != NULL) 
-                {
-                    if (tok_s == 2)
-                    {
-                        strcpy (state, curr_tok_s);
-                        //printf ("%s\n", state);
-                        //printf ("%s\n", curr_tok_s);
-                        tok_s++;
-                    }
-                    else
-                    {
-                        tok_s++;
-                    }
-                }
-            }
-            if (strstr(buf_t, "Pid:") && !strstr(buf_t, "PPid:") && !strstr(buf_t, "TracerPid"))
-            {
-                //tokeninze and get token 2 (task name)
-                int tok_id = 0;
-                char *next_tok_id = buf_t;
-                char *curr_tok_id;
-        
-                /* Tokenize. Note that ' ,?!' will all be removed. */
-                while ((curr_tok_id = next_token(&next_tok_id, "\t :,?!\n")) != NULL) 
-                {
-                    if (tok_id == 1)
-                    {
-                        strcpy(pid, curr_tok_id);
-                        tok_id++;
-                    }
-                    else
-                    {
-                        tok_id++;
-                    }
-                }
-            }
-            if (strstr(buf_t, "Threads:"))
-            {
-                //tokeninze and get token 2 (task name)
-                int tok_thread = 0;
-                char *next_tok_thread = buf_t;
-                char *curr_tok_thread;
-                /* Tokenize. Note that ' ,?!' will all be removed. */
-                while ((curr_tok_thread = next_token(&next_tok_thread, "\t :,?!\n")) != NULL) 
-                {
-                    if (tok_thread == 1)
-                    {
-                        strcpy (threads, curr_tok_thread);
-                        tok_thread++;
-                    }
-                    else
-                    {
-                        tok_thread++;
-                    }
-                }
-            }
-        }
-        close(fd);
-
-        printf("%5s | %12s | %25s | %15s | %5s \n", pid, state, name, pw->pw_name, threads);
-
-        //open d_name (status) and get all the info you need and store it in the struct
+        /* No threads to be had; do the work on this one */
+        root_worker(&queue);
     }
+    for (size_t i = 0; i < started; ++i)
+    {
+        pthread_join(threads[i], NULL);
+    }
+}
 
-    closedir(directory);
-
-    //status file -- process id, state, name, uid (user), threads (processes running)
+/**
+ * Parses a non-negative decimal number. Returns 0 on success or -1 if arg is
+ * not one.
+ */
+int parse_number(const char *arg, long *value)
+{
+    char *end;
+    errno = 0;
+    *value = strtol(arg, &end, 10);
+    if (errno != 0 || end == arg || *end != '\0' || *value < 0)
+    {
+        return -1;
+    }
+    return 0;
 }
 
 /**
@@ -817,16 +1490,60 @@ void task_info()
  */
 void print_usage(char *argv[])
 {
-    printf("Usage: %s [-ahrst] [-l] [-p procfs_dir]\n" , argv[0]);
+    printf("Usage: %s [-ahrst] [-l | -b [-n count]] [-i ms] [-p procfs_dir]...\n",
+            argv[0]);
     printf("\n");
     printf("Options:\n"
 "    * -a              Display all (equivalent to -rst, default)\n"
+"    * -b              Batch mode: print the selected sections every\n"
+"                      interval, with rates since the previous iteration,\n"
+"                      without terminal control codes\n"
 "    * -h              Help/usage information\n"
+"    * -i ms           Interval of the live view, batch mode, and watch mode\n"
+"                      (default: 1000)\n"
 "    * -l              Live view. Cannot be used with other view options.\n"
-"    * -p procfs_dir   Change the expected procfs mount point (default: /proc)\n"
+"    * -n count        Stop the live view, batch mode, or watch mode after\n"
+"                      count iterations (default: 0, until interrupted)\n"
+"    * -p procfs_dir   Change the expected procfs mount point (default:\n"
+"                      /proc). Repeat to inspect several roots in parallel;\n"
+"                      each root's output is preceded by a ==> dir <==\n"
+"                      header\n"
 "    * -r              Hardware Information\n"
 "    * -s              System Information\n"
-"    * -t              Task Information\n");
+"    * -t              Task Information\n"
+"    * --disks[=list]  Disk I/O rates (also in live view). Skips loop, RAM,\n"
+"                      and partitions unless list names devices or is 'all'\n"
+"    * --net[=list]    Network interface rates (also in live view), for all\n"
+"                      interfaces or only those in list\n"
+"    * --psi           Pressure stall information for CPU, memory, and I/O\n"
+"                      (shown as stall bars in live view)\n"
+"    * --numa          Per-NUMA-node memory and CPU usage (also in live view)\n"
+"    * --sysfs-root=dir  sysfs mount point for --numa (default: /sys)\n"
+"    * --cgroups       Per-cgroup (v2) CPU, memory, and I/O rates (also in\n"
+"                      live view); task filters apply\n"
+"    * --cgroup-root=dir  cgroupfs mount point (default: /sys/fs/cgroup)\n"
+"    * --format=fmt    Batch and watch mode output: text, or json for one\n"
+"                      JSON object per line and iteration or event\n"
+"                      (default: text)\n"
+"    * --columns=list  Task list columns, comma-separated (default:\n"
+"                      pid,state,name,user,tasks). Available:\n"
+"                      ");
+    columns_print_names(stdout);
+    printf("\n"
+"    * --io=backend    Task file reads: auto, uring, or sync (default: auto)\n"
+"    * --name=regex    Only list tasks whose name matches regex\n"
+"    * --pid-range=N-M Only list tasks with PIDs in N-M (N-, -M, N also work)\n"
+"    * --state=states  Only list tasks in the given states, e.g. RD\n"
+"    * --stats         Print time spent per section and counts of system\n"
+"                      calls, files opened, bytes read, and tasks parsed to\n"
+"                      stderr at exit\n"
+"    * --tree          Process tree with per-subtree totals (filters apply)\n"
+"    * --user=user     Only list tasks owned by user (name or UID)\n"
+"    * --waiters[=N]   The N tasks (default: 10) that waited longest on a run\n"
+"                      queue per second, from schedstat\n"
+"    * --watch=file    Watch mode: test the threshold rules in file (e.g.,\n"
+"                      'cpu > 90 for 30s', 'tasks{state=D} > 10') every\n"
+"                      interval and print when each starts or stops firing\n");
     printf("\n");
 }
 
@@ -836,45 +1553,198 @@ void print_usage(char *argv[])
  */
 int main(int argc, char *argv[])
 {
-    /* Default location of the proc file system */
-    char *procfs_loc = "/proc";
-
-    /* Set to true if we are using a non-default proc location */
-    bool alt_proc = false;
-
-    struct view_opts defaults = { true, false, true, true };
-    struct view_opts options = { false, false, false, false };
+    /* Locations of the proc file systems to inspect (-p, repeatable) */
+    const char **roots = malloc(argc * sizeof(char *));
+    size_t nroots = 0;
+
+    struct view_opts defaults = { true, false, true, true, false, false, false,
+        false, false, false };
+
+    /* Set to true once any option that selects a view is seen */
+    bool view_selected = false;
+
+    struct inspect_opts opts;
+    memset(&opts, 0, sizeof(opts));
+    opts.backend = IO_AUTO;
+    opts.ncols = columns_default(opts.columns);
+    task_filter_init(&opts.filter);
+    disk_select_init(&opts.disk_sel, NULL);
+    net_select_init(&opts.net_sel, NULL);
+    opts.cgroup_root = "/sys/fs/cgroup";
+    opts.sysfs_root = "/sys";
+    opts.interval_ms = 1000;
+    opts.nwaiters = WAITERS_DEFAULT;
+
+    static struct option long_options[] = {
+        { "cgroup-root", required_argument, NULL, OPT_CGROUP_ROOT },
+        { "cgroups", no_argument, NULL, OPT_CGROUPS },
+        { "columns", required_argument, NULL, OPT_COLUMNS },
+        { "disks", optional_argument, NULL, OPT_DISKS },
+        { "format", required_argument, NULL, OPT_FORMAT },
+        { "io", required_argument, NULL, OPT_IO },
+        { "name", required_argument, NULL, OPT_NAME },
+        { "net", optional_argument, NULL, OPT_NET },
+        { "numa", no_argument, NULL, OPT_NUMA },
+        { "pid-range", required_argument, NULL, OPT_PID_RANGE },
+        { "psi", no_argument, NULL, OPT_PSI },
+        { "state", required_argument, NULL, OPT_STATE },
+        { "stats", no_argument, NULL, OPT_STATS },
+        { "sysfs-root", required_argument, NULL, OPT_SYSFS_ROOT },
+        { "tree", no_argument, NULL, OPT_TREE },
+        { "user", required_argument, NULL, OPT_USER },
+        { "waiters", optional_argument, NULL, OPT_WAITERS },
+        { "watch", required_argument, NULL, OPT_WATCH },
+        { NULL, 0, NULL, 0 },
+    };
 
     int c;
     opterr = 0;
-    while ((c = getopt(argc, argv, "ahlp:rst")) != -1) {
+    while ((c = getopt_long(argc, argv, "abhi:ln:p:rst", long_options, NULL))
+            != -1) {
         switch (c) {
             case 'a':
-                options = defaults;
+                opts.views = defaults;
+                view_selected = true;
+                break;
+            case 'b':
+                opts.batch = true;
                 break;
             case 'h':
                 print_usage(argv);
                 return 0;
+            case 'i':
+                if (parse_number(optarg, &opts.interval_ms) == -1
+                        || opts.interval_ms == 0) {
+                    fprintf(stderr, "Invalid interval `%s'.\n", optarg);
+                    return 1;
+                }
+                break;
             case 'l':
-                options.live_view = true;
+                opts.views.live_view = true;
+                view_selected = true;
+                break;
+            case 'n':
+                if (parse_number(optarg, &opts.iterations) == -1) {
+                    fprintf(stderr, "Invalid iteration count `%s'.\n",
+                            optarg);
+                    return 1;
+                }
                 break;
             case 'p':
-                procfs_loc = optarg;
-                alt_proc = true;
+                roots[nroots++] = optarg;
                 break;
             case 'r':
-                options.hardware = true;
+                opts.views.hardware = true;
+                view_selected = true;
                 break;
             case 's':
-                options.system = true;
+                opts.views.system = true;
+                view_selected = true;
                 break;
             case 't':
-                options.task_list = true;
+                opts.views.task_list = true;
+                view_selected = true;
+                break;
+            case OPT_IO:
+                if (io_backend_parse(optarg, &opts.backend) == -1) {
+                    fprintf(stderr, "Unknown I/O backend `%s'.\n", optarg);
+                    print_usage(argv);
+                    return 1;
+                }
+                break;
+            case OPT_COLUMNS:
+                opts.ncols = columns_parse(optarg, opts.columns);
+                if (opts.ncols == -1) {
+                    return 1;
+                }
+                break;
+            case OPT_DISKS:
+                opts.views.disks = true;
+                view_selected = true;
+                disk_select_init(&opts.disk_sel, optarg);
+                break;
+            case OPT_NET:
+                opts.views.net = true;
+                view_selected = true;
+                net_select_init(&opts.net_sel, optarg);
+                break;
+            case OPT_PSI:
+                opts.views.psi = true;
+                view_selected = true;
+                break;
+            case OPT_NUMA:
+                opts.views.numa = true;
+                view_selected = true;
+                break;
+            case OPT_SYSFS_ROOT:
+                opts.sysfs_root = optarg;
+                break;
+            case OPT_CGROUPS:
+                opts.views.cgroups = true;
+                view_selected = true;
+                break;
+            case OPT_CGROUP_ROOT:
+                opts.cgroup_root = optarg;
+                break;
+            case OPT_FORMAT:
+                if (strcmp(optarg, "text") == 0) {
+                    opts.format = FORMAT_TEXT;
+                } else if (strcmp(optarg, "json") == 0) {
+                    opts.format = FORMAT_JSON;
+                } else {
+                    fprintf(stderr, "Unknown format `%s'.\n", optarg);
+                    print_usage(argv);
+                    return 1;
+                }
+                break;
+            case OPT_WAITERS:
+                opts.views.waiters = true;
+                view_selected = true;
+                if (optarg != NULL && (parse_number(optarg, &opts.nwaiters)
+                            == -1 || opts.nwaiters == 0)) {
+                    fprintf(stderr, "Invalid number of waiters `%s'.\n",
+                            optarg);
+                    return 1;
+                }
+                break;
+            case OPT_WATCH:
+                opts.watch_path = optarg;
+                break;
+            case OPT_STATS:
+                stats_enabled = true;
+                break;
+            case OPT_TREE:
+                opts.views.task_tree = true;
+                view_selected = true;
+                break;
+            case OPT_USER:
+                if (task_filter_set_user(&opts.filter, optarg) == -1) {
+                    return 1;
+                }
+                break;
+            case OPT_STATE:
+                if (task_filter_set_states(&opts.filter, optarg) == -1) {
+                    return 1;
+                }
+                break;
+            case OPT_NAME:
+                if (task_filter_set_name(&opts.filter, optarg) == -1) {
+                    return 1;
+                }
+                break;
+            case OPT_PID_RANGE:
+                if (task_filter_set_pid_range(&opts.filter, optarg) == -1) {
+                    return 1;
+                }
                 break;
             case '?':
-                if (optopt == 'p') {
-                    fprintf(stderr,
-                            "Option -%c requires an argument.\n", optopt);
+                if (optopt == 'p' || optopt == 'i' || optopt == 'n'
+                        || optopt >= OPT_IO) {
+                    fprintf(stderr, "Option %s requires an argument.\n",
+                            argv[optind - 1]);
+                } else if (optopt == 0) {
+                    fprintf(stderr, "Unknown option `%s'.\n",
+                            argv[optind - 1]);
                 } else if (isprint(optopt)) {
                     fprintf(stderr, "Unknown option `-%c'.\n", optopt);
                 } else {
@@ -888,55 +1758,129 @@ int main(int argc, char *argv[])
         }
     }
 
-    if (alt_proc == true) {
-        LOG("Using alternative proc directory: %s\n", procfs_loc);
+    if (nroots == 0) {
+        /* Default location of the proc file system */
+        roots[nroots++] = "/proc";
+    } else {
+        for (size_t i = 0; i < nroots; ++i) {
+            LOG("Using alternative proc directory: %s\n", roots[i]);
+        }
+    }
 
-        /* Remove two arguments from the count: one for -p, one for the
-         * directory passed in: */
-        argc = argc - 2;
+    if (view_selected == false) {
+        /* No view options (possibly only -p or --io). Enable defaults: */
+        opts.views = defaults;
     }
 
-    if (argc <= 1) {
-        /* No args (or -p only). Enable default options: */
-        options = defaults;
+    if (opts.batch) {
+        /* Batch mode repeats whatever sections were selected instead */
+        opts.views.live_view = false;
     }
 
-    if (options.live_view == true) {
+    if (opts.watch_path != NULL) {
+        if (opts.batch || opts.views.live_view) {
+            fprintf(stderr, "--watch cannot be combined with -b or -l.\n");
+            return 1;
+        }
+        /* Rules are compiled once; the window sizes depend on -i */
+        opts.rules = rules_load(opts.watch_path, opts.interval_ms);
+        if (opts.rules == NULL) {
+            return 1;
+        }
+        /* Watch mode samples only what its rules test */
+        memset(&opts.views, 0, sizeof(opts.views));
+        LOG("Watching %zu rules from %s\n", rules_count(opts.rules),
+                opts.watch_path);
+    } else if (opts.views.live_view == true) {
         /* If live view is enabled, we will disable any other view options that
-         * were passed in. */
-        options = defaults;
-        options.live_view = true;
+         * were passed in, except for the sections the live view can show. */
+        bool disks = opts.views.disks;
+        bool net = opts.views.net;
+        bool numa = opts.views.numa;
+        bool cgroups = opts.views.cgroups;
+        opts.views = defaults;
+        opts.views.live_view = true;
+        opts.views.disks = disks;
+        opts.views.net = net;
+        opts.views.numa = numa;
+        opts.views.cgroups = cgroups;
         LOGP("Live view enabled. Ignoring other view options.\n");
     } else {
-        LOG("View options selected: %s%s%s\n",
-                options.hardware ? "hardware " : "",
-                options.system ? "system " : "",
-                options.task_list ? "task_list" : "");
+        LOG("View options selected: %s%s%s%s%s%s%s%s%s%s\n",
+                opts.views.hardware ? "hardware " : "",
+                opts.views.system ? "system " : "",
+                opts.views.task_list ? "task_list " : "",
+                opts.views.task_tree ? "task_tree " : "",
+                opts.views.disks ? "disks " : "",
+                opts.views.net ? "net " : "",
+                opts.views.psi ? "psi " : "",
+                opts.views.numa ? "numa " : "",
+                opts.views.cgroups ? "cgroups " : "",
+                opts.views.waiters ? "waiters" : "");
     }
 
-    if (chdir(procfs_loc) == -1) {
-        return -1;
+    if ((opts.views.live_view || opts.batch || opts.rules != NULL)
+            && nroots > 1) {
+        fprintf(stderr, "Live view, batch mode, and watch mode support a "
+                "single procfs root.\n");
+        return 1;
     }
 
-    if(options.live_view)
-    {
-        live_info();
+    if (opts.format == FORMAT_JSON && !opts.batch && opts.rules == NULL) {
+        fprintf(stderr, "--format=json requires batch mode (-b) or "
+                "--watch.\n");
+        return 1;
     }
 
-    if (options.system) 
-    {
-        sys_info();
+    if (opts.batch) {
+        /* Iterations are written whole, with one flush each */
+        static char batch_buf[BATCH_BUF_SZ];
+        setvbuf(stdout, batch_buf, _IOFBF, sizeof(batch_buf));
     }
 
-    if (options.hardware)
-    {
-        hardware_info();
+    /* One library context per root; every reader works relative to the
+     * root's directory fd */
+    struct root_job *jobs = calloc(nroots, sizeof(struct root_job));
+    for (size_t i = 0; i < nroots; ++i) {
+        jobs[i].path = roots[i];
+        jobs[i].ins = inspector_open(roots[i], opts.backend);
+        if (jobs[i].ins == NULL) {
+            perror(roots[i]);
+            return 1;
+        }
     }
 
-    if (options.task_list)
+    if (opts.views.live_view || opts.batch || opts.rules != NULL)
+    {
+        sample_loop(jobs[0].ins, &opts);
+    }
+    else if (nroots == 1)
     {
-        task_info();
+        inspect_root(stdout, jobs[0].ins, &opts);
+    }
+    else
+    {
+        inspect_roots(jobs, nroots, &opts);
+        for (size_t i = 0; i < nroots; ++i)
+        {
+            printf ("%s==> %s <==\n", i > 0 ? "\n" : "", jobs[i].path);
+            fwrite(jobs[i].report, 1, jobs[i].report_len, stdout);
+            free(jobs[i].report);
+        }
     }
 
+    if (stats_enabled) {
+        stats_print(stderr);
+    }
+
+    for (size_t i = 0; i < nroots; ++i) {
+        inspector_close(jobs[i].ins);
+    }
+    free(jobs);
+    free(roots);
+    task_filter_free(&opts.filter);
+    if (opts.rules != NULL) {
+        rules_free(opts.rules);
+    }
     return 0;
 }
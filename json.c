@@ -0,0 +1,44 @@
+/**
+ * @file
+ *
+ * Helpers for JSON output. See json.h for an overview.
+ */
+
+#include <math.h>
+
+#include "json.h"
+
+void json_string(FILE *out, const char *str)
+{
+    fputc('"', out);
+    for (const unsigned char *p = (const unsigned char *) str; *p != '\0';
+            ++p) {
+        if (*p == '"' || *p == '\\') {
+            fputc('\\', out);
+            fputc(*p, out);
+        } else if (*p < 0x20) {
+            fprintf(out, "\\u%04x", *p);
+        } else {
+            fputc(*p, out);
+        }
+    }
+    fputc('"', out);
+}
+
+void json_number(FILE *out, double value)
+{
+    if (value < 0 || !isfinite(value)) {
+        fprintf(out, "null");
+    } else {
+        fprintf(out, "%.2f", value);
+    }
+}
+
+void json_int(FILE *out, long long value)
+{
+    if (value < 0) {
+        fprintf(out, "null");
+    } else {
+        fprintf(out, "%lld", value);
+    }
+}
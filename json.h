@@ -0,0 +1,30 @@
+/**
+ * @file
+ *
+ * Helpers for the JSON output of batch mode (--format=json). Each section
+ * module writes its own values; these only cover the parts that need care.
+ */
+
+#ifndef _JSON_H_
+#define _JSON_H_
+
+#include <stdio.h>
+
+/**
+ * Writes a string as a quoted JSON string, escaping quotes, backslashes, and
+ * control characters.
+ */
+void json_string(FILE *out, const char *str);
+
+/**
+ * Writes a non-negative number, or null if value is negative (the value
+ * could not be measured) or not finite, which JSON cannot represent.
+ */
+void json_number(FILE *out, double value);
+
+/**
+ * Writes a non-negative integer, or null if value is negative.
+ */
+void json_int(FILE *out, long long value);
+
+#endif
@@ -0,0 +1,271 @@
+/**
+ * @file
+ *
+ * libinspector context and snapshot readers. See libinspector.h for an
+ * overview.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "libinspector.h"
+#include "procfs.h"
+#include "stats.h"
+
+/**
+ * System-wide files that are kept open and re-read on every sample.
+ */
+enum cached_file {
+    FILE_STAT,
+    FILE_MEMINFO,
+    FILE_LOADAVG,
+    FILE_UPTIME,
+    CACHED_FILES,
+};
+
+static const char *cached_paths[CACHED_FILES] = {
+    "stat", "meminfo", "loadavg", "uptime",
+};
+
+struct inspector {
+    int root;
+    int fds[CACHED_FILES]; /**< Opened on first use; -1 until then */
+    struct task_scanner *scanner;
+    struct file_buf buf;
+    struct uid_cache users;
+};
+
+struct inspector *inspector_open(const char *procfs_root,
+        enum io_backend backend)
+{
+    struct inspector *ins = calloc(1, sizeof(struct inspector));
+    if (ins == NULL) {
+        return NULL;
+    }
+
+    ins->root = open(procfs_root, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (ins->root == -1) {
+        int err = errno;
+        free(ins);
+        errno = err;
+        return NULL;
+    }
+    ins->scanner = task_scanner_create(ins->root, backend);
+    if (ins->scanner == NULL) {
+        close(ins->root);
+        free(ins);
+        errno = ENOMEM;
+        return NULL;
+    }
+    for (int i = 0; i < CACHED_FILES; ++i) {
+        ins->fds[i] = -1;
+    }
+    return ins;
+}
+
+void inspector_close(struct inspector *ins)
+{
+    for (int i = 0; i < CACHED_FILES; ++i) {
+        if (ins->fds[i] != -1) {
+            close(ins->fds[i]);
+        }
+    }
+    task_scanner_destroy(ins->scanner);
+    close(ins->root);
+    file_buf_free(&ins->buf);
+    free(ins);
+}
+
+int inspector_root(const struct inspector *ins)
+{
+    return ins->root;
+}
+
+struct uid_cache *inspector_users(struct inspector *ins)
+{
+    return &ins->users;
+}
+
+/**
+ * Reads one of the cached files into the context's buffer, opening it if
+ * this is the first read. Returns the contents or NULL on failure.
+ */
+static char *read_cached(struct inspector *ins, enum cached_file file)
+{
+    if (ins->fds[file] == -1) {
+        ins->fds[file] = openat(ins->root, cached_paths[file],
+                O_RDONLY | O_CLOEXEC);
+        stats_add(STAT_SYSCALLS, 1);
+        if (ins->fds[file] == -1) {
+            return NULL;
+        }
+        stats_add(STAT_FILES_OPENED, 1);
+    }
+
+    if (file_buf_reread(&ins->buf, ins->fds[file]) == -1) {
+        return NULL;
+    }
+    return ins->buf.data;
+}
+
+/**
+ * Copies the first line of a file below the root into dest.
+ */
+static int read_line_into(struct inspector *ins, const char *path, char *dest,
+        size_t sz)
+{
+    if (file_buf_read(&ins->buf, ins->root, path) == -1) {
+        return -1;
+    }
+    snprintf(dest, sz, "%.*s", (int) strcspn(ins->buf.data, "\n"),
+            ins->buf.data);
+    return 0;
+}
+
+int inspector_system(struct inspector *ins, struct system_info *sys)
+{
+    if (read_line_into(ins, "sys/kernel/hostname", sys->hostname,
+                sizeof(sys->hostname)) == -1
+            || read_line_into(ins, "sys/kernel/osrelease", sys->kernel,
+                sizeof(sys->kernel)) == -1) {
+        return -1;
+    }
+
+    char *uptime = read_cached(ins, FILE_UPTIME);
+    if (uptime == NULL) {
+        return -1;
+    }
+    sys->uptime_sec = strtod(uptime, NULL);
+    return 0;
+}
+
+int inspector_cpu_info(struct inspector *ins, struct cpu_info *info)
+{
+    if (file_buf_read(&ins->buf, ins->root, "cpuinfo") == -1) {
+        return -1;
+    }
+
+    info->model[0] = '\0';
+    info->units = 0;
+    for (char *line = ins->buf.data; line != NULL && *line != '\0';) {
+        char *end = strchr(line, '\n');
+        size_t len = end != NULL ? end - line : strlen(line);
+
+        if (strncmp(line, "processor", 9) == 0) {
+            info->units++;
+        } else if (info->model[0] == '\0'
+                && strncmp(line, "model name", 10) == 0) {
+            char *value = memchr(line, ':', len);
+            if (value != NULL) {
+                value += 1 + strspn(value + 1, " \t");
+                snprintf(info->model, sizeof(info->model), "%.*s",
+                        (int) (line + len - value), value);
+            }
+        }
+
+        line = end != NULL ? end + 1 : NULL;
+    }
+    return 0;
+}
+
+int inspector_cpu_times(struct inspector *ins, struct cpu_times *times)
+{
+    times->total = 0;
+    times->idle = 0;
+
+    char *stat = read_cached(ins, FILE_STAT);
+    if (stat == NULL) {
+        return -1;
+    }
+
+    /* "cpu  user nice system idle iowait irq softirq steal guest ..." */
+    char *p = stat + strcspn(stat, " ");
+    for (int col = 1; col < 10; ++col) {
+        char *end;
+        unsigned long long value = strtoull(p, &end, 10);
+        if (end == p) {
+            break;
+        }
+        times->total += value;
+        if (col == 4) {
+            times->idle = value;
+        }
+        p = end;
+    }
+    return 0;
+}
+
+double cpu_times_usage(const struct cpu_times *prev,
+        const struct cpu_times *cur)
+{
+    unsigned long long t_diff = cur->total - prev->total;
+    unsigned long long i_diff = cur->idle - prev->idle;
+    if (t_diff == 0) {
+        return 0;
+    }
+    return (1 - (double) i_diff / t_diff) * 100;
+}
+
+int inspector_memory(struct inspector *ins, struct memory_info *mem)
+{
+    static const struct {
+        const char *key;
+        size_t offset;
+    } fields[] = {
+        { "MemTotal:", offsetof(struct memory_info, total_kb) },
+        { "MemFree:", offsetof(struct memory_info, free_kb) },
+        { "MemAvailable:", offsetof(struct memory_info, available_kb) },
+        { "Active:", offsetof(struct memory_info, active_kb) },
+    };
+    const size_t nfields = sizeof(fields) / sizeof(fields[0]);
+
+    for (size_t i = 0; i < nfields; ++i) {
+        *(long long *) ((char *) mem + fields[i].offset) = -1;
+    }
+
+    char *meminfo = read_cached(ins, FILE_MEMINFO);
+    if (meminfo == NULL) {
+        return -1;
+    }
+
+    for (char *line = meminfo; line != NULL && *line != '\0';) {
+        for (size_t i = 0; i < nfields; ++i) {
+            size_t len = strlen(fields[i].key);
+            if (strncmp(line, fields[i].key, len) == 0) {
+                *(long long *) ((char *) mem + fields[i].offset)
+                    = strtoll(line + len, NULL, 10);
+                break;
+            }
+        }
+
+        line = strchr(line, '\n');
+        if (line != NULL) {
+            line++;
+        }
+    }
+    return 0;
+}
+
+int inspector_load(struct inspector *ins, struct load_avg *load)
+{
+    char *loadavg = read_cached(ins, FILE_LOADAVG);
+    if (loadavg == NULL) {
+        return -1;
+    }
+    if (sscanf(loadavg, "%lf %lf %lf", &load->avg[0], &load->avg[1],
+                &load->avg[2]) != 3) {
+        errno = EINVAL;
+        return -1;
+    }
+    return 0;
+}
+
+size_t inspector_tasks(struct inspector *ins, unsigned int sources,
+        const struct task_filter *filter, struct task **tasks)
+{
+    return task_scanner_scan(ins->scanner, sources, filter, tasks);
+}
@@ -0,0 +1,143 @@
+/**
+ * @file
+ *
+ * libinspector: the procfs readers behind the inspector tool, for embedding
+ * in other programs. A context is opened once per procfs root and then
+ * sampled any number of times; it keeps the root's directory fd, the fds of
+ * the system-wide files that are re-read on every sample (stat, meminfo,
+ * loadavg, and uptime), a reusable read buffer, a user name cache, and a task
+ * scanner. Sampling CPU times, memory, and load costs a pread() each and no
+ * allocations. Task scans reuse the scanner's batch I/O context and buffers,
+ * so they only open the task files and allocate the returned array.
+ * inspector_system() and inspector_cpu_info() open hostname, osrelease, and
+ * cpuinfo on every call, as these rarely need to be read more than once.
+ *
+ * Snapshots are returned in plain structs owned by the caller. The section
+ * modules (disks.h, net.h, psi.h, numa.h, cgroups.h, tree.h) are part of the
+ * library too and take the context's root fd from inspector_root().
+ *
+ * A context must only be used by one thread at a time. The cgroup mapping
+ * cache of cgroups.h is kept per thread, so threads inspecting different
+ * roots should each have their own context.
+ */
+
+#ifndef _LIBINSPECTOR_H_
+#define _LIBINSPECTOR_H_
+
+#include <limits.h>
+#include <stddef.h>
+
+#include "batch_io.h"
+#include "tasks.h"
+
+struct inspector;
+
+/**
+ * Host identification and uptime.
+ */
+struct system_info {
+    char hostname[HOST_NAME_MAX + 1];
+    char kernel[128]; /**< Kernel release, e.g., "6.1.0-18-amd64" */
+    double uptime_sec;
+};
+
+/**
+ * Static CPU information from cpuinfo.
+ */
+struct cpu_info {
+    char model[128]; /**< Empty if cpuinfo has no "model name" line */
+    int units;       /**< Number of logical processors */
+};
+
+/**
+ * Cumulative CPU time counters of all CPUs, in clock ticks.
+ */
+struct cpu_times {
+    unsigned long long total;
+    unsigned long long idle;
+};
+
+/**
+ * System-wide memory counters in kilobytes; -1 if meminfo lacks the field.
+ */
+struct memory_info {
+    long long total_kb;
+    long long free_kb;
+    long long available_kb;
+    long long active_kb;
+};
+
+/**
+ * The 1, 5, and 15 minute load averages.
+ */
+struct load_avg {
+    double avg[3];
+};
+
+/**
+ * Opens a context for the proc file system mounted at procfs_root. Task
+ * scans use the given I/O backend. Returns NULL (with errno set) on failure.
+ */
+struct inspector *inspector_open(const char *procfs_root,
+        enum io_backend backend);
+
+/**
+ * Closes every fd held by a context and frees it.
+ */
+void inspector_close(struct inspector *ins);
+
+/**
+ * Returns the directory fd of the context's procfs root, for the section
+ * modules and openat()-style reads of other files.
+ */
+int inspector_root(const struct inspector *ins);
+
+/**
+ * Returns the context's user name cache, e.g., for columns_print_row().
+ */
+struct uid_cache *inspector_users(struct inspector *ins);
+
+/**
+ * Reads the host name, kernel release, and uptime. Returns 0 on success or -1
+ * (with errno set) on failure; the other snapshot functions follow the same
+ * convention.
+ */
+int inspector_system(struct inspector *ins, struct system_info *sys);
+
+/**
+ * Reads the CPU model and the number of logical processors.
+ */
+int inspector_cpu_info(struct inspector *ins, struct cpu_info *info);
+
+/**
+ * Reads the aggregate CPU counters from the first line of stat: the total of
+ * the first nine columns and the idle column.
+ */
+int inspector_cpu_times(struct inspector *ins, struct cpu_times *times);
+
+/**
+ * Returns the CPU usage percentage between two snapshots.
+ */
+double cpu_times_usage(const struct cpu_times *prev,
+        const struct cpu_times *cur);
+
+/**
+ * Reads the memory counters from meminfo.
+ */
+int inspector_memory(struct inspector *ins, struct memory_info *mem);
+
+/**
+ * Reads the load averages from loadavg.
+ */
+int inspector_load(struct inspector *ins, struct load_avg *load);
+
+/**
+ * Scans the tasks of the context's root with the context's task scanner (see
+ * task_scanner_scan()), so repeated scans share one batch I/O context.
+ * Returns the number of tasks stored in *tasks, which the caller must free,
+ * or 0 with *tasks set to NULL on failure.
+ */
+size_t inspector_tasks(struct inspector *ins, unsigned int sources,
+        const struct task_filter *filter, struct task **tasks);
+
+#endif
@@ -0,0 +1,245 @@
+/**
+ * @file
+ *
+ * Network interface statistics from /proc/net/dev. See net.h for an overview.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "json.h"
+#include "net.h"
+
+/* Number of counters per interface line: eight receive, eight transmit */
+#define NET_FIELDS 16
+
+void net_select_init(struct net_select *sel, const char *arg)
+{
+    sel->names = arg;
+}
+
+/**
+ * Parses the counters following the interface name. Returns the number of
+ * fields found.
+ */
+static int parse_counters(char *p, uint64_t *fields)
+{
+    int n = 0;
+    while (n < NET_FIELDS) {
+        char *end;
+        uint64_t value = strtoull(p, &end, 10);
+        if (end == p) {
+            break;
+        }
+        fields[n++] = value;
+        p = end;
+    }
+    return n;
+}
+
+int net_sample(struct net_sample *sample, int root,
+        const struct net_select *sel)
+{
+    if (file_buf_read(&sample->buf, root, "net/dev") == -1) {
+        return -1;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &sample->time);
+
+    sample->n = 0;
+
+    /* Skip the two header lines */
+    char *line = sample->buf.data;
+    for (int i = 0; i < 2 && line != NULL; ++i) {
+        line = strchr(line, '\n');
+        if (line != NULL) {
+            line++;
+        }
+    }
+
+    while (line != NULL && *line != '\0') {
+        char *end = strchr(line, '\n');
+        if (end != NULL) {
+            *end = '\0';
+        }
+
+        /* "  eth0: 123 ..." (large counters may abut the colon) */
+        char *colon = strchr(line, ':');
+        char *name = line + strspn(line, " ");
+        if (colon == NULL || colon - name >= IF_NAMESIZE) {
+            line = (end != NULL) ? end + 1 : NULL;
+            continue;
+        }
+
+        if (sample->n == sample->cap) {
+            size_t cap = sample->cap > 0 ? sample->cap * 2 : 64;
+            struct net_stat *ifaces = realloc(sample->ifaces,
+                    cap * sizeof(struct net_stat));
+            if (ifaces == NULL) {
+                return -1;
+            }
+            sample->ifaces = ifaces;
+            sample->cap = cap;
+        }
+
+        struct net_stat *iface = &sample->ifaces[sample->n];
+        uint64_t f[NET_FIELDS];
+        if (parse_counters(colon + 1, f) == NET_FIELDS) {
+            memcpy(iface->name, name, colon - name);
+            iface->name[colon - name] = '\0';
+            iface->rx_bytes = f[0];
+            iface->rx_packets = f[1];
+            iface->rx_errs = f[2];
+            iface->rx_drop = f[3];
+            iface->tx_bytes = f[8];
+            iface->tx_packets = f[9];
+            iface->tx_errs = f[10];
+            iface->tx_drop = f[11];
+            iface->shown = sel->names == NULL
+                || list_contains(sel->names, iface->name);
+            sample->n++;
+        }
+
+        line = (end != NULL) ? end + 1 : NULL;
+    }
+
+    return 0;
+}
+
+/**
+ * Finds the interface in prev that corresponds to cur->ifaces[i], trying the
+ * same index first.
+ */
+static const struct net_stat *find_prev(const struct net_sample *prev,
+        const struct net_stat *iface, size_t i)
+{
+    if (i < prev->n && strcmp(prev->ifaces[i].name, iface->name) == 0) {
+        return &prev->ifaces[i];
+    }
+    for (size_t j = 0; j < prev->n; ++j) {
+        if (strcmp(prev->ifaces[j].name, iface->name) == 0) {
+            return &prev->ifaces[j];
+        }
+    }
+    return NULL;
+}
+
+/* Rates per interface, in the order of the columns */
+#define NET_RATES 8
+
+static const char *const rate_names[NET_RATES] = {
+    "rx_mb_per_sec", "rx_packets_per_sec", "rx_drops_per_sec",
+    "rx_errors_per_sec", "tx_mb_per_sec", "tx_packets_per_sec",
+    "tx_drops_per_sec", "tx_errors_per_sec",
+};
+static const int rate_widths[NET_RATES] = { 8, 9, 9, 8, 8, 9, 9, 8 };
+
+/**
+ * Computes the rates of an interface between two samples dt seconds apart.
+ * A rate is -1 if its counter went backwards, as when an interface is
+ * recreated under the same name or a driver resets its counters.
+ */
+static void iface_rates(const struct net_stat *p, const struct net_stat *c,
+        double dt, double *rates)
+{
+    rates[0] = counter_rate(p->rx_bytes, c->rx_bytes, dt, 1 / 1e6);
+    rates[1] = counter_rate(p->rx_packets, c->rx_packets, dt, 1);
+    rates[2] = counter_rate(p->rx_drop, c->rx_drop, dt, 1);
+    rates[3] = counter_rate(p->rx_errs, c->rx_errs, dt, 1);
+    rates[4] = counter_rate(p->tx_bytes, c->tx_bytes, dt, 1 / 1e6);
+    rates[5] = counter_rate(p->tx_packets, c->tx_packets, dt, 1);
+    rates[6] = counter_rate(p->tx_drop, c->tx_drop, dt, 1);
+    rates[7] = counter_rate(p->tx_errs, c->tx_errs, dt, 1);
+}
+
+/**
+ * Returns the number of decimals of a rate: more for MB/s than for counts.
+ */
+static int rate_decimals(int i, bool json)
+{
+    if (i == 0 || i == 4) {
+        return json ? 3 : 2;
+    }
+    return 1;
+}
+
+int net_print(FILE *out, const struct net_sample *prev,
+        const struct net_sample *cur)
+{
+    double dt = elapsed_sec(&prev->time, &cur->time);
+    if (dt <= 0) {
+        dt = 1;
+    }
+
+    fprintf(out, "Interface        |  RX MB/s |  RX pkt/s | RX drop/s "
+            "| RX err/s |  TX MB/s |  TX pkt/s | TX drop/s | TX err/s\n");
+    fprintf(out, "-----------------+----------+-----------+-----------"
+            "+----------+----------+-----------+-----------+---------\n");
+    int lines = 2;
+
+    for (size_t i = 0; i < cur->n; ++i) {
+        const struct net_stat *c = &cur->ifaces[i];
+        const struct net_stat *p = find_prev(prev, c, i);
+        if (!c->shown || p == NULL) {
+            continue;
+        }
+
+        double rates[NET_RATES];
+        iface_rates(p, c, dt, rates);
+        fprintf(out, "%-16s", c->name);
+        for (int r = 0; r < NET_RATES; ++r) {
+            if (rates[r] < 0) {
+                fprintf(out, " | %*s", rate_widths[r], "-");
+            } else {
+                fprintf(out, " | %*.*f", rate_widths[r],
+                        rate_decimals(r, false), rates[r]);
+            }
+        }
+        fprintf(out, "\n");
+        lines++;
+    }
+
+    return lines;
+}
+
+void net_print_json(FILE *out, const struct net_sample *prev,
+        const struct net_sample *cur)
+{
+    double dt = elapsed_sec(&prev->time, &cur->time);
+    if (dt <= 0) {
+        dt = 1;
+    }
+    bool first = true;
+
+    fprintf(out, "[");
+    for (size_t i = 0; i < cur->n; ++i) {
+        const struct net_stat *c = &cur->ifaces[i];
+        const struct net_stat *p = find_prev(prev, c, i);
+        if (!c->shown || p == NULL) {
+            continue;
+        }
+
+        double rates[NET_RATES];
+        iface_rates(p, c, dt, rates);
+        fprintf(out, "%s{\"interface\":", first ? "" : ",");
+        json_string(out, c->name);
+        for (int r = 0; r < NET_RATES; ++r) {
+            fprintf(out, ",\"%s\":", rate_names[r]);
+            if (rates[r] < 0) {
+                fprintf(out, "null");
+            } else {
+                fprintf(out, "%.*f", rate_decimals(r, true), rates[r]);
+            }
+        }
+        fprintf(out, "}");
+        first = false;
+    }
+    fprintf(out, "]");
+}
+
+void net_sample_free(struct net_sample *sample)
+{
+    free(sample->ifaces);
+    file_buf_free(&sample->buf);
+    memset(sample, 0, sizeof(*sample));
+}
@@ -0,0 +1,90 @@
+/**
+ * @file
+ *
+ * Network interface statistics from /proc/net/dev. Like the disk view, each
+ * sample is one buffered read of the file parsed into a reusable array, so a
+ * tick costs no allocations no matter how many interfaces the host has.
+ */
+
+#ifndef _NET_H_
+#define _NET_H_
+
+#include <net/if.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "procfs.h"
+
+/**
+ * Cumulative counters of a single network interface.
+ */
+struct net_stat {
+    char name[IF_NAMESIZE];
+    bool shown;
+    uint64_t rx_bytes;
+    uint64_t rx_packets;
+    uint64_t rx_errs;
+    uint64_t rx_drop;
+    uint64_t tx_bytes;
+    uint64_t tx_packets;
+    uint64_t tx_errs;
+    uint64_t tx_drop;
+};
+
+/**
+ * All interfaces at one point in time. Zero-initialize before first use.
+ */
+struct net_sample {
+    struct net_stat *ifaces;
+    size_t n;
+    size_t cap;
+    struct timespec time;
+    struct file_buf buf;
+};
+
+/**
+ * Selects the interfaces to display: every interface, or only those named in
+ * a comma-separated list.
+ */
+struct net_select {
+    const char *names;
+};
+
+/**
+ * Parses the argument of --net: a comma-separated list of interface names,
+ * or NULL for all interfaces.
+ */
+void net_select_init(struct net_select *sel, const char *arg);
+
+/**
+ * Reads net/dev below the procfs root directory fd 'root' into sample.
+ * Returns 0 on success or -1 with errno set on failure; nothing is printed,
+ * since the live view samples on every tick.
+ */
+int net_sample(struct net_sample *sample, int root,
+        const struct net_select *sel);
+
+/**
+ * Prints a table of per-interface rates between two samples to out. A rate
+ * whose counter went backwards (the interface was recreated or its counters
+ * reset) is shown as "-". Returns the number of lines printed.
+ */
+int net_print(FILE *out, const struct net_sample *prev,
+        const struct net_sample *cur);
+
+/**
+ * Writes the same rates as net_print() as a JSON array of objects, one per
+ * interface, with null for unknown rates.
+ */
+void net_print_json(FILE *out, const struct net_sample *prev,
+        const struct net_sample *cur);
+
+/**
+ * Frees the memory held by a sample.
+ */
+void net_sample_free(struct net_sample *sample);
+
+#endif
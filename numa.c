@@ -0,0 +1,351 @@
+/**
+ * @file
+ *
+ * Per-NUMA-node memory and CPU usage. See numa.h for an overview.
+ */
+
+#include <ctype.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "json.h"
+#include "numa.h"
+#include "stats.h"
+#include "tasks.h"
+
+/* Location of the node directories below the sysfs root */
+#define NODE_DIR "/devices/system/node"
+
+static int compare_ids(const void *a, const void *b)
+{
+    const struct numa_node *x = a;
+    const struct numa_node *y = b;
+    return (x->id > y->id) - (x->id < y->id);
+}
+
+/**
+ * Lists the nodeN directories into sample->nodes, sorted by node number.
+ */
+static int list_nodes(struct numa_sample *sample, const char *dir_path)
+{
+    DIR *dir = opendir(dir_path);
+    stats_add(STAT_SYSCALLS, 1);
+    if (dir == NULL) {
+        return -1;
+    }
+    stats_add(STAT_FILES_OPENED, 1);
+
+    sample->n = 0;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (strncmp(entry->d_name, "node", 4) != 0
+                || !isdigit((unsigned char) entry->d_name[4])) {
+            continue;
+        }
+
+        if (sample->n == sample->cap) {
+            size_t cap = sample->cap > 0 ? sample->cap * 2 : 8;
+            struct numa_node *nodes = realloc(sample->nodes,
+                    cap * sizeof(struct numa_node));
+            if (nodes == NULL) {
+                closedir(dir);
+                stats_add(STAT_SYSCALLS, 1);
+                return -1;
+            }
+            sample->nodes = nodes;
+            sample->cap = cap;
+        }
+
+        struct numa_node *node = &sample->nodes[sample->n++];
+        memset(node, 0, sizeof(*node));
+        node->id = atoi(entry->d_name + 4);
+        node->mem_total_kb = -1;
+        node->mem_free_kb = -1;
+        node->mem_used_kb = -1;
+    }
+    closedir(dir);
+    stats_add(STAT_SYSCALLS, 1);
+
+    qsort(sample->nodes, sample->n, sizeof(struct numa_node), compare_ids);
+    return 0;
+}
+
+/**
+ * Records node index 'node' for every CPU in a list such as "0-3,8-11".
+ */
+static int parse_cpulist(struct numa_sample *sample, const char *list,
+        int node)
+{
+    const char *p = list;
+    while (isdigit((unsigned char) *p)) {
+        char *end;
+        long lo = strtol(p, &end, 10);
+        long hi = lo;
+        if (*end == '-') {
+            hi = strtol(end + 1, &end, 10);
+        }
+        if (hi < lo || hi >= INT_MAX) {
+            break;
+        }
+
+        if ((size_t) hi >= sample->ncpus) {
+            size_t ncpus = sample->ncpus > 0 ? sample->ncpus : 64;
+            while ((size_t) hi >= ncpus) {
+                ncpus *= 2;
+            }
+            int *cpu_node = realloc(sample->cpu_node, ncpus * sizeof(int));
+            if (cpu_node == NULL) {
+                return -1;
+            }
+            for (size_t i = sample->ncpus; i < ncpus; ++i) {
+                cpu_node[i] = -1;
+            }
+            sample->cpu_node = cpu_node;
+            sample->ncpus = ncpus;
+        }
+
+        for (long cpu = lo; cpu <= hi; ++cpu) {
+            sample->cpu_node[cpu] = node;
+            sample->nodes[node].ncpus++;
+        }
+
+        p = (*end == ',') ? end + 1 : end;
+    }
+    return 0;
+}
+
+/**
+ * Extracts the memory sizes we use from a node's meminfo, whose lines look
+ * like "Node 0 MemTotal:  6158152 kB".
+ */
+static void parse_node_meminfo(char *buf, struct numa_node *node)
+{
+    char *line = buf;
+    while (line != NULL && *line != '\0') {
+        char key[32];
+        long long value;
+        if (sscanf(line, "Node %*d %31[^:]: %lld", key, &value) == 2) {
+            if (strcmp(key, "MemTotal") == 0) {
+                node->mem_total_kb = value;
+            } else if (strcmp(key, "MemFree") == 0) {
+                node->mem_free_kb = value;
+            } else if (strcmp(key, "MemUsed") == 0) {
+                node->mem_used_kb = value;
+            }
+        }
+
+        line = strchr(line, '\n');
+        if (line != NULL) {
+            line++;
+        }
+    }
+}
+
+/**
+ * Adds the time of every "cpuN" line of stat to the CPU's node. Fields are
+ * summed the same way as the machine-wide CPU usage: user through guest,
+ * with idle counted as idle.
+ */
+static void add_cpu_times(struct numa_sample *sample, char *buf)
+{
+    char *line = buf;
+    while (line != NULL && *line != '\0') {
+        int cpu;
+        unsigned long long f[9];
+        if (strncmp(line, "cpu", 3) == 0 && isdigit((unsigned char) line[3])
+                && sscanf(line + 3, "%d %llu %llu %llu %llu %llu %llu %llu "
+                    "%llu %llu", &cpu, &f[0], &f[1], &f[2], &f[3], &f[4],
+                    &f[5], &f[6], &f[7], &f[8]) == 10
+                && cpu >= 0 && (size_t) cpu < sample->ncpus
+                && sample->cpu_node[cpu] != -1) {
+            struct numa_node *node = &sample->nodes[sample->cpu_node[cpu]];
+            for (int i = 0; i < 9; ++i) {
+                node->cpu_total += f[i];
+            }
+            node->cpu_idle += f[3];
+        }
+
+        line = strchr(line, '\n');
+        if (line != NULL) {
+            line++;
+        }
+    }
+}
+
+int numa_sample(struct numa_sample *sample, int root,
+        const char *sysfs_root)
+{
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s" NODE_DIR, sysfs_root);
+    if (list_nodes(sample, path) == -1) {
+        return -1;
+    }
+
+    for (size_t i = 0; i < sample->ncpus; ++i) {
+        sample->cpu_node[i] = -1;
+    }
+
+    for (size_t i = 0; i < sample->n; ++i) {
+        struct numa_node *node = &sample->nodes[i];
+
+        snprintf(path, sizeof(path), "%s" NODE_DIR "/node%d/cpulist",
+                sysfs_root, node->id);
+        if (file_buf_read(&sample->buf, AT_FDCWD, path) != -1
+                && parse_cpulist(sample, sample->buf.data, (int) i) == -1) {
+            return -1;
+        }
+
+        snprintf(path, sizeof(path), "%s" NODE_DIR "/node%d/meminfo",
+                sysfs_root, node->id);
+        if (file_buf_read(&sample->buf, AT_FDCWD, path) != -1) {
+            parse_node_meminfo(sample->buf.data, node);
+        }
+    }
+
+    if (file_buf_read(&sample->buf, root, "stat") == -1) {
+        return -1;
+    }
+    add_cpu_times(sample, sample->buf.data);
+    clock_gettime(CLOCK_MONOTONIC, &sample->time);
+
+    return 0;
+}
+
+/**
+ * Returns the CPU usage of cur->nodes[i] since the previous sample, or -1 if
+ * the node is new, no time has passed, or its counters went backwards, as
+ * they do when one of its CPUs goes offline and drops out of stat.
+ */
+static double node_cpu_pct(const struct numa_sample *prev,
+        const struct numa_node *node, size_t i)
+{
+    /* Nodes only change on hotplug; match by position, then by id */
+    const struct numa_node *p = NULL;
+    for (size_t j = 0; j < prev->n && p == NULL; ++j) {
+        size_t k = (i + j) % prev->n;
+        if (prev->nodes[k].id == node->id) {
+            p = &prev->nodes[k];
+        }
+    }
+
+    if (p == NULL || node->cpu_total <= p->cpu_total
+            || node->cpu_idle < p->cpu_idle) {
+        return -1;
+    }
+    unsigned long long total = node->cpu_total - p->cpu_total;
+    unsigned long long idle = node->cpu_idle - p->cpu_idle;
+    if (idle > total) {
+        return -1;
+    }
+    return 100.0 * (total - idle) / total;
+}
+
+int numa_print(FILE *out, const struct numa_sample *prev,
+        const struct numa_sample *cur)
+{
+    fprintf(out, "Node | CPUs |  CPU %% |     Used |     Free |    Total "
+            "| Mem %%\n");
+    fprintf(out, "-----+------+--------+----------+----------+----------"
+            "+------\n");
+    int lines = 2;
+
+    for (size_t i = 0; i < cur->n; ++i) {
+        const struct numa_node *node = &cur->nodes[i];
+
+        double cpu_pct = node_cpu_pct(prev, node, i);
+        char cpu[16] = "-";
+        if (cpu_pct >= 0) {
+            snprintf(cpu, sizeof(cpu), "%.1f", cpu_pct);
+        }
+
+        char used[32];
+        char free_kb[32];
+        char total[32];
+        char pct[16] = "-";
+        format_kb(node->mem_used_kb, used, sizeof(used));
+        format_kb(node->mem_free_kb, free_kb, sizeof(free_kb));
+        format_kb(node->mem_total_kb, total, sizeof(total));
+        if (node->mem_total_kb > 0 && node->mem_used_kb >= 0) {
+            snprintf(pct, sizeof(pct), "%.1f",
+                    100.0 * node->mem_used_kb / node->mem_total_kb);
+        }
+
+        fprintf(out, "%4d | %4d | %6s | %8s | %8s | %8s | %5s\n",
+                node->id, node->ncpus, cpu, used, free_kb, total, pct);
+        lines++;
+    }
+
+    return lines;
+}
+
+void numa_print_json(FILE *out, const struct numa_sample *prev,
+        const struct numa_sample *cur)
+{
+    fprintf(out, "[");
+    for (size_t i = 0; i < cur->n; ++i) {
+        const struct numa_node *node = &cur->nodes[i];
+        fprintf(out, "%s{\"node\":%d,\"cpus\":%d,\"cpu_pct\":",
+                i > 0 ? "," : "", node->id, node->ncpus);
+        json_number(out, node_cpu_pct(prev, node, i));
+        fprintf(out, ",\"mem_used_kb\":");
+        json_int(out, node->mem_used_kb);
+        fprintf(out, ",\"mem_free_kb\":");
+        json_int(out, node->mem_free_kb);
+        fprintf(out, ",\"mem_total_kb\":");
+        json_int(out, node->mem_total_kb);
+        fprintf(out, "}");
+    }
+    fprintf(out, "]");
+}
+
+int numa_home_node(char *numa_maps)
+{
+    /* Each mapping lists its pages per node ("N0=12 N1=3") followed by the
+     * page size ("kernelpagesize_kB=4"), which differs for huge pages. */
+    unsigned long long kb[MAX_NUMA_NODES] = { 0 };
+
+    char *line = numa_maps;
+    while (line != NULL && *line != '\0') {
+        char *end = strchr(line, '\n');
+        if (end != NULL) {
+            *end = '\0';
+        }
+
+        long long page_kb = 4;
+        char *size = strstr(line, "kernelpagesize_kB=");
+        if (size != NULL) {
+            page_kb = atoll(size + strlen("kernelpagesize_kB="));
+        }
+
+        for (char *p = strstr(line, " N"); p != NULL; p = strstr(p + 1, " N")) {
+            char *eq;
+            long node = strtol(p + 2, &eq, 10);
+            if (eq != p + 2 && *eq == '=' && node >= 0
+                    && node < MAX_NUMA_NODES) {
+                kb[node] += strtoull(eq + 1, NULL, 10) * page_kb;
+            }
+        }
+
+        line = (end != NULL) ? end + 1 : NULL;
+    }
+
+    int home = -1;
+    for (int i = 0; i < MAX_NUMA_NODES; ++i) {
+        if (kb[i] > 0 && (home == -1 || kb[i] > kb[home])) {
+            home = i;
+        }
+    }
+    return home;
+}
+
+void numa_sample_free(struct numa_sample *sample)
+{
+    free(sample->nodes);
+    free(sample->cpu_node);
+    file_buf_free(&sample->buf);
+    memset(sample, 0, sizeof(*sample));
+}
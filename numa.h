@@ -0,0 +1,87 @@
+/**
+ * @file
+ *
+ * Per-NUMA-node memory and CPU usage. Node memory comes from
+ * devices/system/node/nodeN/meminfo under the sysfs root; CPU time is the
+ * per-CPU lines of /proc/stat summed over the CPUs in each node's cpulist.
+ * Like the machine-wide view, CPU usage is computed between two samples.
+ */
+
+#ifndef _NUMA_H_
+#define _NUMA_H_
+
+#include <stddef.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "procfs.h"
+
+/* Nodes beyond this are ignored when finding a task's home node */
+#define MAX_NUMA_NODES 64
+
+/**
+ * Memory and cumulative CPU time of one node. Memory sizes that could not be
+ * read are -1.
+ */
+struct numa_node {
+    int id;
+    int ncpus;
+    long long mem_total_kb;
+    long long mem_free_kb;
+    long long mem_used_kb;
+    unsigned long long cpu_total;
+    unsigned long long cpu_idle;
+};
+
+/**
+ * All nodes at one point in time. Zero-initialize before first use.
+ */
+struct numa_sample {
+    struct numa_node *nodes;
+    size_t n;
+    size_t cap;
+
+    /* Index into nodes of each CPU number, or -1 */
+    int *cpu_node;
+    size_t ncpus;
+
+    struct timespec time;
+    struct file_buf buf;
+};
+
+/**
+ * Reads every node below sysfs_root (e.g., "/sys") and the per-CPU times
+ * from stat below the procfs root directory fd 'root'. Returns 0 on success
+ * or -1 with errno set if the node directory (e.g., on a kernel without NUMA
+ * support) or stat cannot be read. Failures are left to the caller to
+ * report, so that a sampling loop can do it once.
+ */
+int numa_sample(struct numa_sample *sample, int root,
+        const char *sysfs_root);
+
+/**
+ * Prints a table of per-node CPU usage between two samples and memory use in
+ * the latest one to out. Returns the number of lines printed.
+ */
+int numa_print(FILE *out, const struct numa_sample *prev,
+        const struct numa_sample *cur);
+
+/**
+ * Writes the same values as numa_print() as a JSON array of objects, one per
+ * node, with null for values that are unknown.
+ */
+void numa_print_json(FILE *out, const struct numa_sample *prev,
+        const struct numa_sample *cur);
+
+/**
+ * Returns the node holding most of the memory mapped by a task, from the
+ * contents of /proc/[pid]/numa_maps, or -1 if it maps nothing.
+ */
+int numa_home_node(char *numa_maps);
+
+/**
+ * Frees the memory held by a sample.
+ */
+void numa_sample_free(struct numa_sample *sample);
+
+#endif
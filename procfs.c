@@ -0,0 +1,110 @@
+/**
+ * @file
+ *
+ * Helpers shared by the readers of whole procfs files.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "procfs.h"
+#include "stats.h"
+
+/* Initial capacity of a file buffer; most procfs tables fit */
+#define FILE_BUF_MIN 16384
+
+ssize_t file_buf_read(struct file_buf *buf, int dir, const char *path)
+{
+    int fd = openat(dir, path, O_RDONLY);
+    stats_add(STAT_SYSCALLS, 1);
+    if (fd == -1) {
+        return -1;
+    }
+    stats_add(STAT_FILES_OPENED, 1);
+
+    ssize_t len = file_buf_reread(buf, fd);
+    int err = errno;
+    close(fd);
+    stats_add(STAT_SYSCALLS, 1);
+    errno = err;
+    return len;
+}
+
+ssize_t file_buf_reread(struct file_buf *buf, int fd)
+{
+    buf->len = 0;
+    while (true) {
+        if (buf->cap - buf->len < 2) {
+            size_t cap = buf->cap > 0 ? buf->cap * 2 : FILE_BUF_MIN;
+            char *data = realloc(buf->data, cap);
+            if (data == NULL) {
+                errno = ENOMEM;
+                return -1;
+            }
+            buf->data = data;
+            buf->cap = cap;
+        }
+
+        ssize_t read_sz = pread(fd, buf->data + buf->len,
+                buf->cap - buf->len - 1, buf->len);
+        stats_add(STAT_SYSCALLS, 1);
+        if (read_sz == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        if (read_sz == 0) {
+            break;
+        }
+        buf->len += read_sz;
+    }
+    stats_add(STAT_BYTES_READ, buf->len);
+
+    buf->data[buf->len] = '\0';
+    return buf->len;
+}
+
+void file_buf_free(struct file_buf *buf)
+{
+    free(buf->data);
+    buf->data = NULL;
+    buf->cap = 0;
+    buf->len = 0;
+}
+
+double elapsed_sec(const struct timespec *start, const struct timespec *end)
+{
+    return (end->tv_sec - start->tv_sec)
+        + (end->tv_nsec - start->tv_nsec) / 1e9;
+}
+
+double counter_rate(long long prev, long long cur, double dt, double scale)
+{
+    if (prev < 0 || cur < 0 || cur < prev || dt <= 0) {
+        return -1;
+    }
+    return (cur - prev) / dt * scale;
+}
+
+bool list_contains(const char *list, const char *name)
+{
+    size_t len = strlen(name);
+    const char *p = list;
+    while (*p != '\0') {
+        size_t tok = strcspn(p, ",");
+        if (tok == len && strncmp(p, name, len) == 0) {
+            return true;
+        }
+        p += tok;
+        if (*p == ',') {
+            p++;
+        }
+    }
+    return false;
+}
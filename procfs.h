@@ -0,0 +1,64 @@
+/**
+ * @file
+ *
+ * Helpers shared by the readers of whole procfs files.
+ */
+
+#ifndef _PROCFS_H_
+#define _PROCFS_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+#include <time.h>
+
+/**
+ * A reusable, growable buffer for file contents. Zero-initialize before first
+ * use; the memory is kept between reads so that periodic samples do not
+ * allocate.
+ */
+struct file_buf {
+    char *data;
+    size_t cap;
+    size_t len;
+};
+
+/**
+ * Reads the whole file at path (relative to the directory fd 'dir', like
+ * openat()) into buf with a single open and as few read calls as the buffer
+ * allows, growing the buffer if the file does not fit. The contents are
+ * NUL-terminated. Returns the number of bytes read or -1 on failure (with
+ * errno set).
+ */
+ssize_t file_buf_read(struct file_buf *buf, int dir, const char *path);
+
+/**
+ * Like file_buf_read(), but reads an already open file from its start, so
+ * that a procfs file kept open across samples regenerates its contents
+ * without another path lookup.
+ */
+ssize_t file_buf_reread(struct file_buf *buf, int fd);
+
+/**
+ * Frees the memory held by a buffer.
+ */
+void file_buf_free(struct file_buf *buf);
+
+/**
+ * Returns the seconds elapsed between two CLOCK_MONOTONIC timestamps.
+ */
+double elapsed_sec(const struct timespec *start, const struct timespec *end);
+
+/**
+ * Returns the per-second rate of a cumulative counter between two samples
+ * dt seconds apart, multiplied by 'scale', or -1 if either value is unknown
+ * (negative), the counter went backwards, or no time passed.
+ */
+double counter_rate(long long prev, long long cur, double dt, double scale);
+
+/**
+ * Returns true if name appears in a comma-separated list.
+ */
+bool list_contains(const char *list, const char *name);
+
+#endif
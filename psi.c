@@ -0,0 +1,155 @@
+/**
+ * @file
+ *
+ * Pressure stall information. See psi.h for an overview.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "json.h"
+#include "psi.h"
+
+static const char *psi_files[PSI_RESOURCES] = {
+    "pressure/cpu", "pressure/memory", "pressure/io",
+};
+
+static const char *psi_names[PSI_RESOURCES] = { "cpu", "memory", "io" };
+
+/**
+ * Parses the line of buf that starts with kind ("some" or "full").
+ */
+static void parse_line(const char *buf, const char *kind,
+        struct psi_line *line)
+{
+    const char *p = buf;
+    size_t len = strlen(kind);
+    while (p != NULL && strncmp(p, kind, len) != 0) {
+        p = strchr(p, '\n');
+        if (p != NULL) {
+            p++;
+        }
+    }
+
+    line->valid = p != NULL
+        && sscanf(p + len, " avg10=%lf avg60=%lf avg300=%lf total=%llu",
+                &line->avg10, &line->avg60, &line->avg300, &line->total) == 4;
+}
+
+int psi_sample(struct psi_sample *sample, int root)
+{
+    int found = 0;
+    for (int r = 0; r < PSI_RESOURCES; ++r) {
+        if (file_buf_read(&sample->buf, root, psi_files[r]) == -1) {
+            sample->some[r].valid = false;
+            sample->full[r].valid = false;
+            continue;
+        }
+        parse_line(sample->buf.data, "some", &sample->some[r]);
+        parse_line(sample->buf.data, "full", &sample->full[r]);
+        found++;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &sample->time);
+
+    return found > 0 ? 0 : -1;
+}
+
+double psi_stall_pct(const struct psi_sample *prev,
+        const struct psi_sample *cur, enum psi_resource res, bool full)
+{
+    const struct psi_line *p = full ? &prev->full[res] : &prev->some[res];
+    const struct psi_line *c = full ? &cur->full[res] : &cur->some[res];
+    double dt = elapsed_sec(&prev->time, &cur->time);
+    if (!p->valid || !c->valid || c->total < p->total || dt <= 0) {
+        return -1;
+    }
+
+    double pct = 100.0 * (c->total - p->total) / (dt * 1e6);
+    return pct > 100 ? 100 : pct;
+}
+
+/**
+ * Prints the averages of one line and its stall rate, or dashes if the line
+ * is missing.
+ */
+static void print_line(FILE *out, const struct psi_line *line, double pct)
+{
+    if (!line->valid || pct < 0) {
+        fprintf(out, "%6s %6s %6s | %7s", "-", "-", "-", "-");
+    } else {
+        fprintf(out, "%6.2f %6.2f %6.2f | %6.2f%%", line->avg10,
+                line->avg60, line->avg300, pct);
+    }
+}
+
+int psi_print(FILE *out, const struct psi_sample *prev,
+        const struct psi_sample *cur)
+{
+    fprintf(out, "         |   some avg10/60/300 %% | stalled "
+            "|   full avg10/60/300 %% | stalled\n");
+    fprintf(out, "---------+-----------------------+---------"
+            "+-----------------------+--------\n");
+    int lines = 2;
+
+    for (int r = 0; r < PSI_RESOURCES; ++r) {
+        if (!cur->some[r].valid && !cur->full[r].valid) {
+            continue;
+        }
+
+        fprintf(out, "%-8s |  ", psi_names[r]);
+        print_line(out, &cur->some[r], psi_stall_pct(prev, cur, r, false));
+        fprintf(out, " |  ");
+        print_line(out, &cur->full[r], psi_stall_pct(prev, cur, r, true));
+        fprintf(out, "\n");
+        lines++;
+    }
+
+    return lines;
+}
+
+/**
+ * Writes one "some" or "full" line as a JSON object, or null if it is
+ * missing.
+ */
+static void print_line_json(FILE *out, const struct psi_line *line,
+        double pct)
+{
+    if (!line->valid) {
+        fprintf(out, "null");
+        return;
+    }
+    fprintf(out, "{\"avg10\":%.2f,\"avg60\":%.2f,\"avg300\":%.2f"
+            ",\"stalled_pct\":", line->avg10, line->avg60, line->avg300);
+    json_number(out, pct);
+    fprintf(out, "}");
+}
+
+void psi_print_json(FILE *out, const struct psi_sample *prev,
+        const struct psi_sample *cur)
+{
+    bool first = true;
+
+    fprintf(out, "{");
+    for (int r = 0; r < PSI_RESOURCES; ++r) {
+        if (!cur->some[r].valid && !cur->full[r].valid) {
+            continue;
+        }
+
+        fprintf(out, "%s\"%s\":{\"some\":", first ? "" : ",",
+                psi_names[r]);
+        print_line_json(out, &cur->some[r],
+                psi_stall_pct(prev, cur, r, false));
+        fprintf(out, ",\"full\":");
+        print_line_json(out, &cur->full[r],
+                psi_stall_pct(prev, cur, r, true));
+        fprintf(out, "}");
+        first = false;
+    }
+    fprintf(out, "}");
+}
+
+void psi_sample_free(struct psi_sample *sample)
+{
+    file_buf_free(&sample->buf);
+    memset(sample, 0, sizeof(*sample));
+}
@@ -0,0 +1,88 @@
+/**
+ * @file
+ *
+ * Pressure stall information from /proc/pressure/{cpu,memory,io}. Each file
+ * has a "some" line (time at least one task was stalled on the resource) and
+ * a "full" line (time all non-idle tasks were stalled at once), with the
+ * kernel's running averages and a cumulative stall time in microseconds.
+ * Stall rates between two samples are computed from the cumulative totals,
+ * so they cover exactly the sampling interval instead of a fixed window.
+ */
+
+#ifndef _PSI_H_
+#define _PSI_H_
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "procfs.h"
+
+/**
+ * Resources with a pressure file.
+ */
+enum psi_resource {
+    PSI_CPU,
+    PSI_MEMORY,
+    PSI_IO,
+    PSI_RESOURCES,
+};
+
+/**
+ * One "some" or "full" line.
+ */
+struct psi_line {
+    bool valid;
+    double avg10;
+    double avg60;
+    double avg300;
+    unsigned long long total; /**< Cumulative stall time in microseconds */
+};
+
+/**
+ * Pressure of every resource at one point in time. Zero-initialize before
+ * first use.
+ */
+struct psi_sample {
+    struct psi_line some[PSI_RESOURCES];
+    struct psi_line full[PSI_RESOURCES];
+    struct timespec time;
+    struct file_buf buf;
+};
+
+/**
+ * Reads pressure/cpu, pressure/memory, and pressure/io below the procfs root
+ * directory fd 'root' into sample. Returns 0 if at least one resource could
+ * be read, or -1 if PSI is not available (e.g., a kernel built without it or
+ * booted with psi=0).
+ */
+int psi_sample(struct psi_sample *sample, int root);
+
+/**
+ * Returns the percentage of time between two samples during which tasks were
+ * stalled on a resource ("full" stalls if full is true, "some" otherwise), or
+ * -1 if either sample lacks the line.
+ */
+double psi_stall_pct(const struct psi_sample *prev,
+        const struct psi_sample *cur, enum psi_resource res, bool full);
+
+/**
+ * Prints a table of the kernel averages and the stall rates between two
+ * samples to out. Returns the number of lines printed.
+ */
+int psi_print(FILE *out, const struct psi_sample *prev,
+        const struct psi_sample *cur);
+
+/**
+ * Writes the same values as psi_print() as a JSON object keyed by resource,
+ * with null for a missing line or an unknown stall rate.
+ */
+void psi_print_json(FILE *out, const struct psi_sample *prev,
+        const struct psi_sample *cur);
+
+/**
+ * Frees the memory held by a sample.
+ */
+void psi_sample_free(struct psi_sample *sample);
+
+#endif
@@ -0,0 +1,532 @@
+/**
+ * @file
+ *
+ * Threshold rules for watch mode. See rules.h for an overview.
+ */
+
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "debug.h"
+#include "json.h"
+#include "rules.h"
+
+/* Maximum length of a rule as quoted in events */
+#define RULE_TEXT_SZ 128
+
+enum rule_op {
+    OP_GT,
+    OP_GE,
+    OP_LT,
+    OP_LE,
+    OP_EQ,
+    OP_NE,
+};
+
+/* Two-character operators come first so that ">=" is not read as ">" */
+static const struct {
+    const char *text;
+    enum rule_op op;
+} ops[] = {
+    { ">=", OP_GE }, { "<=", OP_LE }, { "==", OP_EQ }, { "!=", OP_NE },
+    { ">", OP_GT }, { "<", OP_LT },
+};
+
+static const struct {
+    const char *name;
+    bool bytes;
+} metrics[RULE_METRICS] = {
+    { "cpu", false },
+    { "mem_available", true },
+    { "mem_free", true },
+    { "mem_used", true },
+    { "mem_pct", false },
+    { "load1", false },
+    { "load5", false },
+    { "load15", false },
+    { "psi_cpu", false },
+    { "psi_memory", false },
+    { "psi_io", false },
+    { "tasks", false },
+};
+
+/**
+ * A sample in a windowed rule's ring buffer.
+ */
+struct rule_slot {
+    uint64_t ms;
+    bool hit;
+};
+
+/**
+ * A compiled rule and its evaluation state.
+ */
+struct rule {
+    enum rule_metric metric;
+    enum rule_op op;
+    double threshold;
+    uint64_t window_ms; /**< 0 if the rule has no "for" clause */
+    struct task_filter filter;
+    char text[RULE_TEXT_SZ];
+
+    /* Ring of the samples in the window: a slice of the set's slots */
+    struct rule_slot *ring;
+    size_t cap;
+    size_t head;
+    size_t len;
+    size_t hits;
+
+    double value;
+    bool firing;
+    bool changed;
+};
+
+struct rule_set {
+    struct rule *rules;
+    size_t n;
+    struct rule_slot *slots;
+    unsigned int metrics;
+    unsigned int sources;
+};
+
+static const char *skip_space(const char *p)
+{
+    while (isspace((unsigned char) *p)) {
+        p++;
+    }
+    return p;
+}
+
+/**
+ * Parses "key=value,..." up to the closing brace into the rule's filter.
+ * Returns the position after the brace, or NULL on failure.
+ */
+static const char *parse_selector(const char *p, struct rule *rule)
+{
+    while (*p != '}') {
+        size_t len = strcspn(p, ",}");
+        if (p[len] == '\0') {
+            return NULL;
+        }
+
+        char pair[RULE_TEXT_SZ];
+        snprintf(pair, sizeof(pair), "%.*s", (int) len, p);
+        char *value = strchr(pair, '=');
+        if (value == NULL) {
+            return NULL;
+        }
+        *value++ = '\0';
+
+        int ret;
+        if (strcmp(pair, "state") == 0) {
+            ret = task_filter_set_states(&rule->filter, value);
+        } else if (strcmp(pair, "user") == 0) {
+            ret = task_filter_set_user(&rule->filter, value);
+        } else if (strcmp(pair, "name") == 0) {
+            ret = task_filter_set_name(&rule->filter, value);
+        } else if (strcmp(pair, "pid") == 0) {
+            ret = task_filter_set_pid_range(&rule->filter, value);
+        } else {
+            ret = -1;
+        }
+        if (ret == -1) {
+            return NULL;
+        }
+
+        p += len;
+        if (*p == ',') {
+            p++;
+        }
+    }
+    return p + 1;
+}
+
+/**
+ * Parses a threshold with an optional binary suffix or percent sign.
+ */
+static const char *parse_threshold(const char *p, double *value)
+{
+    char *end;
+    *value = strtod(p, &end);
+    if (end == p) {
+        return NULL;
+    }
+
+    const char *suffix = strchr("KMGT", toupper((unsigned char) *end));
+    if (*end != '\0' && suffix != NULL) {
+        for (const char *s = "KMGT"; s <= suffix; ++s) {
+            *value *= 1024;
+        }
+        end++;
+    } else if (*end == '%') {
+        end++;
+    }
+    return end;
+}
+
+/**
+ * Parses a duration such as "30s" into milliseconds.
+ */
+static const char *parse_duration(const char *p, uint64_t *ms)
+{
+    static const struct {
+        const char *unit;
+        uint64_t ms;
+    } units[] = {
+        { "ms", 1 }, { "s", 1000 }, { "m", 60 * 1000 }, { "h", 3600 * 1000 },
+    };
+
+    char *end;
+    double value = strtod(p, &end);
+    if (end == p || value <= 0) {
+        return NULL;
+    }
+    for (size_t i = 0; i < sizeof(units) / sizeof(units[0]); ++i) {
+        size_t len = strlen(units[i].unit);
+        if (strncmp(end, units[i].unit, len) == 0
+                && !isalpha((unsigned char) end[len])) {
+            *ms = (uint64_t) (value * units[i].ms);
+            return end + len;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Compiles one rule (already stripped of comments and surrounding space).
+ * Returns NULL on success or a description of the problem.
+ */
+static const char *parse_rule(const char *line, struct rule *rule)
+{
+    snprintf(rule->text, sizeof(rule->text), "%s", line);
+    task_filter_init(&rule->filter);
+
+    const char *p = line;
+    size_t len = 0;
+    while (isalnum((unsigned char) p[len]) || p[len] == '_') {
+        len++;
+    }
+    int m = 0;
+    while (m < RULE_METRICS && (strlen(metrics[m].name) != len
+                || strncmp(p, metrics[m].name, len) != 0)) {
+        m++;
+    }
+    if (m == RULE_METRICS) {
+        return "unknown metric";
+    }
+    rule->metric = m;
+    p = skip_space(p + len);
+
+    if (*p == '{') {
+        if (rule->metric != METRIC_TASKS) {
+            return "only tasks takes a selector";
+        }
+        p = parse_selector(p + 1, rule);
+        if (p == NULL) {
+            return "invalid selector";
+        }
+        p = skip_space(p);
+    }
+
+    size_t i = 0;
+    while (i < sizeof(ops) / sizeof(ops[0])
+            && strncmp(p, ops[i].text, strlen(ops[i].text)) != 0) {
+        i++;
+    }
+    if (i == sizeof(ops) / sizeof(ops[0])) {
+        return "expected a comparison operator";
+    }
+    rule->op = ops[i].op;
+    p = skip_space(p + strlen(ops[i].text));
+
+    p = parse_threshold(p, &rule->threshold);
+    if (p == NULL) {
+        return "invalid threshold";
+    }
+    p = skip_space(p);
+
+    if (strncmp(p, "for", 3) == 0 && isspace((unsigned char) p[3])) {
+        p = parse_duration(skip_space(p + 3), &rule->window_ms);
+        if (p == NULL) {
+            return "invalid duration";
+        }
+        p = skip_space(p);
+    }
+
+    if (*p != '\0') {
+        return "unexpected text at end of rule";
+    }
+    return NULL;
+}
+
+/**
+ * Cuts a line at its newline or at a '#' that starts a comment. A '#' inside
+ * a selector's braces belongs to the selector, e.g., to a name= regex.
+ */
+static void strip_comment(char *line)
+{
+    int depth = 0;
+    for (char *p = line; *p != '\0'; ++p) {
+        if (*p == '{') {
+            depth++;
+        } else if (*p == '}' && depth > 0) {
+            depth--;
+        } else if (*p == '\n' || (*p == '#' && depth == 0)) {
+            *p = '\0';
+            return;
+        }
+    }
+}
+
+struct rule_set *rules_load(const char *path, long interval_ms)
+{
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        perror(path);
+        return NULL;
+    }
+
+    struct rule_set *rules = calloc(1, sizeof(struct rule_set));
+    if (rules == NULL) {
+        perror("rules_load");
+        fclose(file);
+        return NULL;
+    }
+    size_t cap = 0;
+    char *line = NULL;
+    size_t line_sz = 0;
+    int lineno = 0;
+    bool ok = true;
+
+    while (ok && getline(&line, &line_sz, file) != -1) {
+        lineno++;
+        strip_comment(line);
+        size_t end = strlen(line);
+        while (end > 0 && isspace((unsigned char) line[end - 1])) {
+            line[--end] = '\0';
+        }
+        const char *text = skip_space(line);
+        if (*text == '\0') {
+            continue;
+        }
+
+        if (rules->n == cap) {
+            size_t grown_cap = cap == 0 ? 16 : cap * 2;
+            struct rule *grown = realloc(rules->rules,
+                    grown_cap * sizeof(struct rule));
+            if (grown == NULL) {
+                perror("rules_load");
+                ok = false;
+                break;
+            }
+            rules->rules = grown;
+            cap = grown_cap;
+        }
+        struct rule *rule = &rules->rules[rules->n++];
+        memset(rule, 0, sizeof(*rule));
+
+        const char *error = parse_rule(text, rule);
+        if (error != NULL) {
+            fprintf(stderr, "%s:%d: %s: %s\n", path, lineno, error, text);
+            ok = false;
+        }
+    }
+    free(line);
+    fclose(file);
+
+    if (!ok) {
+        rules_free(rules);
+        return NULL;
+    }
+
+    /* Every window holds one sample per interval plus the one at its
+     * start, and one spare for a late tick */
+    size_t nslots = 0;
+    for (size_t i = 0; i < rules->n; ++i) {
+        struct rule *rule = &rules->rules[i];
+        if (rule->window_ms > 0) {
+            rule->cap = rule->window_ms / interval_ms + 2;
+            nslots += rule->cap;
+        }
+        rules->metrics |= 1u << rule->metric;
+        if (rule->metric == METRIC_TASKS) {
+            rules->sources |= task_filter_sources(&rule->filter);
+        }
+    }
+    rules->slots = calloc(nslots > 0 ? nslots : 1, sizeof(struct rule_slot));
+    if (rules->slots == NULL) {
+        perror("rules_load");
+        rules_free(rules);
+        return NULL;
+    }
+    nslots = 0;
+    for (size_t i = 0; i < rules->n; ++i) {
+        rules->rules[i].ring = rules->slots + nslots;
+        nslots += rules->rules[i].cap;
+    }
+
+    return rules;
+}
+
+void rules_free(struct rule_set *rules)
+{
+    for (size_t i = 0; i < rules->n; ++i) {
+        task_filter_free(&rules->rules[i].filter);
+    }
+    free(rules->rules);
+    free(rules->slots);
+    free(rules);
+}
+
+size_t rules_count(const struct rule_set *rules)
+{
+    return rules->n;
+}
+
+unsigned int rules_metrics(const struct rule_set *rules)
+{
+    return rules->metrics;
+}
+
+unsigned int rules_task_sources(const struct rule_set *rules)
+{
+    return rules->sources;
+}
+
+static bool compare(enum rule_op op, double value, double threshold)
+{
+    switch (op) {
+        case OP_GT: return value > threshold;
+        case OP_GE: return value >= threshold;
+        case OP_LT: return value < threshold;
+        case OP_LE: return value <= threshold;
+        case OP_EQ: return value == threshold;
+        case OP_NE: return value != threshold;
+    }
+    return false;
+}
+
+static void window_pop(struct rule *rule)
+{
+    rule->hits -= rule->ring[rule->head].hit;
+    rule->head = (rule->head + 1) % rule->cap;
+    rule->len--;
+}
+
+/**
+ * Adds a sample to a rule's window. Returns true if the threshold was met by
+ * every sample over the whole window.
+ */
+static bool window_push(struct rule *rule, uint64_t now, bool hit)
+{
+    if (rule->len == rule->cap) {
+        window_pop(rule);
+    }
+    struct rule_slot *slot = &rule->ring[(rule->head + rule->len) % rule->cap];
+    slot->ms = now;
+    slot->hit = hit;
+    rule->len++;
+    rule->hits += hit;
+
+    /* Keep the newest sample at or before the start of the window and
+     * everything after it */
+    while (rule->len > 1
+            && rule->ring[(rule->head + 1) % rule->cap].ms + rule->window_ms
+                <= now) {
+        window_pop(rule);
+    }
+
+    return rule->hits == rule->len
+        && now - rule->ring[rule->head].ms >= rule->window_ms;
+}
+
+int rules_eval(struct rule_set *rules, const struct rule_input *in)
+{
+    uint64_t now = (uint64_t) in->time.tv_sec * 1000
+        + in->time.tv_nsec / 1000000;
+    int changed = 0;
+
+    for (size_t i = 0; i < rules->n; ++i) {
+        struct rule *rule = &rules->rules[i];
+        rule->changed = false;
+
+        if (rule->metric == METRIC_TASKS) {
+            size_t count = 0;
+            for (size_t t = 0; t < in->ntasks; ++t) {
+                count += task_filter_matches(&rule->filter, &in->tasks[t]);
+            }
+            rule->value = count;
+        } else {
+            rule->value = in->values[rule->metric];
+        }
+        if (rule->value < 0) {
+            continue;
+        }
+
+        bool hit = compare(rule->op, rule->value, rule->threshold);
+        bool active = rule->window_ms == 0 ? hit
+            : window_push(rule, now, hit);
+        if (active != rule->firing) {
+            rule->firing = active;
+            rule->changed = true;
+            changed++;
+            TRACE(TRACE_DEBUG, "rule_transition", i, active);
+        }
+    }
+    return changed;
+}
+
+/**
+ * Formats the current value of a rule's metric.
+ */
+static void format_value(const struct rule *rule, char *buf, size_t sz)
+{
+    if (metrics[rule->metric].bytes) {
+        format_kb((long long) (rule->value / 1024), buf, sz);
+    } else if (rule->metric == METRIC_TASKS) {
+        snprintf(buf, sz, "%.0f", rule->value);
+    } else {
+        snprintf(buf, sz, "%.2f", rule->value);
+    }
+}
+
+void rules_print_events(FILE *out, const struct rule_set *rules,
+        const struct timespec *now)
+{
+    char when[32];
+    struct tm tm;
+    strftime(when, sizeof(when), "%Y-%m-%d %H:%M:%S",
+            localtime_r(&now->tv_sec, &tm));
+
+    for (size_t i = 0; i < rules->n; ++i) {
+        const struct rule *rule = &rules->rules[i];
+        if (!rule->changed) {
+            continue;
+        }
+        char value[32];
+        format_value(rule, value, sizeof(value));
+        fprintf(out, "%s %-8s %s (%s %s)\n", when,
+                rule->firing ? "FIRING" : "RESOLVED", rule->text,
+                metrics[rule->metric].name, value);
+    }
+}
+
+void rules_print_events_json(FILE *out, const struct rule_set *rules,
+        const struct timespec *now)
+{
+    for (size_t i = 0; i < rules->n; ++i) {
+        const struct rule *rule = &rules->rules[i];
+        if (!rule->changed) {
+            continue;
+        }
+        fprintf(out, "{\"time\":%lld.%03ld,\"event\":\"%s\",\"rule\":",
+                (long long) now->tv_sec, now->tv_nsec / 1000000,
+                rule->firing ? "firing" : "resolved");
+        json_string(out, rule->text);
+        fprintf(out, ",\"metric\":\"%s\",\"value\":",
+                metrics[rule->metric].name);
+        json_number(out, rule->value);
+        fprintf(out, "}\n");
+    }
+}
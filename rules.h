@@ -0,0 +1,116 @@
+/**
+ * @file
+ *
+ * Threshold rules for watch mode (--watch=file). A rule file has one rule per
+ * line, e.g.:
+ *
+ *     cpu > 90 for 30s
+ *     mem_available < 2G
+ *     tasks{state=D} > 10
+ *
+ * A rule compares a metric against a threshold (with an optional K, M, G, or
+ * T binary suffix) using >, >=, <, <=, ==, or !=. With "for <duration>" (ms,
+ * s, m, or h) it only fires once the comparison has held in every sample over
+ * that window. The tasks metric counts the tasks matching an optional
+ * selector with the keys of the task filters: state, user, name, and pid.
+ * Blank lines and text after a '#' outside a selector's braces are ignored.
+ *
+ * Rules are compiled once into a flat array. Each windowed rule owns a slice
+ * of a single ring buffer allocation holding its recent samples and a count
+ * of those that met the threshold, so evaluating a sample is O(1) per rule.
+ * A rule only produces an event when it starts or stops firing.
+ */
+
+#ifndef _RULES_H_
+#define _RULES_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "tasks.h"
+
+/**
+ * Values a rule can test. Sizes are in bytes and percentages in 0-100.
+ */
+enum rule_metric {
+    METRIC_CPU,           /**< CPU usage since the previous sample */
+    METRIC_MEM_AVAILABLE, /**< MemAvailable */
+    METRIC_MEM_FREE,      /**< MemFree */
+    METRIC_MEM_USED,      /**< MemTotal - MemAvailable */
+    METRIC_MEM_PCT,       /**< Used memory as a share of MemTotal */
+    METRIC_LOAD1,
+    METRIC_LOAD5,
+    METRIC_LOAD15,
+    METRIC_PSI_CPU,       /**< Share of time some tasks stalled on CPU */
+    METRIC_PSI_MEMORY,
+    METRIC_PSI_IO,
+    METRIC_TASKS,         /**< Tasks matching the rule's selector */
+    RULE_METRICS,
+};
+
+struct rule_set;
+
+/**
+ * One sample of the system-wide metrics. Values that could not be measured
+ * are -1, and rules on them neither fire nor resolve. Task rules count the
+ * given tasks, which must have been scanned with rules_task_sources().
+ */
+struct rule_input {
+    double values[RULE_METRICS];
+    const struct task *tasks;
+    size_t ntasks;
+    struct timespec time; /**< CLOCK_MONOTONIC time of the sample */
+};
+
+/**
+ * Compiles the rules in a file. interval_ms is the expected time between
+ * samples and sizes the ring buffers of windowed rules. Returns NULL (after
+ * printing a message with the file name and line) on failure.
+ */
+struct rule_set *rules_load(const char *path, long interval_ms);
+
+/**
+ * Frees a rule set.
+ */
+void rules_free(struct rule_set *rules);
+
+/**
+ * Returns the number of rules in a set.
+ */
+size_t rules_count(const struct rule_set *rules);
+
+/**
+ * Returns the metrics used by the rules, as a mask of (1 << metric) bits, so
+ * that the caller only samples what is needed.
+ */
+unsigned int rules_metrics(const struct rule_set *rules);
+
+/**
+ * Returns the task sources the selectors of task rules depend on.
+ */
+unsigned int rules_task_sources(const struct rule_set *rules);
+
+/**
+ * Evaluates every rule against a sample. Returns the number of rules that
+ * started or stopped firing, which the next rules_print_events() call
+ * reports.
+ */
+int rules_eval(struct rule_set *rules, const struct rule_input *in);
+
+/**
+ * Prints a line per rule that changed state in the last evaluation, with the
+ * wall clock time, FIRING or RESOLVED, the rule, and the current value.
+ */
+void rules_print_events(FILE *out, const struct rule_set *rules,
+        const struct timespec *now);
+
+/**
+ * Writes the same events as rules_print_events() as one JSON object per
+ * line.
+ */
+void rules_print_events_json(FILE *out, const struct rule_set *rules,
+        const struct timespec *now);
+
+#endif
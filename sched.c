@@ -0,0 +1,204 @@
+/**
+ * @file
+ *
+ * Scheduler latency metrics. See sched.h for an overview.
+ */
+
+#include <stdlib.h>
+
+#include "json.h"
+#include "procfs.h"
+#include "sched.h"
+#include "tree.h"
+
+int task_rates(const struct task_sample *prev, struct task_sample *cur)
+{
+    struct pid_index idx;
+    if (pid_index_build(&idx, prev->tasks, prev->n) == -1) {
+        return -1;
+    }
+
+    double dt = elapsed_sec(&prev->time, &cur->time);
+    for (size_t i = 0; i < cur->n; ++i) {
+        struct task *c = &cur->tasks[i];
+        int j = pid_index_find(&idx, prev->tasks, c->pid);
+        if (j == -1 || prev->tasks[j].start_time != c->start_time) {
+            continue;
+        }
+
+        const struct task *p = &prev->tasks[j];
+        c->rates.run_ms = counter_rate(p->run_ns, c->run_ns, dt, 1e-6);
+        c->rates.wait_ms = counter_rate(p->wait_ns, c->wait_ns, dt, 1e-6);
+        c->rates.slices = counter_rate(p->slices, c->slices, dt, 1);
+        c->rates.vcsw = counter_rate(p->vcsw, c->vcsw, dt, 1);
+        c->rates.ivcsw = counter_rate(p->ivcsw, c->ivcsw, dt, 1);
+    }
+
+    pid_index_free(&idx);
+    return 0;
+}
+
+/**
+ * Restores the min-heap property below heap[i], keyed by wait rate.
+ */
+static void sift_down(size_t *heap, size_t n, size_t i,
+        const struct task *tasks)
+{
+    for (;;) {
+        size_t least = i;
+        size_t l = 2 * i + 1;
+        size_t r = l + 1;
+        if (l < n && tasks[heap[l]].rates.wait_ms
+                < tasks[heap[least]].rates.wait_ms) {
+            least = l;
+        }
+        if (r < n && tasks[heap[r]].rates.wait_ms
+                < tasks[heap[least]].rates.wait_ms) {
+            least = r;
+        }
+        if (least == i) {
+            return;
+        }
+        size_t tmp = heap[i];
+        heap[i] = heap[least];
+        heap[least] = tmp;
+        i = least;
+    }
+}
+
+size_t top_waiters(const struct task *tasks, size_t n, size_t k,
+        size_t *top)
+{
+    /* top holds a min-heap of the best k so far, so the task to beat is
+     * always at the root */
+    size_t size = 0;
+    for (size_t i = 0; i < n && k > 0; ++i) {
+        double wait = tasks[i].rates.wait_ms;
+        if (wait <= 0) {
+            continue;
+        }
+
+        if (size < k) {
+            size_t c = size++;
+            top[c] = i;
+            while (c > 0 && tasks[top[(c - 1) / 2]].rates.wait_ms > wait) {
+                size_t parent = (c - 1) / 2;
+                top[c] = top[parent];
+                top[parent] = i;
+                c = parent;
+            }
+        } else if (wait > tasks[top[0]].rates.wait_ms) {
+            top[0] = i;
+            sift_down(top, size, 0, tasks);
+        }
+    }
+
+    /* Heapsort: moving each minimum to the end leaves the array in
+     * descending order */
+    for (size_t end = size; end > 1; --end) {
+        size_t tmp = top[0];
+        top[0] = top[end - 1];
+        top[end - 1] = tmp;
+        sift_down(top, end - 1, 0, tasks);
+    }
+    return size;
+}
+
+/**
+ * Returns true if any task of the sample has a run queue wait rate, i.e.,
+ * the kernel provides schedstat and the task was in both scans.
+ */
+static bool have_waits(const struct task_sample *sample)
+{
+    for (size_t i = 0; i < sample->n; ++i) {
+        if (sample->tasks[i].rates.wait_ms >= 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Returns the average run queue wait per timeslice in milliseconds, or -1 if
+ * the task ran no timeslices.
+ */
+static double wait_per_slice(const struct task *task)
+{
+    if (task->rates.slices <= 0) {
+        return -1;
+    }
+    return task->rates.wait_ms / task->rates.slices;
+}
+
+int waiters_print(FILE *out, const struct task_sample *sample, size_t k)
+{
+    if (!have_waits(sample)) {
+        fprintf(out, "Not available\n");
+        return 1;
+    }
+
+    size_t *top = malloc((k > 0 ? k : 1) * sizeof(size_t));
+    if (top == NULL) {
+        return 0;
+    }
+    size_t n = top_waiters(sample->tasks, sample->n, k, top);
+
+    fprintf(out, "    PID | Task Name                 | Wait ms/s |  Run ms/s "
+            "| Slices/s | ms/slice\n");
+    fprintf(out, "--------+---------------------------+-----------+-----------"
+            "+----------+---------\n");
+    int lines = 2;
+
+    for (size_t i = 0; i < n; ++i) {
+        const struct task *t = &sample->tasks[top[i]];
+        double per_slice = wait_per_slice(t);
+        fprintf(out, "%7d | %-25.25s | %9.1f | %9.1f | %8.1f | ", t->pid,
+                t->name, t->rates.wait_ms, t->rates.run_ms, t->rates.slices);
+        if (per_slice < 0) {
+            fprintf(out, "%8s\n", "-");
+        } else {
+            fprintf(out, "%8.2f\n", per_slice);
+        }
+        lines++;
+    }
+
+    free(top);
+    return lines;
+}
+
+void waiters_print_json(FILE *out, const struct task_sample *sample,
+        size_t k)
+{
+    size_t *top = malloc((k > 0 ? k : 1) * sizeof(size_t));
+    if (top == NULL || !have_waits(sample)) {
+        fprintf(out, "null");
+        free(top);
+        return;
+    }
+    size_t n = top_waiters(sample->tasks, sample->n, k, top);
+
+    fprintf(out, "[");
+    for (size_t i = 0; i < n; ++i) {
+        const struct task *t = &sample->tasks[top[i]];
+        fprintf(out, "%s{\"pid\":%d,\"name\":", i > 0 ? "," : "", t->pid);
+        json_string(out, t->name);
+        fprintf(out, ",\"wait_ms\":");
+        json_number(out, t->rates.wait_ms);
+        fprintf(out, ",\"run_ms\":");
+        json_number(out, t->rates.run_ms);
+        fprintf(out, ",\"slices\":");
+        json_number(out, t->rates.slices);
+        fprintf(out, ",\"wait_per_slice_ms\":");
+        json_number(out, wait_per_slice(t));
+        fprintf(out, "}");
+    }
+    fprintf(out, "]");
+    free(top);
+}
+
+void task_sample_free(struct task_sample *sample)
+{
+    free(sample->tasks);
+    sample->tasks = NULL;
+    sample->n = 0;
+}
@@ -0,0 +1,71 @@
+/**
+ * @file
+ *
+ * Scheduler latency metrics: per-task rates of the schedstat counters (time
+ * on the CPU, time waiting on a run queue, and timeslices) and of the
+ * context switch counts in status, and a summary of the tasks that waited
+ * longest for a CPU.
+ *
+ * The counters are cumulative, so rates are computed between two scans. The
+ * tasks of the scans are joined through a PID hash table (see tree.h), and a
+ * task only gets rates if its start time is unchanged, so a reused PID does
+ * not produce a bogus difference. Unlike the process-wide times and thread
+ * count in stat, schedstat and the switch counts in status describe only the
+ * task's main thread.
+ */
+
+#ifndef _SCHED_H_
+#define _SCHED_H_
+
+#include <stddef.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "tasks.h"
+
+/* Number of tasks in the top waiters summary unless given */
+#define WAITERS_DEFAULT 10
+
+/**
+ * The tasks of one scan and when it was taken.
+ */
+struct task_sample {
+    struct task *tasks;
+    size_t n;
+    struct timespec time;
+};
+
+/**
+ * Sets the per-second rates of every task in cur that also appears in prev.
+ * Returns 0 on success or -1 if out of memory.
+ */
+int task_rates(const struct task_sample *prev, struct task_sample *cur);
+
+/**
+ * Selects the (at most) k tasks with the highest run queue wait rate, with a
+ * bounded min-heap of size k, so that hosts with many tasks need O(n log k)
+ * time and no copy of the task array. Stores their indices in top in
+ * descending order of wait rate and returns how many there are.
+ */
+size_t top_waiters(const struct task *tasks, size_t n, size_t k,
+        size_t *top);
+
+/**
+ * Prints the top k waiters of a sample whose rates have been computed, with
+ * their run rate, timeslice rate, and average wait per timeslice. Returns
+ * the number of lines printed.
+ */
+int waiters_print(FILE *out, const struct task_sample *sample, size_t k);
+
+/**
+ * Writes the same values as waiters_print() as a JSON array.
+ */
+void waiters_print_json(FILE *out, const struct task_sample *sample,
+        size_t k);
+
+/**
+ * Frees the tasks of a sample.
+ */
+void task_sample_free(struct task_sample *sample);
+
+#endif
@@ -0,0 +1,108 @@
+/**
+ * @file
+ *
+ * Self-profiling counters and phase timers. See stats.h for an overview.
+ */
+
+#include <unistd.h>
+
+#include "stats.h"
+#include "procfs.h"
+
+bool stats_enabled;
+uint64_t stats_counters[STAT_COUNTERS];
+
+/**
+ * Accumulated timings of one phase, in nanoseconds.
+ */
+struct phase_totals {
+    uint64_t calls;
+    uint64_t wall_ns;
+    uint64_t cpu_ns;
+};
+
+static struct phase_totals phases[STAT_PHASES];
+
+/* Time the calling thread has spent in stats_sleep() */
+static __thread uint64_t slept_ns;
+
+static const char *phase_names[STAT_PHASES] = {
+    "sys_info", "hardware_info", "psi_info", "disk_info", "net_info",
+    "numa_info", "cgroup_info", "waiters_info", "task_info", "tree_info",
+    "live_tick", "batch_iter", "watch_tick",
+};
+
+static const char *counter_names[STAT_COUNTERS] = {
+    "System calls", "Files opened", "Bytes read", "Tasks parsed",
+};
+
+void stats_begin(struct stats_timer *timer)
+{
+    if (__builtin_expect(stats_enabled, 0)) {
+        clock_gettime(CLOCK_MONOTONIC, &timer->wall);
+        clock_gettime(CLOCK_THREAD_CPUTIME_ID, &timer->cpu);
+        timer->slept_ns = slept_ns;
+    }
+}
+
+void stats_end(enum stats_phase phase, const struct stats_timer *timer)
+{
+    if (!__builtin_expect(stats_enabled, 0)) {
+        return;
+    }
+
+    struct timespec wall;
+    struct timespec cpu;
+    clock_gettime(CLOCK_MONOTONIC, &wall);
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpu);
+
+    uint64_t wall_ns = (uint64_t) (elapsed_sec(&timer->wall, &wall) * 1e9);
+    uint64_t asleep = slept_ns - timer->slept_ns;
+    wall_ns = wall_ns > asleep ? wall_ns - asleep : 0;
+
+    struct phase_totals *totals = &phases[phase];
+    __atomic_fetch_add(&totals->calls, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&totals->wall_ns, wall_ns, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&totals->cpu_ns,
+            (uint64_t) (elapsed_sec(&timer->cpu, &cpu) * 1e9),
+            __ATOMIC_RELAXED);
+}
+
+void stats_sleep(unsigned int seconds)
+{
+    if (!__builtin_expect(stats_enabled, 0)) {
+        sleep(seconds);
+        return;
+    }
+
+    struct timespec start;
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    sleep(seconds);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    slept_ns += (uint64_t) (elapsed_sec(&start, &end) * 1e9);
+}
+
+void stats_print(FILE *out)
+{
+    fprintf(out, "Inspector Statistics\n");
+    fprintf(out, "--------------------\n");
+    fprintf(out, "Phase         | Calls |    Wall ms |     CPU ms\n");
+    fprintf(out, "--------------+-------+------------+-----------\n");
+
+    for (int i = 0; i < STAT_PHASES; ++i) {
+        const struct phase_totals *totals = &phases[i];
+        if (totals->calls == 0) {
+            continue;
+        }
+        fprintf(out, "%-13s | %5llu | %10.2f | %10.2f\n", phase_names[i],
+                (unsigned long long) totals->calls, totals->wall_ns / 1e6,
+                totals->cpu_ns / 1e6);
+    }
+
+    fprintf(out, "\n");
+    for (int i = 0; i < STAT_COUNTERS; ++i) {
+        fprintf(out, "%s: %llu\n", counter_names[i],
+                (unsigned long long) stats_counters[i]);
+    }
+}
@@ -0,0 +1,108 @@
+/**
+ * @file
+ *
+ * Self-profiling for --stats: wall and CPU time per phase of the program
+ * (each section, each tick of the live view, batch mode, or watch mode) and
+ * counters of the work the readers do (system calls, files opened, bytes
+ * read, and tasks parsed).
+ *
+ * Collection is off unless stats_enabled is set, and every hook starts with
+ * a single predictable branch on it, so the instrumentation costs next to
+ * nothing in normal runs. Totals are process-wide and updated with relaxed
+ * atomics, so threads inspecting different roots add to the same summary.
+ *
+ * System calls are counted where the readers make them: opens, reads,
+ * closes, stats, and io_uring_enter. Directory listings count their open and
+ * close only, since readdir() hides how many getdents calls it makes; file
+ * operations run inside io_uring count as files opened and bytes read but
+ * not as system calls.
+ */
+
+#ifndef _STATS_H_
+#define _STATS_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+/**
+ * Work counters.
+ */
+enum stats_counter {
+    STAT_SYSCALLS,
+    STAT_FILES_OPENED,
+    STAT_BYTES_READ,
+    STAT_TASKS_PARSED,
+    STAT_COUNTERS,
+};
+
+/**
+ * Timed phases.
+ */
+enum stats_phase {
+    PHASE_SYS_INFO,
+    PHASE_HARDWARE_INFO,
+    PHASE_PSI,
+    PHASE_DISKS,
+    PHASE_NET,
+    PHASE_NUMA,
+    PHASE_CGROUPS,
+    PHASE_WAITERS,
+    PHASE_TASK_INFO,
+    PHASE_TREE,
+    PHASE_LIVE_TICK,
+    PHASE_BATCH_ITERATION,
+    PHASE_WATCH_TICK,
+    STAT_PHASES,
+};
+
+/**
+ * The start of a timed phase.
+ */
+struct stats_timer {
+    struct timespec wall;
+    struct timespec cpu;
+    uint64_t slept_ns; /**< Calling thread's stats_sleep() total at start */
+};
+
+/* Set once at startup to turn collection on */
+extern bool stats_enabled;
+
+/* Use stats_add() rather than updating these directly */
+extern uint64_t stats_counters[STAT_COUNTERS];
+
+/**
+ * Adds n to a counter if collection is enabled.
+ */
+static inline void stats_add(enum stats_counter counter, uint64_t n)
+{
+    if (__builtin_expect(stats_enabled, 0)) {
+        __atomic_fetch_add(&stats_counters[counter], n, __ATOMIC_RELAXED);
+    }
+}
+
+/**
+ * Starts timing a phase (on the calling thread) if collection is enabled.
+ */
+void stats_begin(struct stats_timer *timer);
+
+/**
+ * Adds the time since stats_begin() to a phase if collection is enabled.
+ */
+void stats_end(enum stats_phase phase, const struct stats_timer *timer);
+
+/**
+ * Sleeps for the given number of seconds, like sleep(). The time asleep is
+ * left out of the wall time of every phase being timed on the calling thread,
+ * so that a section measuring rates over an interval is charged only for its
+ * sampling.
+ */
+void stats_sleep(unsigned int seconds);
+
+/**
+ * Prints the phase timings and counters collected so far to out.
+ */
+void stats_print(FILE *out);
+
+#endif
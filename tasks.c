@@ -0,0 +1,1203 @@
+/**
+ * @file
+ *
+ * Task list scanning and column definitions. See tasks.h for an overview.
+ */
+
+#include <ctype.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pwd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "cgroups.h"
+#include "debug.h"
+#include "json.h"
+#include "numa.h"
+#include "stats.h"
+#include "tasks.h"
+
+/* Number of tasks whose files are requested together in one batch */
+#define TASK_BATCH 256
+
+/* Maximum number of files the io_uring backend keeps in flight */
+#define IO_DEPTH 64
+
+/* Longest path below the procfs root we build for a task */
+#define TASK_PATH_SZ 48
+
+/**
+ * A per-task source that is backed by a request to the batch I/O layer.
+ */
+struct file_source {
+    unsigned int source;
+    const char *file;
+    size_t buf_sz;
+    void (*parse)(char *buf, struct task *task);
+
+    /* Whether failing to find this source means the task has exited */
+    bool required;
+};
+
+static void parse_stat(char *buf, struct task *task);
+static void parse_status(char *buf, struct task *task);
+static void parse_statm(char *buf, struct task *task);
+static void parse_smaps_rollup(char *buf, struct task *task);
+static void parse_cgroup(char *buf, struct task *task);
+static void parse_schedstat(char *buf, struct task *task);
+
+/* A NULL file stands for the /proc/[pid] directory itself (stat only) */
+static const struct file_source file_sources[] = {
+    { SRC_OWNER,  NULL,           0,    NULL,               true },
+    { SRC_STAT,   "stat",         1024, parse_stat,         true },
+    { SRC_STATUS, "status",       4096, parse_status,       true },
+    { SRC_STATM,  "statm",        256,  parse_statm,        true },
+    { SRC_SMAPS,  "smaps_rollup", 2048, parse_smaps_rollup, false },
+    { SRC_CGROUP, "cgroup",       4096, parse_cgroup,       false },
+    { SRC_SCHEDSTAT, "schedstat", 128,  parse_schedstat,    false },
+};
+
+#define NUM_FILE_SOURCES (sizeof(file_sources) / sizeof(file_sources[0]))
+
+/**
+ * Extracts the fields we use from /proc/[pid]/stat. The command name is
+ * enclosed in parentheses and may itself contain spaces or parentheses, so
+ * the remaining fields are located from the last ')'.
+ */
+static void parse_stat(char *buf, struct task *task)
+{
+    char *open = strchr(buf, '(');
+    char *close = strrchr(buf, ')');
+    if (open == NULL || close == NULL || close < open) {
+        return;
+    }
+
+    size_t len = close - open - 1;
+    if (len >= sizeof(task->name)) {
+        len = sizeof(task->name) - 1;
+    }
+    memcpy(task->name, open + 1, len);
+    task->name[len] = '\0';
+
+    /* Fields 3 (state) onward; see proc(5) */
+    sscanf(close + 2,
+            "%c %d %*d %*d %*d %*d %*u %*u %*u %*u %*u %llu %llu "
+            "%*d %*d %*d %*d %d %*d %llu",
+            &task->state, &task->ppid, &task->utime, &task->stime,
+            &task->threads, &task->start_time);
+}
+
+/**
+ * Invokes fn on the key and value of each "Key:\tvalue" line of buf. Lines
+ * are only split at their first ':'; values are parsed by the callback.
+ */
+static void parse_keyed(char *buf, struct task *task,
+        void (*fn)(const char *key, size_t key_len, const char *value,
+            struct task *task))
+{
+    char *line = buf;
+    while (line != NULL && *line != '\0') {
+        char *end = strchr(line, '\n');
+        char *colon = memchr(line, ':',
+                end != NULL ? (size_t) (end - line) : strlen(line));
+
+        if (colon != NULL) {
+            const char *value = colon + 1 + strspn(colon + 1, "\t ");
+            fn(line, colon - line, value, task);
+        }
+
+        line = (end != NULL) ? end + 1 : NULL;
+    }
+}
+
+static bool key_is(const char *key, size_t key_len, const char *want)
+{
+    return strlen(want) == key_len && strncmp(key, want, key_len) == 0;
+}
+
+static void status_field(const char *key, size_t key_len, const char *value,
+        struct task *task)
+{
+    if (key_is(key, key_len, "VmSwap")) {
+        task->swap_kb = atoll(value);
+    } else if (key_is(key, key_len, "voluntary_ctxt_switches")) {
+        task->vcsw = atoll(value);
+    } else if (key_is(key, key_len, "nonvoluntary_ctxt_switches")) {
+        task->ivcsw = atoll(value);
+    }
+}
+
+/**
+ * Extracts the fields we use from /proc/[pid]/status.
+ */
+static void parse_status(char *buf, struct task *task)
+{
+    /* Kernel threads have no VmSwap line */
+    task->swap_kb = 0;
+    parse_keyed(buf, task, status_field);
+}
+
+/**
+ * Extracts total program size and resident set size from /proc/[pid]/statm.
+ */
+static void parse_statm(char *buf, struct task *task)
+{
+    long long size, resident;
+    if (sscanf(buf, "%lld %lld", &size, &resident) == 2) {
+        long long page_kb = sysconf(_SC_PAGESIZE) / 1024;
+        task->vsize_kb = size * page_kb;
+        task->rss_kb = resident * page_kb;
+    }
+}
+
+static void smaps_field(const char *key, size_t key_len, const char *value,
+        struct task *task)
+{
+    if (key_is(key, key_len, "Pss")) {
+        task->pss_kb = atoll(value);
+    }
+}
+
+/**
+ * Extracts the proportional set size from /proc/[pid]/smaps_rollup.
+ */
+static void parse_smaps_rollup(char *buf, struct task *task)
+{
+    parse_keyed(buf, task, smaps_field);
+}
+
+/**
+ * Maps the task to its cgroup through /proc/[pid]/cgroup. Needs the start
+ * time from stat, which is always read in an earlier stage.
+ */
+static void parse_cgroup(char *buf, struct task *task)
+{
+    task->cgroup = cgroup_cache_store(task->pid, task->start_time, buf);
+}
+
+/**
+ * Extracts the run time, run queue wait time (both in nanoseconds), and
+ * number of timeslices from /proc/[pid]/schedstat. The file is missing on
+ * kernels built without CONFIG_SCHEDSTATS.
+ */
+static void parse_schedstat(char *buf, struct task *task)
+{
+    sscanf(buf, "%lld %lld %lld", &task->run_ns, &task->wait_ns,
+            &task->slices);
+}
+
+/**
+ * Opens a directory below the procfs root for reading with readdir().
+ */
+static DIR *open_dir(int root, const char *path)
+{
+    int fd = openat(root, path, O_RDONLY | O_DIRECTORY);
+    stats_add(STAT_SYSCALLS, 1);
+    if (fd == -1) {
+        return NULL;
+    }
+    stats_add(STAT_FILES_OPENED, 1);
+
+    DIR *dir = fdopendir(fd);
+    if (dir == NULL) {
+        close(fd);
+    }
+    return dir;
+}
+
+/**
+ * Counts the open file descriptors of a task, or returns -1 if its fd
+ * directory cannot be read.
+ */
+static int count_fds(int root, int pid)
+{
+    char path[TASK_PATH_SZ];
+    snprintf(path, sizeof(path), "%d/fd", pid);
+
+    DIR *dir = open_dir(root, path);
+    if (dir == NULL) {
+        return -1;
+    }
+
+    int count = 0;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (entry->d_name[0] != '.') {
+            count++;
+        }
+    }
+    closedir(dir);
+    stats_add(STAT_SYSCALLS, 1);
+    return count;
+}
+
+/**
+ * Finds the home node of a task, or returns -1 if its numa_maps cannot be
+ * read. The file has a line per mapping and can be far larger than the
+ * other sources, so it is read on its own into a growable buffer.
+ */
+static int home_node(int root, int pid, struct file_buf *buf)
+{
+    char path[TASK_PATH_SZ];
+    snprintf(path, sizeof(path), "%d/numa_maps", pid);
+
+    if (file_buf_read(buf, root, path) == -1) {
+        return -1;
+    }
+    return numa_home_node(buf->data);
+}
+
+const char *task_state_name(char state)
+{
+    switch (state) {
+        case 'R': return "running";
+        case 'S': return "sleeping";
+        case 'D': return "disk sleep";
+        case 'T': return "stopped";
+        case 't': return "tracing stop";
+        case 'X': return "dead";
+        case 'Z': return "zombie";
+        case 'P': return "parked";
+        case 'I': return "idle";
+        default:  return "unknown";
+    }
+}
+
+const char *uid_cache_name(struct uid_cache *cache, uid_t uid)
+{
+    size_t idx = uid % UID_CACHE_SZ;
+    if (cache->entries[idx].valid && cache->entries[idx].uid == uid) {
+        return cache->entries[idx].name;
+    }
+
+    struct passwd entry;
+    struct passwd *pw = NULL;
+    char pw_buf[4096];
+    char *name = cache->entries[idx].name;
+    size_t name_sz = sizeof(cache->entries[idx].name);
+    getpwuid_r(uid, &entry, pw_buf, sizeof(pw_buf), &pw);
+    if (pw != NULL) {
+        snprintf(name, name_sz, "%s", pw->pw_name);
+    } else {
+        snprintf(name, name_sz, "%d", (int) uid);
+    }
+    cache->entries[idx].uid = uid;
+    cache->entries[idx].valid = true;
+    return name;
+}
+
+/**
+ * Collects the numeric (task) entries of the procfs root that fall in the
+ * filter's PID range into *pids, which holds *cap entries and is grown as
+ * needed. Returns the number of PIDs stored, or -1 if the root cannot be
+ * listed or memory is exhausted.
+ */
+static ssize_t list_pids(int root, const struct task_filter *filter,
+        int **pids, size_t *cap)
+{
+    size_t count = 0;
+    if (*cap == 0) {
+        if ((*pids = malloc(1024 * sizeof(int))) == NULL) {
+            return -1;
+        }
+        *cap = 1024;
+    }
+
+    DIR *directory;
+    if ((directory = open_dir(root, ".")) == NULL) {
+        perror("opendir");
+        return -1;
+    }
+
+    struct dirent *entry;
+    while ((entry = readdir(directory)) != NULL) {
+        if (!isdigit((unsigned char) entry->d_name[0])) {
+            continue;
+        }
+
+        int pid = atoi(entry->d_name);
+        if (pid < filter->pid_min || pid > filter->pid_max) {
+            continue;
+        }
+
+        if (count == *cap) {
+            int *grown = realloc(*pids, *cap * 2 * sizeof(int));
+            if (grown == NULL) {
+                closedir(directory);
+                return -1;
+            }
+            *pids = grown;
+            *cap *= 2;
+        }
+        (*pids)[count++] = pid;
+    }
+    closedir(directory);
+    stats_add(STAT_SYSCALLS, 1);
+
+    return (ssize_t) count;
+}
+
+/**
+ * Returns true if a failed request means the task no longer exists (as
+ * opposed to, e.g., a file we are not allowed to read).
+ */
+static bool task_gone(ssize_t result)
+{
+    return result == -ENOENT || result == -ESRCH;
+}
+
+static void task_init(struct task *task, int pid)
+{
+    memset(task, 0, sizeof(*task));
+    task->pid = pid;
+    task->ppid = -1;
+    task->threads = -1;
+    task->state = '?';
+    task->vsize_kb = -1;
+    task->rss_kb = -1;
+    task->pss_kb = -1;
+    task->swap_kb = -1;
+    task->fds = -1;
+    task->node = -1;
+    task->run_ns = -1;
+    task->wait_ns = -1;
+    task->slices = -1;
+    task->vcsw = -1;
+    task->ivcsw = -1;
+    task->rates.run_ms = -1;
+    task->rates.wait_ms = -1;
+    task->rates.slices = -1;
+    task->rates.vcsw = -1;
+    task->rates.ivcsw = -1;
+}
+
+void task_filter_init(struct task_filter *filter)
+{
+    memset(filter, 0, sizeof(*filter));
+    filter->pid_min = 0;
+    filter->pid_max = INT_MAX;
+}
+
+void task_filter_free(struct task_filter *filter)
+{
+    if (filter->by_name) {
+        regfree(&filter->name);
+        filter->by_name = false;
+    }
+}
+
+int task_filter_set_user(struct task_filter *filter, const char *user)
+{
+    char *end;
+    long uid = strtol(user, &end, 10);
+    if (*user != '\0' && *end == '\0' && uid >= 0) {
+        filter->uid = (uid_t) uid;
+    } else {
+        struct passwd *pw = getpwnam(user);
+        if (pw == NULL) {
+            fprintf(stderr, "Unknown user `%s'.\n", user);
+            return -1;
+        }
+        filter->uid = pw->pw_uid;
+    }
+    filter->by_user = true;
+    return 0;
+}
+
+int task_filter_set_states(struct task_filter *filter, const char *states)
+{
+    if (*states == '\0' || strspn(states, TASK_STATES) != strlen(states)) {
+        fprintf(stderr, "Invalid state list `%s' (expected letters from %s).\n",
+                states, TASK_STATES);
+        return -1;
+    }
+    snprintf(filter->states, sizeof(filter->states), "%s", states);
+    return 0;
+}
+
+int task_filter_set_name(struct task_filter *filter, const char *pattern)
+{
+    task_filter_free(filter);
+
+    int ret = regcomp(&filter->name, pattern, REG_EXTENDED | REG_NOSUB);
+    if (ret != 0) {
+        char msg[128];
+        regerror(ret, &filter->name, msg, sizeof(msg));
+        fprintf(stderr, "Invalid name pattern `%s': %s\n", pattern, msg);
+        return -1;
+    }
+    filter->by_name = true;
+    return 0;
+}
+
+int task_filter_set_pid_range(struct task_filter *filter, const char *range)
+{
+    /* Accepts "N", "N-M", "N-", and "-M" */
+    const char *dash = strchr(range, '-');
+    char *end;
+    long lo = 0;
+    long hi = INT_MAX;
+
+    /* At least one bound is needed */
+    if (range[0] == '\0' || strcmp(range, "-") == 0) {
+        goto invalid;
+    }
+    if (dash != range) {
+        lo = strtol(range, &end, 10);
+        if (end != (dash != NULL ? dash : range + strlen(range))) {
+            goto invalid;
+        }
+        if (dash == NULL) {
+            hi = lo;
+        }
+    }
+    if (dash != NULL && dash[1] != '\0') {
+        hi = strtol(dash + 1, &end, 10);
+        if (*end != '\0') {
+            goto invalid;
+        }
+    }
+    if (lo < 0 || hi < lo || hi > INT_MAX) {
+        goto invalid;
+    }
+
+    filter->pid_min = (int) lo;
+    filter->pid_max = (int) hi;
+    return 0;
+
+invalid:
+    fprintf(stderr, "Invalid PID range `%s' (expected N, N-M, N-, or -M).\n",
+            range);
+    return -1;
+}
+
+unsigned int task_filter_sources(const struct task_filter *filter)
+{
+    unsigned int sources = 0;
+    if (filter->by_user) {
+        sources |= SRC_OWNER;
+    }
+    if (filter->states[0] != '\0' || filter->by_name) {
+        sources |= SRC_STAT;
+    }
+    return sources;
+}
+
+/**
+ * Checks a task against the filter criteria whose sources are in 'known'.
+ * Criteria that depend on sources not read yet are assumed to pass.
+ */
+static bool task_matches(const struct task_filter *filter,
+        const struct task *task, unsigned int known)
+{
+    if ((known & SRC_OWNER) && filter->by_user && task->uid != filter->uid) {
+        return false;
+    }
+    if (known & SRC_STAT) {
+        if (filter->states[0] != '\0'
+                && strchr(filter->states, task->state) == NULL) {
+            return false;
+        }
+        if (filter->by_name
+                && regexec(&filter->name, task->name, 0, NULL, 0) != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool task_filter_matches(const struct task_filter *filter,
+        const struct task *task)
+{
+    if (task->pid < filter->pid_min || task->pid > filter->pid_max) {
+        return false;
+    }
+    return task_matches(filter, task, task_filter_sources(filter));
+}
+
+/**
+ * State kept between scans: the batch context and every buffer a scan needs
+ * except the task array it returns. Each task in a batch owns a region of
+ * bufs, with a fixed offset per file source that is set for each scan.
+ */
+struct task_scanner {
+    int root;
+    enum io_backend backend;
+    struct io_batch *batch; /**< Created by the first scan that needs it */
+
+    int *pids;
+    size_t pids_cap;
+
+    struct io_req *reqs;
+    char (*paths)[TASK_PATH_SZ];
+    char *bufs;
+    size_t bufs_sz;
+    size_t buf_off[NUM_FILE_SOURCES];
+    size_t task_buf_sz;
+
+    /* numa_maps contents; see home_node() */
+    struct file_buf numa_buf;
+
+    /* Task (index into idx) and source of each request */
+    size_t *req_task;
+    const struct file_source **req_src;
+};
+
+/**
+ * Reads the given sources for the tasks tasks[idx[0..n)], then drops tasks
+ * that have exited or that fail the filter given everything read so far
+ * ('known' includes 'sources'). If 'count' is set, the tasks that had any
+ * file read are added to STAT_TASKS_PARSED. Returns the number of tasks left
+ * in idx.
+ */
+static size_t scan_stage(struct task_scanner *scan, unsigned int sources,
+        unsigned int known, const struct task_filter *filter,
+        struct task *tasks, size_t *idx, size_t n, bool count)
+{
+    /* Requests are grouped by task, in file_sources order. A task has no
+     * request for a cgroup file whose contents are cached. */
+    size_t nreqs = 0;
+    for (size_t i = 0; i < n; ++i) {
+        struct task *task = &tasks[idx[i]];
+        for (size_t s = 0; s < NUM_FILE_SOURCES; ++s) {
+            const struct file_source *src = &file_sources[s];
+            if (!(sources & src->source)) {
+                continue;
+            }
+            if (src->source == SRC_CGROUP) {
+                task->cgroup = cgroup_cache_lookup(task->pid,
+                        task->start_time);
+                if (task->cgroup != NULL) {
+                    continue;
+                }
+            }
+
+            struct io_req *req = &scan->reqs[nreqs];
+            char *path = scan->paths[nreqs];
+            if (src->file == NULL) {
+                snprintf(path, TASK_PATH_SZ, "%d", task->pid);
+                req->kind = IO_REQ_STAT;
+            } else {
+                snprintf(path, TASK_PATH_SZ, "%d/%s", task->pid, src->file);
+                req->kind = IO_REQ_READ;
+                req->buf = scan->bufs + idx[i] * scan->task_buf_sz
+                    + scan->buf_off[s];
+                req->size = src->buf_sz;
+            }
+            req->path = path;
+            scan->req_task[nreqs] = i;
+            scan->req_src[nreqs] = src;
+            nreqs++;
+        }
+    }
+
+    if (nreqs > 0) {
+        io_batch_submit(scan->batch, scan->reqs, nreqs);
+    }
+
+    size_t kept = 0;
+    size_t parsed = 0;
+    size_t r = 0;
+    for (size_t i = 0; i < n; ++i) {
+        struct task *task = &tasks[idx[i]];
+        bool gone = false;
+        bool read = false;
+
+        for (; r < nreqs && scan->req_task[r] == i; ++r) {
+            const struct io_req *req = &scan->reqs[r];
+            const struct file_source *src = scan->req_src[r];
+            if (gone) {
+                continue;
+            }
+
+            if (req->result == -ESRCH && src->source == SRC_SMAPS) {
+                /* Kernel threads have no address space to roll up */
+                task->pss_kb = 0;
+            } else if (req->result < 0) {
+                gone = src->required && task_gone(req->result);
+            } else if (src->file == NULL) {
+                task->uid = req->uid;
+            } else if (req->result == 0 && src->source == SRC_STAT) {
+                /* stat is never empty for a live task */
+                gone = true;
+            } else {
+                src->parse(req->buf, task);
+                read = true;
+            }
+        }
+        parsed += read;
+
+        if (!gone && task_matches(filter, task, known)) {
+            idx[kept++] = idx[i];
+        }
+    }
+
+    if (count) {
+        stats_add(STAT_TASKS_PARSED, parsed);
+    }
+    return kept;
+}
+
+struct task_scanner *task_scanner_create(int root, enum io_backend backend)
+{
+    struct task_scanner *scanner = calloc(1, sizeof(struct task_scanner));
+    if (scanner == NULL) {
+        return NULL;
+    }
+    scanner->root = root;
+    scanner->backend = backend;
+
+    size_t nreqs = TASK_BATCH * NUM_FILE_SOURCES;
+    scanner->reqs = calloc(nreqs, sizeof(struct io_req));
+    scanner->paths = calloc(nreqs, TASK_PATH_SZ);
+    scanner->req_task = calloc(nreqs, sizeof(size_t));
+    scanner->req_src = calloc(nreqs, sizeof(struct file_source *));
+    if (scanner->reqs == NULL || scanner->paths == NULL
+            || scanner->req_task == NULL || scanner->req_src == NULL) {
+        task_scanner_destroy(scanner);
+        return NULL;
+    }
+    return scanner;
+}
+
+void task_scanner_destroy(struct task_scanner *scanner)
+{
+    if (scanner == NULL) {
+        return;
+    }
+    io_batch_destroy(scanner->batch);
+    file_buf_free(&scanner->numa_buf);
+    free(scanner->req_src);
+    free(scanner->req_task);
+    free(scanner->bufs);
+    free(scanner->paths);
+    free(scanner->reqs);
+    free(scanner->pids);
+    free(scanner);
+}
+
+/**
+ * Lays out the per-task file buffers for the given sources, growing bufs if
+ * needed, and sets up the batch context on first use. Returns 0 on success
+ * or -1 if out of memory.
+ */
+static int scanner_prepare(struct task_scanner *scan, unsigned int sources,
+        bool batched)
+{
+    scan->task_buf_sz = 0;
+    for (size_t s = 0; s < NUM_FILE_SOURCES; ++s) {
+        if (sources & file_sources[s].source) {
+            scan->buf_off[s] = scan->task_buf_sz;
+            scan->task_buf_sz += file_sources[s].buf_sz;
+        }
+    }
+
+    size_t sz = TASK_BATCH * scan->task_buf_sz;
+    if (sz > scan->bufs_sz) {
+        char *bufs = realloc(scan->bufs, sz);
+        if (bufs == NULL) {
+            return -1;
+        }
+        scan->bufs = bufs;
+        scan->bufs_sz = sz;
+    }
+
+    if (batched && scan->batch == NULL) {
+        scan->batch = io_batch_create(scan->backend, scan->root, IO_DEPTH);
+        if (scan->batch == NULL) {
+            return -1;
+        }
+        LOG("Reading task files with the %s backend\n",
+                io_batch_backend_name(scan->batch));
+    }
+    return 0;
+}
+
+size_t task_scanner_scan(struct task_scanner *scanner, unsigned int sources,
+        const struct task_filter *filter, struct task **tasks)
+{
+    int root = scanner->root;
+    ssize_t listed = list_pids(root, filter, &scanner->pids,
+            &scanner->pids_cap);
+    *tasks = NULL;
+    if (listed == -1) {
+        return 0;
+    }
+    size_t npids = (size_t) listed;
+    const int *pids = scanner->pids;
+
+    /* Sources are read in stages so that a filter can reject a task before
+     * the rest of its files are opened: first the directory owner (--user),
+     * then stat (--state and --name), then everything else. The cgroup
+     * cache is keyed by start time, so stat also goes first if the cgroup
+     * is wanted. */
+    sources |= task_filter_sources(filter);
+    unsigned int stages[3];
+    int nstages = 0;
+    unsigned int rest = sources & ~(SRC_FD | SRC_NUMA);
+    if (filter->by_user) {
+        stages[nstages++] = SRC_OWNER;
+        rest &= ~SRC_OWNER;
+    }
+    if (filter->states[0] != '\0' || filter->by_name
+            || (sources & SRC_CGROUP)) {
+        sources |= SRC_STAT;
+        stages[nstages++] = SRC_STAT;
+        rest &= ~SRC_STAT;
+    }
+    if (rest != 0) {
+        stages[nstages++] = rest;
+    }
+
+    if (scanner_prepare(scanner, sources, nstages > 0) == -1
+            || (*tasks = calloc(npids > 0 ? npids : 1,
+                    sizeof(struct task))) == NULL) {
+        return 0;
+    }
+    size_t count = 0;
+    size_t idx[TASK_BATCH];
+
+    for (size_t first = 0; first < npids; first += TASK_BATCH) {
+        size_t n = npids - first;
+        if (n > TASK_BATCH) {
+            n = TASK_BATCH;
+        }
+
+        /* Tasks are parsed straight into the output array; rejected ones
+         * are overwritten when the survivors are compacted below. */
+        struct task *batch_tasks = &(*tasks)[count];
+        for (size_t i = 0; i < n; ++i) {
+            task_init(&batch_tasks[i], pids[first + i]);
+            idx[i] = i;
+        }
+
+        /* A task is counted as parsed in the first stage that reads its
+         * files; the directory owner is not a file */
+        unsigned int known = 0;
+        for (int st = 0; st < nstages && n > 0; ++st) {
+            bool first_read = (stages[st] & ~SRC_OWNER) != 0
+                && (known & ~SRC_OWNER) == 0;
+            known |= stages[st];
+            n = scan_stage(scanner, stages[st], known, filter, batch_tasks,
+                    idx, n, first_read);
+        }
+        TRACE(TRACE_DEBUG, "task_batch", first, n);
+
+        for (size_t i = 0; i < n; ++i) {
+            struct task *task = &(*tasks)[count++];
+            if (task != &batch_tasks[idx[i]]) {
+                *task = batch_tasks[idx[i]];
+            }
+            if (sources & SRC_FD) {
+                task->fds = count_fds(root, task->pid);
+            }
+            if (sources & SRC_NUMA) {
+                task->node = home_node(root, task->pid, &scanner->numa_buf);
+            }
+        }
+    }
+
+    TRACE(TRACE_INFO, "tasks_scan", npids, count);
+    return count;
+}
+
+size_t tasks_scan(int root, unsigned int sources,
+        const struct task_filter *filter, enum io_backend backend,
+        struct task **tasks)
+{
+    struct task_scanner *scanner = task_scanner_create(root, backend);
+    if (scanner == NULL) {
+        *tasks = NULL;
+        return 0;
+    }
+    size_t count = task_scanner_scan(scanner, sources, filter, tasks);
+    task_scanner_destroy(scanner);
+    return count;
+}
+
+void format_kb(long long kb, char *buf, size_t sz)
+{
+    if (kb < 0) {
+        snprintf(buf, sz, "-");
+    } else if (kb < 1024) {
+        snprintf(buf, sz, "%lldK", kb);
+    } else if (kb < 1024 * 1024) {
+        snprintf(buf, sz, "%.1fM", kb / 1024.0);
+    } else {
+        snprintf(buf, sz, "%.1fG", kb / (1024.0 * 1024.0));
+    }
+}
+
+static void format_int(int value, char *buf, size_t sz)
+{
+    if (value < 0) {
+        snprintf(buf, sz, "-");
+    } else {
+        snprintf(buf, sz, "%d", value);
+    }
+}
+
+static void fmt_pid(const struct task *task, struct uid_cache *users,
+        char *buf, size_t sz)
+{
+    snprintf(buf, sz, "%d", task->pid);
+}
+
+static void fmt_ppid(const struct task *task, struct uid_cache *users,
+        char *buf, size_t sz)
+{
+    format_int(task->ppid, buf, sz);
+}
+
+static void fmt_state(const struct task *task, struct uid_cache *users,
+        char *buf, size_t sz)
+{
+    snprintf(buf, sz, "%s", task_state_name(task->state));
+}
+
+static void fmt_name(const struct task *task, struct uid_cache *users,
+        char *buf, size_t sz)
+{
+    /* Truncate to the width of the column */
+    snprintf(buf, sz, "%.25s", task->name);
+}
+
+static void fmt_user(const struct task *task, struct uid_cache *users,
+        char *buf, size_t sz)
+{
+    snprintf(buf, sz, "%s", uid_cache_name(users, task->uid));
+}
+
+static void fmt_threads(const struct task *task, struct uid_cache *users,
+        char *buf, size_t sz)
+{
+    format_int(task->threads, buf, sz);
+}
+
+void format_ticks(unsigned long long ticks, char *buf, size_t sz)
+{
+    long hz = sysconf(_SC_CLK_TCK);
+
+    snprintf(buf, sz, "%llu.%02llu", ticks / hz, (ticks % hz) * 100 / hz);
+}
+
+static void fmt_cpu(const struct task *task, struct uid_cache *users,
+        char *buf, size_t sz)
+{
+    format_ticks(task->utime + task->stime, buf, sz);
+}
+
+static void fmt_vsz(const struct task *task, struct uid_cache *users,
+        char *buf, size_t sz)
+{
+    format_kb(task->vsize_kb, buf, sz);
+}
+
+static void fmt_rss(const struct task *task, struct uid_cache *users,
+        char *buf, size_t sz)
+{
+    format_kb(task->rss_kb, buf, sz);
+}
+
+static void fmt_pss(const struct task *task, struct uid_cache *users,
+        char *buf, size_t sz)
+{
+    format_kb(task->pss_kb, buf, sz);
+}
+
+static void fmt_swap(const struct task *task, struct uid_cache *users,
+        char *buf, size_t sz)
+{
+    format_kb(task->swap_kb, buf, sz);
+}
+
+static void fmt_fds(const struct task *task, struct uid_cache *users,
+        char *buf, size_t sz)
+{
+    format_int(task->fds, buf, sz);
+}
+
+static void fmt_node(const struct task *task, struct uid_cache *users,
+        char *buf, size_t sz)
+{
+    format_int(task->node, buf, sz);
+}
+
+/**
+ * Formats a per-second rate, or "-" if it is unknown.
+ */
+static void format_per_sec(double value, char *buf, size_t sz)
+{
+    if (value < 0) {
+        snprintf(buf, sz, "-");
+    } else {
+        snprintf(buf, sz, "%.1f", value);
+    }
+}
+
+static void fmt_run(const struct task *task, struct uid_cache *users,
+        char *buf, size_t sz)
+{
+    format_per_sec(task->rates.run_ms, buf, sz);
+}
+
+static void fmt_wait(const struct task *task, struct uid_cache *users,
+        char *buf, size_t sz)
+{
+    format_per_sec(task->rates.wait_ms, buf, sz);
+}
+
+static void fmt_slices(const struct task *task, struct uid_cache *users,
+        char *buf, size_t sz)
+{
+    format_per_sec(task->rates.slices, buf, sz);
+}
+
+static void fmt_vcsw(const struct task *task, struct uid_cache *users,
+        char *buf, size_t sz)
+{
+    format_per_sec(task->rates.vcsw, buf, sz);
+}
+
+static void fmt_ivcsw(const struct task *task, struct uid_cache *users,
+        char *buf, size_t sz)
+{
+    format_per_sec(task->rates.ivcsw, buf, sz);
+}
+
+static double val_pid(const struct task *task)
+{
+    return task->pid;
+}
+
+static double val_ppid(const struct task *task)
+{
+    return task->ppid;
+}
+
+static double val_threads(const struct task *task)
+{
+    return task->threads;
+}
+
+static double val_cpu(const struct task *task)
+{
+    return (double) (task->utime + task->stime);
+}
+
+static double val_vsz(const struct task *task)
+{
+    return task->vsize_kb;
+}
+
+static double val_rss(const struct task *task)
+{
+    return task->rss_kb;
+}
+
+static double val_pss(const struct task *task)
+{
+    return task->pss_kb;
+}
+
+static double val_swap(const struct task *task)
+{
+    return task->swap_kb;
+}
+
+static double val_fds(const struct task *task)
+{
+    return task->fds;
+}
+
+static double val_node(const struct task *task)
+{
+    return task->node;
+}
+
+static double val_run(const struct task *task)
+{
+    return task->rates.run_ms;
+}
+
+static double val_wait(const struct task *task)
+{
+    return task->rates.wait_ms;
+}
+
+static double val_slices(const struct task *task)
+{
+    return task->rates.slices;
+}
+
+static double val_vcsw(const struct task *task)
+{
+    return task->rates.vcsw;
+}
+
+static double val_ivcsw(const struct task *task)
+{
+    return task->rates.ivcsw;
+}
+
+static const struct column columns[] = {
+    { "pid",   "PID",       5,  0,          fmt_pid,     val_pid },
+    { "state", "State",     12, SRC_STAT,   fmt_state,   NULL },
+    { "name",  "Task Name", 25, SRC_STAT,   fmt_name,    NULL },
+    { "user",  "User",      15, SRC_OWNER,  fmt_user,    NULL },
+    { "tasks", "Tasks",     5,  SRC_STAT,   fmt_threads, val_threads },
+    { "ppid",  "PPID",      5,  SRC_STAT,   fmt_ppid,    val_ppid },
+    { "cpu",   "CPU Time",  9,  SRC_STAT,   fmt_cpu,     val_cpu },
+    { "vsz",   "VSZ",       8,  SRC_STATM,  fmt_vsz,     val_vsz },
+    { "rss",   "RSS",       8,  SRC_STATM,  fmt_rss,     val_rss },
+    { "pss",   "PSS",       8,  SRC_SMAPS,  fmt_pss,     val_pss },
+    { "swap",  "Swap",      8,  SRC_STATUS, fmt_swap,    val_swap },
+    { "fds",   "FDs",       5,  SRC_FD,     fmt_fds,     val_fds },
+    { "node",  "Node",      4,  SRC_NUMA,   fmt_node,    val_node },
+    { "run",   "Run ms/s",  9,  SRC_SCHEDSTAT, fmt_run,    val_run,    true },
+    { "wait",  "Wait ms/s", 9,  SRC_SCHEDSTAT, fmt_wait,   val_wait,   true },
+    { "slices", "Slices/s", 8,  SRC_SCHEDSTAT, fmt_slices, val_slices, true },
+    { "vcsw",  "VCSW/s",    8,  SRC_STATUS, fmt_vcsw,    val_vcsw,   true },
+    { "ivcsw", "IVCSW/s",   8,  SRC_STATUS, fmt_ivcsw,   val_ivcsw,  true },
+};
+
+#define NUM_COLUMNS (sizeof(columns) / sizeof(columns[0]))
+
+static const struct column *column_find(const char *name, size_t len)
+{
+    for (size_t i = 0; i < NUM_COLUMNS; ++i) {
+        if (strlen(columns[i].name) == len
+                && strncmp(columns[i].name, name, len) == 0) {
+            return &columns[i];
+        }
+    }
+    return NULL;
+}
+
+int columns_parse(const char *spec, const struct column **cols)
+{
+    int ncols = 0;
+    const char *p = spec;
+
+    while (*p != '\0') {
+        size_t len = strcspn(p, ",");
+        if (len > 0) {
+            const struct column *col = column_find(p, len);
+            if (col == NULL) {
+                fprintf(stderr, "Unknown column `%.*s'. Available: ",
+                        (int) len, p);
+                columns_print_names(stderr);
+                fprintf(stderr, "\n");
+                return -1;
+            }
+            if (ncols == MAX_COLUMNS) {
+                fprintf(stderr, "Too many columns (max %d).\n", MAX_COLUMNS);
+                return -1;
+            }
+            cols[ncols++] = col;
+        }
+        p += len;
+        if (*p == ',') {
+            p++;
+        }
+    }
+
+    if (ncols == 0) {
+        fprintf(stderr, "No columns selected.\n");
+        return -1;
+    }
+    return ncols;
+}
+
+int columns_default(const struct column **cols)
+{
+    static const char *defaults[] = { "pid", "state", "name", "user", "tasks" };
+    int ncols = 0;
+    for (size_t i = 0; i < sizeof(defaults) / sizeof(defaults[0]); ++i) {
+        cols[ncols++] = column_find(defaults[i], strlen(defaults[i]));
+    }
+    return ncols;
+}
+
+unsigned int columns_sources(const struct column *const *cols, int ncols)
+{
+    unsigned int sources = 0;
+    for (int i = 0; i < ncols; ++i) {
+        sources |= cols[i]->sources;
+    }
+    return sources;
+}
+
+bool columns_rates(const struct column *const *cols, int ncols)
+{
+    for (int i = 0; i < ncols; ++i) {
+        if (cols[i]->rate) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void columns_print_names(FILE *out)
+{
+    for (size_t i = 0; i < NUM_COLUMNS; ++i) {
+        fprintf(out, "%s%s", i > 0 ? "," : "", columns[i].name);
+    }
+}
+
+void columns_print_header(FILE *out, const struct column *const *cols,
+        int ncols)
+{
+    for (int i = 0; i < ncols; ++i) {
+        fprintf(out, "%s%*s", i > 0 ? " | " : "", cols[i]->width,
+                cols[i]->header);
+    }
+    fprintf(out, "\n");
+
+    for (int i = 0; i < ncols; ++i) {
+        int dashes = cols[i]->width + (i > 0 ? 2 : 1);
+        if (i > 0) {
+            fprintf(out, "+");
+        }
+        for (int j = 0; j < dashes; ++j) {
+            fprintf(out, "-");
+        }
+    }
+    fprintf(out, "\n");
+}
+
+void columns_print_row(FILE *out, struct uid_cache *users,
+        const struct column *const *cols, int ncols, const struct task *task)
+{
+    char buf[64];
+    for (int i = 0; i < ncols; ++i) {
+        cols[i]->format(task, users, buf, sizeof(buf));
+        fprintf(out, "%s%*s", i > 0 ? " | " : "", cols[i]->width, buf);
+    }
+    fprintf(out, " \n");
+}
+
+void columns_print_json(FILE *out, struct uid_cache *users,
+        const struct column *const *cols, int ncols, const struct task *task)
+{
+    char buf[64];
+    fprintf(out, "{");
+    for (int i = 0; i < ncols; ++i) {
+        const struct column *col = cols[i];
+        fprintf(out, "%s\"%s\":", i > 0 ? "," : "", col->name);
+        if (col->value == NULL) {
+            col->format(task, users, buf, sizeof(buf));
+            json_string(out, buf);
+        } else if (col->rate) {
+            json_number(out, col->value(task));
+        } else {
+            json_int(out, (long long) col->value(task));
+        }
+    }
+    fprintf(out, "}");
+}
@@ -0,0 +1,292 @@
+/**
+ * @file
+ *
+ * Task list model: scanning /proc/[pid] directories into task records and the
+ * columns that can be displayed for them. Every column declares the procfs
+ * sources it is computed from, and a scan only reads the union of the sources
+ * of the selected columns.
+ */
+
+#ifndef _TASKS_H_
+#define _TASKS_H_
+
+#include <stdbool.h>
+#include <regex.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <sys/types.h>
+
+#include "batch_io.h"
+
+/* Maximum number of columns that can be selected at once */
+#define MAX_COLUMNS 32
+
+/* Number of entries in a UID to user name cache */
+#define UID_CACHE_SZ 64
+
+/* Task states as they appear in /proc/[pid]/stat */
+#define TASK_STATES "RSDTtXZPI"
+
+/**
+ * Per-task data sources. Values are bit flags so that a set of sources can be
+ * stored in a single unsigned int.
+ */
+enum task_source {
+    SRC_OWNER  = 1 << 0, /**< Owner of the /proc/[pid] directory */
+    SRC_STAT   = 1 << 1, /**< /proc/[pid]/stat */
+    SRC_STATUS = 1 << 2, /**< /proc/[pid]/status */
+    SRC_STATM  = 1 << 3, /**< /proc/[pid]/statm */
+    SRC_SMAPS  = 1 << 4, /**< /proc/[pid]/smaps_rollup */
+    SRC_FD     = 1 << 5, /**< Entries of /proc/[pid]/fd/ */
+    SRC_CGROUP = 1 << 6, /**< /proc/[pid]/cgroup (see cgroups.h) */
+    SRC_NUMA   = 1 << 7, /**< /proc/[pid]/numa_maps (see numa.h) */
+    SRC_SCHEDSTAT = 1 << 8, /**< /proc/[pid]/schedstat (see sched.h) */
+};
+
+struct cgroup;
+
+/**
+ * Everything we know about a single task. Fields are only meaningful if their
+ * source was part of the scan; numeric fields that could not be read (e.g.,
+ * due to permissions) are set to -1.
+ */
+struct task {
+    int pid;
+    int ppid;
+    int threads;
+    uid_t uid;
+    char state;
+    char name[32];
+    unsigned long long utime;
+    unsigned long long stime;
+    unsigned long long start_time;
+    long long vsize_kb;
+    long long rss_kb;
+    long long pss_kb;
+    long long swap_kb;
+    int fds;
+    struct cgroup *cgroup; /**< Valid until the next cgroups_sample() */
+    int node;
+
+    /* Scheduler counters of the main thread: time on the CPU and waiting on
+     * a run queue, timeslices run, and context switches */
+    long long run_ns;
+    long long wait_ns;
+    long long slices;
+    long long vcsw;
+    long long ivcsw;
+
+    /* Per-second rates of the counters above, set by task_rates() */
+    struct {
+        double run_ms;
+        double wait_ms;
+        double slices;
+        double vcsw;
+        double ivcsw;
+    } rates;
+};
+
+/**
+ * A direct-mapped cache of user names by UID. getpwuid_r() rescans the
+ * password database on every call, so lookups for the rows of a task list go
+ * through one of these. Zero-initialize before first use.
+ */
+struct uid_cache {
+    struct {
+        bool valid;
+        uid_t uid;
+        char name[32];
+    } entries[UID_CACHE_SZ];
+};
+
+/**
+ * A task list column: how it is selected and displayed, and which sources
+ * its value depends on.
+ */
+struct column {
+    const char *name;
+    const char *header;
+    int width;
+    unsigned int sources;
+    void (*format)(const struct task *task, struct uid_cache *users,
+            char *buf, size_t sz);
+
+    /* Unformatted value for JSON output (a count, kB, clock ticks, or a rate
+     * per second), negative if unknown; NULL for the text columns */
+    double (*value)(const struct task *task);
+
+    /* Whether the value is a rate between two scans (see sched.h) */
+    bool rate;
+};
+
+/**
+ * Criteria a task must meet to be included in a scan. Each criterion is
+ * evaluated as soon as the source it depends on has been read: the PID range
+ * on the directory listing, the user on the owner of /proc/[pid], and the
+ * state and name on /proc/[pid]/stat. Rejected tasks have none of their
+ * remaining files opened.
+ */
+struct task_filter {
+    int pid_min;
+    int pid_max;
+    bool by_user;
+    uid_t uid;
+    char states[sizeof(TASK_STATES)];
+    bool by_name;
+    regex_t name;
+};
+
+/**
+ * Initializes a filter that accepts every task.
+ */
+void task_filter_init(struct task_filter *filter);
+
+/**
+ * Releases resources held by a filter (i.e., the compiled name pattern).
+ */
+void task_filter_free(struct task_filter *filter);
+
+/**
+ * Restricts the filter to tasks owned by a user, given as a name or UID.
+ * Returns 0 on success, or -1 (after printing a message) on failure. The
+ * other task_filter_set_* functions follow the same convention.
+ */
+int task_filter_set_user(struct task_filter *filter, const char *user);
+
+/**
+ * Restricts the filter to tasks in any of the given states, e.g., "RD".
+ */
+int task_filter_set_states(struct task_filter *filter, const char *states);
+
+/**
+ * Restricts the filter to tasks whose name matches an extended regular
+ * expression.
+ */
+int task_filter_set_name(struct task_filter *filter, const char *pattern);
+
+/**
+ * Restricts the filter to PIDs in a range: "N", "N-M", "N-", or "-M".
+ */
+int task_filter_set_pid_range(struct task_filter *filter, const char *range);
+
+/**
+ * Returns the sources the filter's criteria depend on.
+ */
+unsigned int task_filter_sources(const struct task_filter *filter);
+
+/**
+ * Checks a task read with (at least) the filter's sources against every
+ * criterion of the filter, e.g., to count the matching tasks of a scan made
+ * with a different filter.
+ */
+bool task_filter_matches(const struct task_filter *filter,
+        const struct task *task);
+
+/**
+ * Parses a comma-separated list of column names (e.g., "pid,name,rss") into
+ * cols, which must have room for MAX_COLUMNS entries. Returns the number of
+ * columns, or -1 (after printing a message) if a name is not recognized.
+ */
+int columns_parse(const char *spec, const struct column **cols);
+
+/**
+ * Returns the default column set (PID, state, name, user, and thread count)
+ * in cols and its length.
+ */
+int columns_default(const struct column **cols);
+
+/**
+ * Returns the union of the sources needed by the given columns.
+ */
+unsigned int columns_sources(const struct column *const *cols, int ncols);
+
+/**
+ * Returns true if any of the given columns is a rate, so the tasks must be
+ * scanned twice.
+ */
+bool columns_rates(const struct column *const *cols, int ncols);
+
+/**
+ * Prints a comma-separated list of the available column names.
+ */
+void columns_print_names(FILE *out);
+
+/**
+ * Prints the header and separator lines for the given columns.
+ */
+void columns_print_header(FILE *out, const struct column *const *cols,
+        int ncols);
+
+/**
+ * Prints one task list row, looking up user names in 'users'.
+ */
+void columns_print_row(FILE *out, struct uid_cache *users,
+        const struct column *const *cols, int ncols, const struct task *task);
+
+/**
+ * Writes one task as a JSON object keyed by column name. Numeric columns are
+ * written unformatted (see struct column), with null for unknown values, and
+ * text columns as in the task list.
+ */
+void columns_print_json(FILE *out, struct uid_cache *users,
+        const struct column *const *cols, int ncols, const struct task *task);
+
+struct task_scanner;
+
+/**
+ * Creates the state for repeated scans of the procfs root directory fd
+ * 'root' (which must stay open until the scanner is destroyed) with the
+ * given I/O backend. The batch I/O context is set up by the first scan that
+ * reads task files, and it and the scan buffers (PID list, requests, and
+ * file contents) are reused by later scans, which only allocate the task
+ * array they return. Returns NULL if out of memory.
+ */
+struct task_scanner *task_scanner_create(int root, enum io_backend backend);
+
+/**
+ * Frees a scanner and tears down its batch I/O context.
+ */
+void task_scanner_destroy(struct task_scanner *scanner);
+
+/**
+ * Scans every task below the scanner's root that passes the filter, reading
+ * only the given sources (plus those the filter needs). Tasks that exit
+ * during the scan are left out. Returns the number of tasks stored in
+ * *tasks, which the caller must free. If the root cannot be listed or memory
+ * is exhausted, returns 0 with *tasks set to NULL.
+ */
+size_t task_scanner_scan(struct task_scanner *scanner, unsigned int sources,
+        const struct task_filter *filter, struct task **tasks);
+
+/**
+ * Scans the tasks below 'root' once, like task_scanner_scan() with a scanner
+ * that is thrown away afterwards. Callers that sample repeatedly should keep
+ * a scanner instead.
+ */
+size_t tasks_scan(int root, unsigned int sources,
+        const struct task_filter *filter, enum io_backend backend,
+        struct task **tasks);
+
+/**
+ * Maps a UID to a user name, or its number if it has no passwd entry. The
+ * result points into the cache and stays valid until a later lookup replaces
+ * the entry.
+ */
+const char *uid_cache_name(struct uid_cache *cache, uid_t uid);
+
+/**
+ * Formats a size in kilobytes with a binary unit suffix, or "-" if unknown.
+ */
+void format_kb(long long kb, char *buf, size_t sz);
+
+/**
+ * Formats a CPU time in clock ticks as seconds with two decimals.
+ */
+void format_ticks(unsigned long long ticks, char *buf, size_t sz);
+
+/**
+ * Returns a description of a single-letter task state (e.g., "sleeping").
+ */
+const char *task_state_name(char state);
+
+#endif
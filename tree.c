@@ -0,0 +1,170 @@
+/**
+ * @file
+ *
+ * Linear-time process tree construction. See tree.h for an overview.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tree.h"
+
+static size_t pid_hash(int pid, size_t mask)
+{
+    /* Fibonacci hashing spreads consecutive PIDs across the table */
+    return ((uint32_t) pid * 2654435769u) & mask;
+}
+
+int pid_index_build(struct pid_index *idx, const struct task *tasks,
+        size_t n)
+{
+    /* Keep the load factor at or below one half */
+    size_t size = 16;
+    while (size < n * 2) {
+        size *= 2;
+    }
+
+    idx->slots = calloc(size, sizeof(uint32_t));
+    if (idx->slots == NULL) {
+        return -1;
+    }
+    idx->mask = size - 1;
+
+    for (size_t i = 0; i < n; ++i) {
+        size_t h = pid_hash(tasks[i].pid, idx->mask);
+        while (idx->slots[h] != 0) {
+            h = (h + 1) & idx->mask;
+        }
+        idx->slots[h] = (uint32_t) i + 1;
+    }
+    return 0;
+}
+
+int pid_index_find(const struct pid_index *idx, const struct task *tasks,
+        int pid)
+{
+    size_t h = pid_hash(pid, idx->mask);
+    while (idx->slots[h] != 0) {
+        int i = (int) idx->slots[h] - 1;
+        if (tasks[i].pid == pid) {
+            return i;
+        }
+        h = (h + 1) & idx->mask;
+    }
+    return -1;
+}
+
+void pid_index_free(struct pid_index *idx)
+{
+    free(idx->slots);
+    idx->slots = NULL;
+}
+
+int task_tree_build(const struct task *tasks, size_t n,
+        struct task_tree *tree)
+{
+    memset(tree, 0, sizeof(*tree));
+    tree->n = n;
+
+    struct pid_index idx;
+    int *parent = malloc((n + 1) * sizeof(int));
+    int *stack = malloc((n + 1) * sizeof(int));
+    tree->first_child = malloc((n + 1) * sizeof(int));
+    tree->next_sibling = malloc((n + 1) * sizeof(int));
+    tree->order = malloc((n + 1) * sizeof(int));
+    tree->depth = malloc((n + 1) * sizeof(int));
+    tree->sub_threads = malloc((n + 1) * sizeof(long long));
+    tree->sub_ticks = malloc((n + 1) * sizeof(unsigned long long));
+    tree->sub_rss_kb = malloc((n + 1) * sizeof(long long));
+    if (parent == NULL || stack == NULL || tree->first_child == NULL
+            || tree->next_sibling == NULL || tree->order == NULL
+            || tree->depth == NULL || tree->sub_threads == NULL
+            || tree->sub_ticks == NULL || tree->sub_rss_kb == NULL
+            || pid_index_build(&idx, tasks, n) == -1) {
+        free(parent);
+        free(stack);
+        task_tree_free(tree);
+        return -1;
+    }
+
+    /* Link children. Walking backwards and prepending leaves every sibling
+     * list in the order the tasks were scanned. */
+    for (size_t i = 0; i < n; ++i) {
+        tree->first_child[i] = -1;
+        tree->next_sibling[i] = -1;
+    }
+    int first_root = -1;
+    for (size_t j = n; j-- > 0; ) {
+        int p = -1;
+        if (tasks[j].ppid > 0 && tasks[j].ppid != tasks[j].pid) {
+            p = pid_index_find(&idx, tasks, tasks[j].ppid);
+        }
+        parent[j] = p;
+
+        if (p == -1) {
+            tree->next_sibling[j] = first_root;
+            first_root = (int) j;
+        } else {
+            tree->next_sibling[j] = tree->first_child[p];
+            tree->first_child[p] = (int) j;
+        }
+    }
+    pid_index_free(&idx);
+
+    /* Pre-order walk with an explicit stack. Pushing a node's next sibling
+     * before descending means each node is pushed exactly once. */
+    size_t top = 0;
+    if (first_root != -1) {
+        stack[top++] = first_root;
+        tree->depth[first_root] = 0;
+    }
+    while (top > 0) {
+        int node = stack[--top];
+        tree->order[tree->norder++] = node;
+
+        int sibling = tree->next_sibling[node];
+        if (sibling != -1) {
+            tree->depth[sibling] = tree->depth[node];
+            stack[top++] = sibling;
+        }
+        int child = tree->first_child[node];
+        if (child != -1) {
+            tree->depth[child] = tree->depth[node] + 1;
+            stack[top++] = child;
+        }
+    }
+
+    /* Children always follow their parent in pre-order, so visiting the
+     * order backwards completes every subtree before it is added upward. */
+    for (size_t i = 0; i < n; ++i) {
+        tree->sub_threads[i] = tasks[i].threads > 0 ? tasks[i].threads : 0;
+        tree->sub_ticks[i] = tasks[i].utime + tasks[i].stime;
+        tree->sub_rss_kb[i] = tasks[i].rss_kb > 0 ? tasks[i].rss_kb : 0;
+    }
+    for (size_t k = tree->norder; k-- > 0; ) {
+        int node = tree->order[k];
+        int p = parent[node];
+        if (p != -1) {
+            tree->sub_threads[p] += tree->sub_threads[node];
+            tree->sub_ticks[p] += tree->sub_ticks[node];
+            tree->sub_rss_kb[p] += tree->sub_rss_kb[node];
+        }
+    }
+
+    free(parent);
+    free(stack);
+    return 0;
+}
+
+void task_tree_free(struct task_tree *tree)
+{
+    free(tree->first_child);
+    free(tree->next_sibling);
+    free(tree->order);
+    free(tree->depth);
+    free(tree->sub_threads);
+    free(tree->sub_ticks);
+    free(tree->sub_rss_kb);
+    memset(tree, 0, sizeof(*tree));
+}
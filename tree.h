@@ -0,0 +1,78 @@
+/**
+ * @file
+ *
+ * Process tree built from the PPid of every task in a scan. Construction is
+ * linear in the number of tasks: parents are found through a PID-to-index
+ * hash table, children are linked through first-child/next-sibling arrays,
+ * and subtree totals are accumulated in a single pass over the nodes in
+ * reverse pre-order (children before parents), without recursion.
+ */
+
+#ifndef _TREE_H_
+#define _TREE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "tasks.h"
+
+/**
+ * Open-addressing hash table from PID to the index of a task in an array.
+ * Slots hold index + 1 so that a zeroed table is empty.
+ */
+struct pid_index {
+    uint32_t *slots;
+    size_t mask;
+};
+
+/**
+ * The forest over an array of tasks. All arrays are indexed by position in
+ * that array; -1 marks the absence of a node.
+ */
+struct task_tree {
+    size_t n;
+    int *first_child;
+    int *next_sibling;
+
+    /* Pre-order traversal of the forest and the depth of each entry */
+    int *order;
+    int *depth;
+    size_t norder;
+
+    /* Totals over each task and all of its descendants */
+    long long *sub_threads;
+    unsigned long long *sub_ticks;
+    long long *sub_rss_kb;
+};
+
+/**
+ * Builds the forest for tasks[0..n). Tasks whose parent is not in the array
+ * (e.g., PID 1, kernel threads, or parents removed by a filter) are roots.
+ * Returns 0 on success or -1 if out of memory.
+ */
+int task_tree_build(const struct task *tasks, size_t n,
+        struct task_tree *tree);
+
+/**
+ * Frees the arrays held by a tree.
+ */
+void task_tree_free(struct task_tree *tree);
+
+/**
+ * Indexes tasks[0..n) by PID. Returns 0 on success or -1 if out of memory.
+ */
+int pid_index_build(struct pid_index *idx, const struct task *tasks,
+        size_t n);
+
+/**
+ * Returns the index of the task with the given PID, or -1 if there is none.
+ */
+int pid_index_find(const struct pid_index *idx, const struct task *tasks,
+        int pid);
+
+/**
+ * Frees the table of an index.
+ */
+void pid_index_free(struct pid_index *idx);
+
+#endif
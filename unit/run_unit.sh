@@ -0,0 +1,27 @@
+#!/usr/bin/env bash
+# Runs the unit test programs against the fixtures in unit/fixtures and a
+# synthetic procfs tree from bench/mkprocfs. Usage: unit/run_unit.sh <tests...>
+
+root="$(cd "$(dirname "$0")/.." && pwd)"
+mkprocfs="${root}/bench/mkprocfs"
+work="$(mktemp -d "${TMPDIR:-/tmp}/inspector-unit.XXXXXX")"
+tasks=300 # UNIT_TASKS in unit.h
+
+trap 'chmod -R u+w "${work}"; rm -rf "${work}"' EXIT
+
+tree="${work}/proc"
+"${mkprocfs}" "${tree}" "${tasks}" || exit 1
+
+cd "${root}" || exit 1
+failed=0
+for test in "$@"; do
+    if ! "./${test}" "${tree}"; then
+        echo "${test} FAILED"
+        failed=$((failed + 1))
+    fi
+done
+
+if [[ ${failed} -gt 0 ]]; then
+    echo "${failed} of $# unit tests failed"
+    exit 1
+fi
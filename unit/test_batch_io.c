@@ -0,0 +1,108 @@
+/**
+ * @file
+ *
+ * Tests for batch_io.c: both backends must produce the same results for
+ * whole-file reads, reads that fill the buffer, missing files, and owner
+ * lookups, including when a context is reused for several batches.
+ */
+
+#include <errno.h>
+#include <sys/stat.h>
+
+#include "batch_io.h"
+#include "unit.h"
+
+#define NREQS 5
+
+/**
+ * Reads the whole of a fixture file with plain stdio for comparison.
+ */
+static size_t slurp(const char *path, char *buf, size_t sz)
+{
+    FILE *f = fopen(path, "r");
+    if (f == NULL) {
+        perror(path);
+        exit(1);
+    }
+    size_t len = fread(buf, 1, sz - 1, f);
+    buf[len] = '\0';
+    fclose(f);
+    return len;
+}
+
+/**
+ * Submits the same requests through a context twice and checks the results
+ * against the files.
+ */
+static void check_backend(enum io_backend backend, int dir)
+{
+    static char short_buf[64], long_buf[8192], part_buf[100], none_buf[64];
+    static char want_short[64], want_long[8192];
+    size_t short_len = slurp("unit/fixtures/batch/short", want_short,
+            sizeof(want_short));
+    size_t long_len = slurp("unit/fixtures/batch/long", want_long,
+            sizeof(want_long));
+
+    struct stat st;
+    if (fstatat(dir, "short", &st, 0) == -1) {
+        perror("fstatat");
+        exit(1);
+    }
+
+    /* A depth below the number of reads makes the ring refill itself */
+    struct io_batch *batch = io_batch_create(backend, dir, 2);
+    CHECK(batch != NULL);
+    if (backend == IO_SYNC) {
+        CHECK_STR(io_batch_backend_name(batch), "sync");
+    }
+
+    for (int round = 0; round < 2; ++round) {
+        struct io_req reqs[NREQS] = {
+            { IO_REQ_READ, "short", short_buf, sizeof(short_buf), 0, 0 },
+            { IO_REQ_READ, "long", long_buf, sizeof(long_buf), 0, 0 },
+            { IO_REQ_READ, "long", part_buf, sizeof(part_buf), 0, 0 },
+            { IO_REQ_READ, "missing", none_buf, sizeof(none_buf), 0, 0 },
+            { IO_REQ_STAT, "short", NULL, 0, (uid_t) -1, 0 },
+        };
+        io_batch_submit(batch, reqs, NREQS);
+
+        CHECK_INT(reqs[0].result, short_len);
+        CHECK_STR(short_buf, want_short);
+
+        CHECK_INT(reqs[1].result, long_len);
+        CHECK_STR(long_buf, want_long);
+
+        /* Reads stop when the buffer is full and leave room for the NUL */
+        CHECK_INT(reqs[2].result, sizeof(part_buf) - 1);
+        CHECK_INT(strlen(part_buf), sizeof(part_buf) - 1);
+        CHECK(strncmp(part_buf, want_long, sizeof(part_buf) - 1) == 0);
+
+        CHECK_INT(reqs[3].result, -ENOENT);
+
+        CHECK_INT(reqs[4].result, 0);
+        CHECK_INT(reqs[4].uid, st.st_uid);
+    }
+
+    io_batch_destroy(batch);
+}
+
+int main(int argc, char *argv[])
+{
+    int dir = unit_open_dir("unit/fixtures/batch");
+
+    check_backend(IO_SYNC, dir);
+    check_backend(IO_URING, dir);
+    check_backend(IO_AUTO, dir);
+
+    enum io_backend backend;
+    CHECK_INT(io_backend_parse("sync", &backend), 0);
+    CHECK_INT(backend, IO_SYNC);
+    CHECK_INT(io_backend_parse("uring", &backend), 0);
+    CHECK_INT(backend, IO_URING);
+    CHECK_INT(io_backend_parse("auto", &backend), 0);
+    CHECK_INT(backend, IO_AUTO);
+    CHECK_INT(io_backend_parse("aio", &backend), -1);
+
+    close(dir);
+    return unit_report("test_batch_io");
+}
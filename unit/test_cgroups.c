@@ -0,0 +1,154 @@
+/**
+ * @file
+ *
+ * Tests for cgroups.c: parsing /proc/[pid]/cgroup into the PID cache, the
+ * aggregation of a fixture tree's tasks by cgroup with the counters of a
+ * fixture cgroupfs, and eviction of cgroups no task refers to any more.
+ */
+
+#include "cgroups.h"
+#include "unit.h"
+
+#define PROC_ROOT "unit/fixtures/cgroups/proc"
+#define CGROUP_ROOT "unit/fixtures/cgroups/sys"
+
+static void check_cache(void)
+{
+    /* The unified hierarchy line may follow v1 lines */
+    struct cgroup *a = cgroup_cache_store(100, 5000,
+            "12:pids:/a\n1:name=systemd:/a\n0::/system.slice/a.service\n");
+    if (CHECK(a != NULL)) {
+        CHECK_STR(a->path, "/system.slice/a.service");
+        CHECK_INT(a->usage_usec, -1);
+        CHECK_INT(a->memory_bytes, -1);
+    }
+    CHECK(cgroup_cache_store(101, 6000, "0::/system.slice/a.service") == a);
+    CHECK(cgroup_cache_store(102, 7000, "4:memory:/legacy\n") == NULL);
+    CHECK(cgroup_cache_store(103, 8000, "") == NULL);
+
+    struct cgroup *root = cgroup_cache_store(104, 9000, "0::/\n");
+    if (CHECK(root != NULL)) {
+        CHECK_STR(root->path, "/");
+    }
+
+    CHECK(cgroup_cache_lookup(100, 5000) == a);
+    CHECK(cgroup_cache_lookup(101, 6000) == a);
+    CHECK(cgroup_cache_lookup(104, 9000) == root);
+
+    /* A reused PID has a different start time and must be read again */
+    CHECK(cgroup_cache_lookup(100, 5001) == NULL);
+    CHECK(cgroup_cache_lookup(102, 7000) == NULL);
+    CHECK(cgroup_cache_lookup(105, 0) == NULL);
+
+    /* Storing a PID again replaces its entry */
+    struct cgroup *b = cgroup_cache_store(100, 5001, "0::/user.slice\n");
+    CHECK(b != NULL && b != a);
+    CHECK(cgroup_cache_lookup(100, 5001) == b);
+    CHECK(cgroup_cache_lookup(100, 5000) == NULL);
+
+    cgroup_cache_free();
+    CHECK(cgroup_cache_lookup(101, 6000) == NULL);
+}
+
+/**
+ * Checks the members and counters of one cgroup of a sample.
+ */
+static void check_group(const struct cgroup *cg, const char *path,
+        size_t tasks, long long threads, long long usage_usec,
+        long long memory_bytes, long long rbytes, long long wbytes)
+{
+    CHECK_STR(cg->path, path);
+    CHECK_INT(cg->tasks, tasks);
+    CHECK_INT(cg->threads, threads);
+    CHECK_INT(cg->usage_usec, usage_usec);
+    CHECK_INT(cg->memory_bytes, memory_bytes);
+    CHECK_INT(cg->rbytes, rbytes);
+    CHECK_INT(cg->wbytes, wbytes);
+}
+
+static void check_sample(enum io_backend backend)
+{
+    int root = unit_open_dir(PROC_ROOT);
+    struct task_filter filter;
+    task_filter_init(&filter);
+    struct cgroup_sample sample = { 0 };
+
+    CHECK_INT(cgroups_sample(&sample, root, CGROUP_ROOT, &filter, backend),
+            0);
+    CHECK_INT(sample.tasks, 5);
+
+    /* Sorted by path; task 5 is only in v1 hierarchies */
+    CHECK_INT(sample.n, 3);
+    if (sample.n == 3) {
+        check_group(sample.groups[0], "/init.scope", 1, 1, 1500000, -1, -1,
+                -1);
+        check_group(sample.groups[1], "/system.slice/a.service", 2, 6,
+                250000000, 104857600, 1048576 + 4096, 2097152 + 8192);
+        check_group(sample.groups[2], "/user.slice", 1, 3, 7000000,
+                52428800, -1, -1);
+        for (size_t i = 0; i < 3; ++i) {
+            CHECK(!sample.groups[i]->has_prev);
+        }
+    }
+
+    char *json;
+    size_t len;
+    FILE *out = open_memstream(&json, &len);
+    cgroups_print_json(out, &sample);
+    fclose(out);
+    CHECK_STR(json, "["
+            "{\"cgroup\":\"/init.scope\",\"tasks\":1,\"threads\":1,"
+            "\"cpu_pct\":null,\"memory_bytes\":null,"
+            "\"read_mb_per_sec\":null,\"write_mb_per_sec\":null},"
+            "{\"cgroup\":\"/system.slice/a.service\",\"tasks\":2,"
+            "\"threads\":6,\"cpu_pct\":null,\"memory_bytes\":104857600,"
+            "\"read_mb_per_sec\":null,\"write_mb_per_sec\":null},"
+            "{\"cgroup\":\"/user.slice\",\"tasks\":1,\"threads\":3,"
+            "\"cpu_pct\":null,\"memory_bytes\":52428800,"
+            "\"read_mb_per_sec\":null,\"write_mb_per_sec\":null}]");
+    free(json);
+
+    /* A cgroup that only a PID missing from the tree refers to */
+    struct cgroup *gone = cgroup_cache_store(999, 1, "0::/gone.scope\n");
+    struct cgroup *service = sample.groups[1];
+    CHECK(gone != NULL);
+    gone->tasks = 42;
+
+    /* The second sample has counters to compute rates from, and the members
+     * come from the cache rather than their cgroup files */
+    CHECK_INT(cgroups_sample(&sample, root, CGROUP_ROOT, &filter, backend),
+            0);
+    CHECK_INT(sample.n, 3);
+    CHECK(sample.groups[1] == service);
+    CHECK(service->has_prev);
+    CHECK_INT(service->prev_usage_usec, 250000000);
+    CHECK_INT(service->tasks, 2);
+
+    /* After two refresh periods the unused cgroup has been dropped, so
+     * interning its path again creates a new record */
+    for (int i = 0; i < 2 * CGROUP_REFRESH_SAMPLES; ++i) {
+        CHECK_INT(cgroups_sample(&sample, root, CGROUP_ROOT, &filter,
+                    backend), 0);
+    }
+    CHECK_INT(sample.n, 3);
+    CHECK(sample.groups[1] == service);
+    CHECK_INT(service->tasks, 2);
+    CHECK(cgroup_cache_lookup(999, 1) == NULL);
+    gone = cgroup_cache_store(999, 1, "0::/gone.scope\n");
+    if (CHECK(gone != NULL)) {
+        CHECK_INT(gone->tasks, 0);
+    }
+
+    cgroup_sample_free(&sample);
+    cgroup_cache_free();
+    task_filter_free(&filter);
+    close(root);
+}
+
+int main(int argc, char *argv[])
+{
+    check_cache();
+    check_sample(IO_SYNC);
+    check_sample(IO_URING);
+    return unit_report("test_cgroups");
+}
@@ -0,0 +1,92 @@
+/**
+ * @file
+ *
+ * Tests for the trace buffers in debug.c: events recorded on several threads,
+ * more than a ring holds, and with names too long for a line all come out
+ * as whole lines when stderr is read back.
+ */
+
+#include <pthread.h>
+
+#include "debug.h"
+#include "unit.h"
+
+/* More than a ring holds, so recording flushes along the way */
+#define NEVENTS 10000
+
+#define NTHREADS 3
+
+static char long_name[2048];
+
+static const struct trace_site short_site = {
+    "unit/test_debug.c", 1, "record", "short",
+};
+static const struct trace_site long_site = {
+    "unit/test_debug.c", 2, "record", long_name,
+};
+
+/**
+ * Records NEVENTS events, every tenth with the long name. The thread's ring
+ * is flushed when it exits.
+ */
+static void *record(void *arg)
+{
+    for (uint64_t i = 0; i < NEVENTS; ++i) {
+        trace_record(i % 10 == 0 ? &long_site : &short_site, i, 42);
+    }
+    return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+    memset(long_name, 'x', sizeof(long_name) - 1);
+
+    /* Send stderr to a file for the duration of the recording */
+    FILE *log = tmpfile();
+    int saved = dup(STDERR_FILENO);
+    if (log == NULL || saved == -1) {
+        perror("tmpfile");
+        return 1;
+    }
+    dup2(fileno(log), STDERR_FILENO);
+
+    pthread_t threads[NTHREADS];
+    for (int i = 0; i < NTHREADS; ++i) {
+        pthread_create(&threads[i], NULL, record, NULL);
+    }
+    record(NULL);
+    for (int i = 0; i < NTHREADS; ++i) {
+        pthread_join(threads[i], NULL);
+    }
+    trace_flush();
+
+    /* Nothing is left to write after a flush */
+    long end = lseek(STDERR_FILENO, 0, SEEK_CUR);
+    trace_flush();
+    CHECK_INT(lseek(STDERR_FILENO, 0, SEEK_CUR), end);
+
+    dup2(saved, STDERR_FILENO);
+    close(saved);
+
+    size_t lines = 0;
+    size_t bad = 0;
+    size_t truncated = 0;
+    char line[4096];
+    rewind(log);
+    while (fgets(line, sizeof(line), log) != NULL) {
+        size_t len = strlen(line);
+        lines++;
+        if (strncmp(line, "[trace] ", 8) != 0 || len > 511
+                || line[len - 1] != '\n') {
+            bad++;
+        } else if (strstr(line, " 42\n") == NULL) {
+            truncated++;
+        }
+    }
+    fclose(log);
+
+    CHECK_INT(lines, (NTHREADS + 1) * NEVENTS);
+    CHECK_INT(bad, 0);
+    CHECK_INT(truncated, (NTHREADS + 1) * NEVENTS / 10);
+    return unit_report("test_debug");
+}
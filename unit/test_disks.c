@@ -0,0 +1,145 @@
+/**
+ * @file
+ *
+ * Tests for disks.c: parsing diskstats, the default selection of whole,
+ * non-virtual disks (partitions are told apart by the kernel's naming rule),
+ * and the rates between two samples, which are unknown for counters that
+ * went backwards.
+ */
+
+#include "disks.h"
+#include "unit.h"
+
+static const char *names[] = {
+    "loop0", "sda", "sda1", "nvme0n1", "nvme0n1p1", "nvme0n10",
+    "nvme0n10p1", "dm-0", "ram0", "zram0",
+};
+
+#define NDISKS (sizeof(names) / sizeof(names[0]))
+
+/**
+ * Samples the fixture and checks which devices are shown: shown is a string
+ * with a '1' for each device of names[] that should be.
+ */
+static void check_selection(int root, const char *arg, const char *shown)
+{
+    struct disk_select sel;
+    disk_select_init(&sel, arg);
+    struct disk_sample sample = { 0 };
+    CHECK_INT(disks_sample(&sample, root, &sel), 0);
+    CHECK_INT(sample.n, NDISKS);
+    for (size_t i = 0; i < sample.n && i < NDISKS; ++i) {
+        CHECK_STR(sample.disks[i].name, names[i]);
+        if (!CHECK(sample.disks[i].shown == (shown[i] == '1'))) {
+            fprintf(stderr, "    device %s, selection %s\n", names[i],
+                    arg != NULL ? arg : "(default)");
+        }
+    }
+    disk_sample_free(&sample);
+}
+
+int main(int argc, char *argv[])
+{
+    int root = unit_open_dir("unit/fixtures/proc");
+    int later = unit_open_dir("unit/fixtures/proc-later");
+
+    /* nvme0n10 is a disk of its own, not a partition of nvme0n1 */
+    check_selection(root, NULL, "0101010100");
+    check_selection(root, "all", "1111111111");
+    check_selection(root, "sda1,loop0", "1010000000");
+
+    struct disk_select sel;
+    disk_select_init(&sel, NULL);
+    struct disk_sample prev = { 0 };
+    struct disk_sample cur = { 0 };
+    CHECK_INT(disks_sample(&prev, root, &sel), 0);
+    CHECK_INT(disks_sample(&cur, later, &sel), 0);
+
+    const struct disk_stat *sda = &cur.disks[1];
+    CHECK_INT(sda->rd_ios, 10200);
+    CHECK_INT(sda->rd_sectors, 820480);
+    CHECK_INT(sda->rd_ticks, 5300);
+    CHECK_INT(sda->wr_ios, 20400);
+    CHECK_INT(sda->wr_sectors, 1640960);
+    CHECK_INT(sda->wr_ticks, 15900);
+    CHECK_INT(sda->io_ticks, 10000);
+
+    /* Two seconds apart: 200 reads of 20480 sectors and 400 writes of 40960
+     * sectors, waiting 1200 ms in all, with the disk busy 1000 ms */
+    prev.time = (struct timespec) { 100, 0 };
+    cur.time = (struct timespec) { 102, 0 };
+    char *json;
+    size_t len;
+    FILE *out = open_memstream(&json, &len);
+    disks_print_json(out, &prev, &cur);
+    fclose(out);
+    CHECK_STR(json, "["
+            "{\"device\":\"sda\",\"reads_per_sec\":100.00,"
+            "\"writes_per_sec\":200.00,\"read_mb_per_sec\":5.243,"
+            "\"write_mb_per_sec\":10.486,\"await_ms\":2.00,"
+            "\"util_pct\":50.0},"
+            "{\"device\":\"nvme0n1\",\"reads_per_sec\":0.00,"
+            "\"writes_per_sec\":0.00,\"read_mb_per_sec\":0.000,"
+            "\"write_mb_per_sec\":0.000,\"await_ms\":0.00,"
+            "\"util_pct\":0.0},"
+            "{\"device\":\"nvme0n10\",\"reads_per_sec\":0.00,"
+            "\"writes_per_sec\":0.00,\"read_mb_per_sec\":0.000,"
+            "\"write_mb_per_sec\":0.000,\"await_ms\":0.00,"
+            "\"util_pct\":0.0},"
+            "{\"device\":\"dm-0\",\"reads_per_sec\":0.00,"
+            "\"writes_per_sec\":0.00,\"read_mb_per_sec\":0.000,"
+            "\"write_mb_per_sec\":0.000,\"await_ms\":0.00,"
+            "\"util_pct\":0.0}]");
+    free(json);
+
+    /* sda was removed and added again, and the write counters of nvme0n10
+     * were reset */
+    int reset = unit_open_dir("unit/fixtures/proc-reset");
+    CHECK_INT(disks_sample(&prev, reset, &sel), 0);
+    prev.time = (struct timespec) { 104, 0 };
+    out = open_memstream(&json, &len);
+    disks_print_json(out, &cur, &prev);
+    fclose(out);
+    CHECK_STR(json, "["
+            "{\"device\":\"sda\",\"reads_per_sec\":null,"
+            "\"writes_per_sec\":null,\"read_mb_per_sec\":null,"
+            "\"write_mb_per_sec\":null,\"await_ms\":null,"
+            "\"util_pct\":null},"
+            "{\"device\":\"nvme0n1\",\"reads_per_sec\":50.00,"
+            "\"writes_per_sec\":50.00,\"read_mb_per_sec\":2.048,"
+            "\"write_mb_per_sec\":2.048,\"await_ms\":1.00,"
+            "\"util_pct\":5.0},"
+            "{\"device\":\"nvme0n10\",\"reads_per_sec\":5.00,"
+            "\"writes_per_sec\":null,\"read_mb_per_sec\":0.205,"
+            "\"write_mb_per_sec\":null,\"await_ms\":null,"
+            "\"util_pct\":0.5},"
+            "{\"device\":\"dm-0\",\"reads_per_sec\":0.00,"
+            "\"writes_per_sec\":0.00,\"read_mb_per_sec\":0.000,"
+            "\"write_mb_per_sec\":0.000,\"await_ms\":0.00,"
+            "\"util_pct\":0.0}]");
+    free(json);
+
+    out = open_memstream(&json, &len);
+    CHECK_INT(disks_print(out, &cur, &prev), 6);
+    fclose(out);
+    CHECK(strstr(json, "sda              |       - |       - |       - "
+            "|       - |        - |      -\n") != NULL);
+    CHECK(strstr(json, "nvme0n10         |     5.0 |       - |    0.20 "
+            "|       - |        - |   0.5%\n") != NULL);
+    free(json);
+    close(reset);
+
+    disk_sample_free(&prev);
+    disk_sample_free(&cur);
+
+    /* A root without diskstats */
+    int empty = unit_open_dir("unit/fixtures/batch");
+    struct disk_sample none = { 0 };
+    CHECK_INT(disks_sample(&none, empty, &sel), -1);
+    disk_sample_free(&none);
+
+    close(empty);
+    close(later);
+    close(root);
+    return unit_report("test_disks");
+}
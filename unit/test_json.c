@@ -0,0 +1,72 @@
+/**
+ * @file
+ *
+ * Tests for the JSON output of batch mode: the helpers in json.c and task
+ * rows from columns_print_json(), whose numeric columns are unformatted.
+ */
+
+#include <math.h>
+
+#include "json.h"
+#include "tasks.h"
+#include "unit.h"
+
+/**
+ * Runs one of the helpers into a string and compares the output.
+ */
+#define CHECK_JSON(call, expected) do { \
+    char *text_; \
+    size_t len_; \
+    FILE *out = open_memstream(&text_, &len_); \
+    call; \
+    fclose(out); \
+    CHECK_STR(text_, expected); \
+    free(text_); \
+} while (0)
+
+int main(int argc, char *argv[])
+{
+    CHECK_JSON(json_string(out, "plain"), "\"plain\"");
+    CHECK_JSON(json_string(out, ""), "\"\"");
+    CHECK_JSON(json_string(out, "say \"hi\"\\"), "\"say \\\"hi\\\"\\\\\"");
+    CHECK_JSON(json_string(out, "tab\tnl\n\x01"),
+            "\"tab\\u0009nl\\u000a\\u0001\"");
+    CHECK_JSON(json_string(out, "caf\xc3\xa9"), "\"caf\xc3\xa9\"");
+
+    CHECK_JSON(json_number(out, 12.345), "12.35");
+    CHECK_JSON(json_number(out, 0), "0.00");
+    CHECK_JSON(json_number(out, -1), "null");
+    CHECK_JSON(json_number(out, NAN), "null");
+    CHECK_JSON(json_number(out, INFINITY), "null");
+    CHECK_JSON(json_number(out, 0.0 / 0.0), "null");
+    CHECK_JSON(json_int(out, 123456789012LL), "123456789012");
+    CHECK_JSON(json_int(out, 0), "0");
+    CHECK_JSON(json_int(out, -1), "null");
+
+    struct task task;
+    memset(&task, 0, sizeof(task));
+    task.pid = 42;
+    task.ppid = 1;
+    task.state = 'S';
+    snprintf(task.name, sizeof(task.name), "a \"quoted\"\tname");
+    task.threads = 3;
+    task.utime = 150;
+    task.stime = 50;
+    task.vsize_kb = -1;
+    task.rss_kb = 10332;
+    task.rates.wait_ms = 12.5;
+    task.rates.vcsw = -1;
+
+    /* Sizes in kB and CPU time in clock ticks rather than "10.1M" and
+     * "2.00"; text columns as in the task list */
+    const struct column *cols[MAX_COLUMNS];
+    int ncols = columns_parse("pid,name,state,tasks,cpu,rss,vsz,wait,vcsw",
+            cols);
+    struct uid_cache users = { 0 };
+    CHECK_JSON(columns_print_json(out, &users, cols, ncols, &task),
+            "{\"pid\":42,\"name\":\"a \\\"quoted\\\"\\u0009name\","
+            "\"state\":\"sleeping\",\"tasks\":3,\"cpu\":200,\"rss\":10332,"
+            "\"vsz\":null,\"wait\":12.50,\"vcsw\":null}");
+
+    return unit_report("test_json");
+}
@@ -0,0 +1,152 @@
+/**
+ * @file
+ *
+ * Tests for libinspector.c: the snapshot readers on a fixture procfs root,
+ * re-reading the files kept open by a context, and task scans through the
+ * context's scanner.
+ */
+
+#include <errno.h>
+
+#include "libinspector.h"
+#include "unit.h"
+
+static void check_snapshots(void)
+{
+    struct inspector *ins = inspector_open("unit/fixtures/proc", IO_SYNC);
+    if (!CHECK(ins != NULL)) {
+        return;
+    }
+    CHECK(inspector_root(ins) >= 0);
+    CHECK(inspector_users(ins) != NULL);
+
+    struct system_info sys;
+    CHECK_INT(inspector_system(ins, &sys), 0);
+    CHECK_STR(sys.hostname, "unit-host");
+    CHECK_STR(sys.kernel, "6.1.0-18-amd64");
+    CHECK_DBL(sys.uptime_sec, 350735.47, 1e-6);
+
+    struct cpu_info info;
+    CHECK_INT(inspector_cpu_info(ins, &info), 0);
+    CHECK_INT(info.units, 4);
+    CHECK_STR(info.model, "Intel(R) Core(TM) i7-8650U CPU @ 1.90GHz");
+
+    /* user through guest; guest_nice is already part of nice */
+    struct cpu_times times;
+    CHECK_INT(inspector_cpu_times(ins, &times), 0);
+    CHECK_INT(times.total, 60553557);
+    CHECK_INT(times.idle, 46828483);
+
+    struct memory_info mem;
+    CHECK_INT(inspector_memory(ins, &mem), 0);
+    CHECK_INT(mem.total_kb, 16318484);
+    CHECK_INT(mem.free_kb, 1203196);
+    CHECK_INT(mem.available_kb, 9514076);
+    CHECK_INT(mem.active_kb, 6022324);
+
+    struct load_avg load;
+    CHECK_INT(inspector_load(ins, &load), 0);
+    CHECK_DBL(load.avg[0], 0.52, 1e-9);
+    CHECK_DBL(load.avg[1], 0.58, 1e-9);
+    CHECK_DBL(load.avg[2], 0.59, 1e-9);
+
+    /* Reading again goes through the same descriptors */
+    CHECK_INT(inspector_cpu_times(ins, &times), 0);
+    CHECK_INT(times.total, 60553557);
+    CHECK_INT(inspector_load(ins, &load), 0);
+    CHECK_DBL(load.avg[2], 0.59, 1e-9);
+    inspector_close(ins);
+
+    struct cpu_times prev = { 100, 80 };
+    struct cpu_times cur = { 200, 130 };
+    CHECK_DBL(cpu_times_usage(&prev, &cur), 50, 1e-9);
+    CHECK_DBL(cpu_times_usage(&cur, &cur), 0, 0);
+}
+
+/**
+ * Writes a file in place, keeping its inode.
+ */
+static void rewrite(int dir, const char *name, const char *contents)
+{
+    int fd = openat(dir, name, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1 || write(fd, contents, strlen(contents)) == -1) {
+        perror(name);
+        exit(1);
+    }
+    close(fd);
+}
+
+static void check_reread(void)
+{
+    char path[] = "/tmp/inspector-unit-XXXXXX";
+    if (mkdtemp(path) == NULL) {
+        perror("mkdtemp");
+        exit(1);
+    }
+    int dir = unit_open_dir(path);
+    rewrite(dir, "loadavg", "1.00 2.00 3.00 1/100 1000\n");
+
+    struct inspector *ins = inspector_open(path, IO_SYNC);
+    struct load_avg load;
+    CHECK_INT(inspector_load(ins, &load), 0);
+    CHECK_DBL(load.avg[0], 1, 1e-9);
+
+    /* A shorter file must not leave the tail of the previous contents */
+    rewrite(dir, "loadavg", "4.5 5.5 6.5 1/9 9\n");
+    CHECK_INT(inspector_load(ins, &load), 0);
+    CHECK_DBL(load.avg[0], 4.5, 1e-9);
+    CHECK_DBL(load.avg[2], 6.5, 1e-9);
+
+    rewrite(dir, "loadavg", "garbage\n");
+    CHECK_INT(inspector_load(ins, &load), -1);
+    CHECK_INT(errno, EINVAL);
+
+    /* Files that do not exist below the root */
+    struct memory_info mem;
+    CHECK_INT(inspector_memory(ins, &mem), -1);
+    CHECK_INT(mem.total_kb, -1);
+    struct system_info sys;
+    CHECK_INT(inspector_system(ins, &sys), -1);
+    inspector_close(ins);
+
+    unlinkat(dir, "loadavg", 0);
+    close(dir);
+    rmdir(path);
+
+    CHECK(inspector_open("unit/fixtures/missing", IO_SYNC) == NULL);
+    CHECK_INT(errno, ENOENT);
+}
+
+static void check_tasks(const char *tree)
+{
+    struct inspector *ins = inspector_open(tree, IO_URING);
+    if (!CHECK(ins != NULL)) {
+        return;
+    }
+    struct task_filter filter;
+    task_filter_init(&filter);
+    for (int round = 0; round < 3; ++round) {
+        struct task *tasks;
+        size_t n = inspector_tasks(ins, SRC_STAT, &filter, &tasks);
+        CHECK_INT(n, UNIT_TASKS);
+        for (size_t i = 0; i < n; ++i) {
+            CHECK_INT(tasks[i].utime, tasks[i].pid % 97);
+        }
+        free(tasks);
+    }
+    task_filter_free(&filter);
+    inspector_close(ins);
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s <mkprocfs tree>\n", argv[0]);
+        return 1;
+    }
+
+    check_snapshots();
+    check_reread();
+    check_tasks(argv[1]);
+    return unit_report("test_libinspector");
+}
@@ -0,0 +1,111 @@
+/**
+ * @file
+ *
+ * Tests for net.c: parsing net/dev (including counters that abut the colon
+ * and lines that are not interfaces), selection by name, and the rates
+ * between two samples, which are unknown for counters that went backwards.
+ */
+
+#include "net.h"
+#include "unit.h"
+
+int main(int argc, char *argv[])
+{
+    int root = unit_open_dir("unit/fixtures/proc");
+    int later = unit_open_dir("unit/fixtures/proc-later");
+
+    struct net_select sel;
+    net_select_init(&sel, NULL);
+    struct net_sample prev = { 0 };
+    CHECK_INT(net_sample(&prev, root, &sel), 0);
+
+    /* The name that does not fit IF_NAMESIZE and the truncated line are
+     * skipped */
+    CHECK_INT(prev.n, 3);
+    CHECK_STR(prev.ifaces[0].name, "lo");
+    CHECK_STR(prev.ifaces[1].name, "eth0");
+    CHECK_INT(prev.ifaces[1].rx_bytes, 98765432);
+    CHECK_INT(prev.ifaces[1].rx_packets, 120000);
+    CHECK_INT(prev.ifaces[1].rx_errs, 3);
+    CHECK_INT(prev.ifaces[1].rx_drop, 17);
+    CHECK_INT(prev.ifaces[1].tx_bytes, 12345678);
+    CHECK_INT(prev.ifaces[1].tx_packets, 90000);
+    CHECK_STR(prev.ifaces[2].name, "eth1");
+    CHECK_INT(prev.ifaces[2].rx_bytes, 123456789012ULL);
+    CHECK_INT(prev.ifaces[2].tx_packets, 876543210);
+    for (size_t i = 0; i < prev.n; ++i) {
+        CHECK(prev.ifaces[i].shown);
+    }
+
+    net_select_init(&sel, "eth0,lo");
+    struct net_sample cur = { 0 };
+    CHECK_INT(net_sample(&cur, later, &sel), 0);
+    CHECK_INT(cur.n, 3);
+    CHECK(cur.ifaces[0].shown);
+    CHECK(cur.ifaces[1].shown);
+    CHECK(!cur.ifaces[2].shown);
+
+    /* Two seconds apart, eth0 received 4 MB in 3000 packets with 2 errors
+     * and 10 drops, and sent 1 MB in 1000 packets */
+    prev.time = (struct timespec) { 100, 0 };
+    cur.time = (struct timespec) { 102, 0 };
+    char *json;
+    size_t len;
+    FILE *out = open_memstream(&json, &len);
+    net_print_json(out, &prev, &cur);
+    fclose(out);
+    CHECK_STR(json, "["
+            "{\"interface\":\"lo\",\"rx_mb_per_sec\":0.000,"
+            "\"rx_packets_per_sec\":0.0,\"rx_drops_per_sec\":0.0,"
+            "\"rx_errors_per_sec\":0.0,\"tx_mb_per_sec\":0.000,"
+            "\"tx_packets_per_sec\":0.0,\"tx_drops_per_sec\":0.0,"
+            "\"tx_errors_per_sec\":0.0},"
+            "{\"interface\":\"eth0\",\"rx_mb_per_sec\":2.000,"
+            "\"rx_packets_per_sec\":1500.0,\"rx_drops_per_sec\":5.0,"
+            "\"rx_errors_per_sec\":1.0,\"tx_mb_per_sec\":0.500,"
+            "\"tx_packets_per_sec\":500.0,\"tx_drops_per_sec\":0.0,"
+            "\"tx_errors_per_sec\":0.0}]");
+    free(json);
+
+    /* eth0 was recreated and the transmit counters of eth1 were reset, so
+     * only their rates that still increase are known */
+    int reset = unit_open_dir("unit/fixtures/proc-reset");
+    net_select_init(&sel, NULL);
+    CHECK_INT(net_sample(&prev, reset, &sel), 0);
+    prev.time = (struct timespec) { 104, 0 };
+    out = open_memstream(&json, &len);
+    net_print_json(out, &cur, &prev);
+    fclose(out);
+    CHECK_STR(json, "["
+            "{\"interface\":\"lo\",\"rx_mb_per_sec\":0.001,"
+            "\"rx_packets_per_sec\":10.0,\"rx_drops_per_sec\":0.0,"
+            "\"rx_errors_per_sec\":0.0,\"tx_mb_per_sec\":0.001,"
+            "\"tx_packets_per_sec\":10.0,\"tx_drops_per_sec\":0.0,"
+            "\"tx_errors_per_sec\":0.0},"
+            "{\"interface\":\"eth0\",\"rx_mb_per_sec\":null,"
+            "\"rx_packets_per_sec\":null,\"rx_drops_per_sec\":null,"
+            "\"rx_errors_per_sec\":null,\"tx_mb_per_sec\":null,"
+            "\"tx_packets_per_sec\":null,\"tx_drops_per_sec\":0.0,"
+            "\"tx_errors_per_sec\":0.0},"
+            "{\"interface\":\"eth1\",\"rx_mb_per_sec\":1.000,"
+            "\"rx_packets_per_sec\":500.0,\"rx_drops_per_sec\":0.0,"
+            "\"rx_errors_per_sec\":0.0,\"tx_mb_per_sec\":null,"
+            "\"tx_packets_per_sec\":null,\"tx_drops_per_sec\":0.0,"
+            "\"tx_errors_per_sec\":0.0}]");
+    free(json);
+
+    out = open_memstream(&json, &len);
+    CHECK_INT(net_print(out, &cur, &prev), 5);
+    fclose(out);
+    CHECK(strstr(json, "eth0             |        - |         - |         - "
+            "|        - |        - |         - |       0.0 |      0.0\n")
+            != NULL);
+    free(json);
+
+    net_sample_free(&prev);
+    net_sample_free(&cur);
+    close(reset);
+    close(later);
+    close(root);
+    return unit_report("test_net");
+}
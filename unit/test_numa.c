@@ -0,0 +1,131 @@
+/**
+ * @file
+ *
+ * Tests for numa.c: the node directories, CPU lists, and per-node meminfo of
+ * a fixture sysfs, per-node CPU usage from two stat files, and the home node
+ * of tasks from their numa_maps.
+ */
+
+#include "numa.h"
+#include "tasks.h"
+#include "unit.h"
+
+#define SYSFS_ROOT "unit/fixtures/numa/sys"
+
+static void check_nodes(void)
+{
+    int root = unit_open_dir("unit/fixtures/numa/proc");
+    int later = unit_open_dir("unit/fixtures/numa/proc-later");
+
+    struct numa_sample prev = { 0 };
+    struct numa_sample cur = { 0 };
+    CHECK_INT(numa_sample(&prev, root, SYSFS_ROOT), 0);
+    CHECK_INT(numa_sample(&cur, later, SYSFS_ROOT), 0);
+
+    /* Only the nodeN entries are nodes */
+    CHECK_INT(prev.n, 3);
+    for (size_t i = 0; i < prev.n; ++i) {
+        CHECK_INT(prev.nodes[i].id, i);
+    }
+
+    /* CPU lists with ranges, and CPUs beyond the initial map size */
+    CHECK_INT(prev.nodes[0].ncpus, 4);
+    CHECK_INT(prev.nodes[1].ncpus, 6);
+    CHECK_INT(prev.nodes[2].ncpus, 0);
+    CHECK(prev.ncpus > 65);
+    static const int cpu_node[] = { 0, 0, 1, 1, 0, 0, 1, 1, -1 };
+    for (int cpu = 0; cpu < 9; ++cpu) {
+        CHECK_INT(prev.cpu_node[cpu], cpu_node[cpu]);
+    }
+    CHECK_INT(prev.cpu_node[63], -1);
+    CHECK_INT(prev.cpu_node[64], 1);
+    CHECK_INT(prev.cpu_node[65], 1);
+
+    CHECK_INT(prev.nodes[0].mem_total_kb, 8000000);
+    CHECK_INT(prev.nodes[0].mem_free_kb, 2000000);
+    CHECK_INT(prev.nodes[0].mem_used_kb, 6000000);
+    CHECK_INT(prev.nodes[2].mem_used_kb, 0);
+
+    /* Per-CPU lines are added to their node: user through guest */
+    CHECK_INT(prev.nodes[0].cpu_total, 4 * 1000);
+    CHECK_INT(prev.nodes[0].cpu_idle, 4 * 800);
+    CHECK_INT(prev.nodes[1].cpu_total, 6 * 1000);
+    CHECK_INT(prev.nodes[2].cpu_total, 0);
+
+    char *json;
+    size_t len;
+    FILE *out = open_memstream(&json, &len);
+    numa_print_json(out, &prev, &cur);
+    fclose(out);
+    CHECK_STR(json, "["
+            "{\"node\":0,\"cpus\":4,\"cpu_pct\":25.00,"
+            "\"mem_used_kb\":6000000,\"mem_free_kb\":2000000,"
+            "\"mem_total_kb\":8000000},"
+            "{\"node\":1,\"cpus\":6,\"cpu_pct\":50.00,"
+            "\"mem_used_kb\":4000000,\"mem_free_kb\":12000000,"
+            "\"mem_total_kb\":16000000},"
+            "{\"node\":2,\"cpus\":0,\"cpu_pct\":null,"
+            "\"mem_used_kb\":0,\"mem_free_kb\":1048576,"
+            "\"mem_total_kb\":1048576}]");
+    free(json);
+
+    /* A CPU of node 0 went offline, so its idle time dropped, and node 1
+     * lost one altogether */
+    cur.nodes[0].cpu_idle = prev.nodes[0].cpu_idle - 800;
+    cur.nodes[1].cpu_total = prev.nodes[1].cpu_total - 1000;
+    out = open_memstream(&json, &len);
+    numa_print_json(out, &prev, &cur);
+    fclose(out);
+    CHECK(strstr(json, "{\"node\":0,\"cpus\":4,\"cpu_pct\":null,") != NULL);
+    CHECK(strstr(json, "{\"node\":1,\"cpus\":6,\"cpu_pct\":null,") != NULL);
+    free(json);
+
+    /* A machine without the node directory */
+    struct numa_sample none = { 0 };
+    CHECK_INT(numa_sample(&none, root, "unit/fixtures/batch"), -1);
+    numa_sample_free(&none);
+
+    numa_sample_free(&prev);
+    numa_sample_free(&cur);
+    close(later);
+    close(root);
+}
+
+static void check_home_node(void)
+{
+    /* Pages are weighted by their size: one 2 MB page outweighs many 4 kB
+     * ones on another node */
+    char maps[] =
+        "0 default anon=5 N0=5 kernelpagesize_kB=4\n"
+        "1 default anon=100 N1=100 kernelpagesize_kB=4\n";
+    CHECK_INT(numa_home_node(maps), 1);
+    char huge[] =
+        "0 default anon=1 N0=1 kernelpagesize_kB=2048\n"
+        "1 default anon=100 N1=100 kernelpagesize_kB=4\n";
+    CHECK_INT(numa_home_node(huge), 0);
+    char none[] = "0 default\n";
+    CHECK_INT(numa_home_node(none), -1);
+    char beyond[] = "0 default anon=9 N64=9 N3=1 kernelpagesize_kB=4";
+    CHECK_INT(numa_home_node(beyond), 3);
+
+    int root = unit_open_dir("unit/fixtures/numa/proc");
+    struct task_filter filter;
+    task_filter_init(&filter);
+    struct task *tasks;
+    size_t n = tasks_scan(root, SRC_NUMA, &filter, IO_SYNC, &tasks);
+    CHECK_INT(n, 3);
+    for (size_t i = 0; i < n; ++i) {
+        static const int home[] = { 0, 0, 1, -1 };
+        CHECK_INT(tasks[i].node, home[tasks[i].pid]);
+    }
+    free(tasks);
+    task_filter_free(&filter);
+    close(root);
+}
+
+int main(int argc, char *argv[])
+{
+    check_nodes();
+    check_home_node();
+    return unit_report("test_numa");
+}
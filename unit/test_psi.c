@@ -0,0 +1,74 @@
+/**
+ * @file
+ *
+ * Tests for psi.c: parsing the pressure files (CPU has no "full" line on
+ * older kernels) and the stall percentages between two samples.
+ */
+
+#include "psi.h"
+#include "unit.h"
+
+int main(int argc, char *argv[])
+{
+    int root = unit_open_dir("unit/fixtures/proc");
+    int later = unit_open_dir("unit/fixtures/proc-later");
+
+    struct psi_sample prev = { 0 };
+    struct psi_sample cur = { 0 };
+    CHECK_INT(psi_sample(&prev, root), 0);
+    CHECK_INT(psi_sample(&cur, later), 0);
+
+    CHECK(prev.some[PSI_CPU].valid);
+    CHECK(!prev.full[PSI_CPU].valid);
+    CHECK_DBL(prev.some[PSI_CPU].avg10, 1.5, 1e-9);
+    CHECK_DBL(prev.some[PSI_CPU].avg60, 0.75, 1e-9);
+    CHECK_DBL(prev.some[PSI_CPU].avg300, 0.2, 1e-9);
+    CHECK_INT(prev.some[PSI_CPU].total, 12000000);
+    CHECK(prev.full[PSI_MEMORY].valid);
+    CHECK_INT(prev.full[PSI_MEMORY].total, 1000000);
+    CHECK_DBL(prev.full[PSI_IO].avg10, 2.1, 1e-9);
+    CHECK_INT(prev.full[PSI_IO].total, 45000000);
+
+    /* Two seconds apart. Stall time beyond the interval is capped, and a
+     * counter that went backwards gives no rate. */
+    prev.time = (struct timespec) { 100, 0 };
+    cur.time = (struct timespec) { 102, 0 };
+    CHECK_DBL(psi_stall_pct(&prev, &cur, PSI_CPU, false), 25, 1e-9);
+    CHECK_DBL(psi_stall_pct(&prev, &cur, PSI_CPU, true), -1, 0);
+    CHECK_DBL(psi_stall_pct(&prev, &cur, PSI_MEMORY, false), 100, 1e-9);
+    CHECK_DBL(psi_stall_pct(&prev, &cur, PSI_MEMORY, true), 100, 1e-9);
+    CHECK_DBL(psi_stall_pct(&prev, &cur, PSI_IO, false), 5, 1e-9);
+    CHECK_DBL(psi_stall_pct(&prev, &cur, PSI_IO, true), -1, 0);
+
+    char *json;
+    size_t len;
+    FILE *out = open_memstream(&json, &len);
+    psi_print_json(out, &prev, &cur);
+    fclose(out);
+    CHECK_STR(json, "{"
+            "\"cpu\":{\"some\":{\"avg10\":2.50,\"avg60\":1.00,"
+            "\"avg300\":0.30,\"stalled_pct\":25.00},\"full\":null},"
+            "\"memory\":{\"some\":{\"avg10\":90.00,\"avg60\":40.00,"
+            "\"avg300\":10.00,\"stalled_pct\":100.00},"
+            "\"full\":{\"avg10\":95.00,\"avg60\":45.00,\"avg300\":12.00,"
+            "\"stalled_pct\":100.00}},"
+            "\"io\":{\"some\":{\"avg10\":4.30,\"avg60\":3.20,"
+            "\"avg300\":2.10,\"stalled_pct\":5.00},"
+            "\"full\":{\"avg10\":0.00,\"avg60\":0.00,\"avg300\":0.00,"
+            "\"stalled_pct\":null}}}");
+    free(json);
+
+    /* Without PSI support there is no pressure directory */
+    int empty = unit_open_dir("unit/fixtures/batch");
+    struct psi_sample none = { 0 };
+    CHECK_INT(psi_sample(&none, empty), -1);
+    CHECK(!none.some[PSI_CPU].valid);
+    psi_sample_free(&none);
+
+    psi_sample_free(&prev);
+    psi_sample_free(&cur);
+    close(empty);
+    close(later);
+    close(root);
+    return unit_report("test_psi");
+}
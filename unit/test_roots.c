@@ -0,0 +1,139 @@
+/**
+ * @file
+ *
+ * Tests for inspecting several procfs roots at once: threads working on
+ * different roots through their own directory fds get the same results as a
+ * lone scan, and each thread has its own cgroup cache.
+ */
+
+#include <pthread.h>
+
+#include "cgroups.h"
+#include "tasks.h"
+#include "unit.h"
+
+#define NTHREADS 4
+
+/**
+ * The work of one thread: even threads scan the generated tree, odd ones
+ * sample the cgroups of the cgroup fixture.
+ */
+struct job {
+    int id;
+    const char *tree;
+    enum io_backend backend;
+    bool scans_ok;
+    bool cgroups_ok;
+    bool cache_ok;
+};
+
+static pthread_barrier_t barrier;
+
+/**
+ * Returns true if a scan of the generated tree found every task with the
+ * values its files hold.
+ */
+static bool scan_tree(int root, enum io_backend backend)
+{
+    struct task_filter filter;
+    task_filter_init(&filter);
+    struct task *tasks;
+    size_t n = tasks_scan(root, SRC_STAT | SRC_STATUS, &filter, backend,
+            &tasks);
+
+    bool ok = n == UNIT_TASKS;
+    for (size_t i = 0; i < n; ++i) {
+        char name[32];
+        snprintf(name, sizeof(name), "worker-%d", tasks[i].pid);
+        if (strcmp(tasks[i].name, name) != 0
+                || tasks[i].vcsw != tasks[i].pid * 3) {
+            ok = false;
+        }
+    }
+    free(tasks);
+    task_filter_free(&filter);
+    return ok;
+}
+
+/**
+ * Returns true if a cgroup sample of the fixture has its three cgroups.
+ */
+static bool sample_cgroups(int root, struct cgroup_sample *sample,
+        enum io_backend backend)
+{
+    struct task_filter filter;
+    task_filter_init(&filter);
+    bool ok = cgroups_sample(sample, root, "unit/fixtures/cgroups/sys",
+            &filter, backend) == 0 && sample->n == 3 && sample->tasks == 5;
+    task_filter_free(&filter);
+    return ok;
+}
+
+static void *run_job(void *arg)
+{
+    struct job *job = arg;
+    bool tree = job->id % 2 == 0;
+    int root = open(tree ? job->tree : "unit/fixtures/cgroups/proc",
+            O_RDONLY | O_DIRECTORY);
+    struct cgroup_sample sample = { 0 };
+
+    job->scans_ok = root != -1;
+    job->cgroups_ok = root != -1;
+    for (int round = 0; round < 5 && root != -1; ++round) {
+        if (tree) {
+            job->scans_ok &= scan_tree(root, job->backend);
+        } else {
+            job->cgroups_ok &= sample_cgroups(root, &sample, job->backend);
+        }
+    }
+
+    /* Every thread caches a PID of its own, then looks for the others' */
+    char line[32];
+    snprintf(line, sizeof(line), "0::/thread-%d\n", job->id);
+    struct cgroup *mine = cgroup_cache_store(10000 + job->id, 1, line);
+    pthread_barrier_wait(&barrier);
+
+    job->cache_ok = mine != NULL
+        && cgroup_cache_lookup(10000 + job->id, 1) == mine;
+    for (int i = 0; i < NTHREADS; ++i) {
+        if (i != job->id && cgroup_cache_lookup(10000 + i, 1) != NULL) {
+            job->cache_ok = false;
+        }
+    }
+
+    cgroup_sample_free(&sample);
+    cgroup_cache_free();
+    if (root != -1) {
+        close(root);
+    }
+    return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s <mkprocfs tree>\n", argv[0]);
+        return 1;
+    }
+
+    struct job jobs[NTHREADS];
+    pthread_t threads[NTHREADS];
+    pthread_barrier_init(&barrier, NULL, NTHREADS);
+    for (int i = 0; i < NTHREADS; ++i) {
+        jobs[i] = (struct job) {
+            .id = i,
+            .tree = argv[1],
+            .backend = i % 4 < 2 ? IO_SYNC : IO_URING,
+        };
+        CHECK_INT(pthread_create(&threads[i], NULL, run_job, &jobs[i]), 0);
+    }
+    for (int i = 0; i < NTHREADS; ++i) {
+        pthread_join(threads[i], NULL);
+        CHECK(jobs[i].scans_ok);
+        CHECK(jobs[i].cgroups_ok);
+        CHECK(jobs[i].cache_ok);
+    }
+    pthread_barrier_destroy(&barrier);
+
+    return unit_report("test_roots");
+}
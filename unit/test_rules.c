@@ -0,0 +1,191 @@
+/**
+ * @file
+ *
+ * Tests for rules.c: the rule file grammar (metrics, selectors, operators,
+ * suffixes, durations, and comments), rejection of malformed rules, and when
+ * plain and windowed rules start and stop firing.
+ */
+
+#include "rules.h"
+#include "unit.h"
+
+#define RULES_DIR "unit/fixtures/rules"
+
+/* Number of rules in watch.rules */
+#define NRULES 7
+
+static const char *bad_files[] = {
+    "unknown-metric", "selector-on-cpu", "selector-key", "selector-state",
+    "selector-unclosed", "no-operator", "no-threshold", "zero-duration",
+    "duration-unit", "trailing-text", "late-error",
+};
+
+static void check_grammar(void)
+{
+    struct rule_set *rules = rules_load(RULES_DIR "/watch.rules", 1000);
+    if (!CHECK(rules != NULL)) {
+        return;
+    }
+    CHECK_INT(rules_count(rules), NRULES);
+    CHECK_INT(rules_metrics(rules), (1u << METRIC_CPU)
+            | (1u << METRIC_MEM_AVAILABLE) | (1u << METRIC_LOAD1)
+            | (1u << METRIC_TASKS) | (1u << METRIC_PSI_IO)
+            | (1u << METRIC_MEM_PCT));
+    CHECK_INT(rules_task_sources(rules), SRC_STAT);
+    rules_free(rules);
+
+    for (size_t i = 0; i < sizeof(bad_files) / sizeof(bad_files[0]); ++i) {
+        char path[128];
+        snprintf(path, sizeof(path), RULES_DIR "/bad/%s.rules",
+                bad_files[i]);
+        rules = rules_load(path, 1000);
+        if (!CHECK(rules == NULL)) {
+            fprintf(stderr, "    %s was accepted\n", path);
+            rules_free(rules);
+        }
+    }
+    CHECK(rules_load(RULES_DIR "/missing.rules", 1000) == NULL);
+}
+
+/**
+ * Evaluates the rules on a sample taken at 'sec' seconds and returns the
+ * events as JSON lines, which the caller frees.
+ */
+static char *eval_at(struct rule_set *rules, struct rule_input *in,
+        double sec, int *changed)
+{
+    in->time.tv_sec = (time_t) sec;
+    in->time.tv_nsec = (long) ((sec - (time_t) sec) * 1e9);
+    *changed = rules_eval(rules, in);
+
+    char *json;
+    size_t len;
+    FILE *out = open_memstream(&json, &len);
+    rules_print_events_json(out, rules, &in->time);
+    fclose(out);
+    return json;
+}
+
+/**
+ * Evaluates a sample and checks the events it produced.
+ */
+#define CHECK_EVAL(sec, nchanged, expected) do { \
+    int changed_; \
+    char *json_ = eval_at(rules, &in, sec, &changed_); \
+    CHECK_INT(changed_, nchanged); \
+    CHECK_STR(json_, expected); \
+    free(json_); \
+} while (0)
+
+static void check_windows(void)
+{
+    struct rule_set *rules = rules_load(RULES_DIR "/watch.rules", 1000);
+    if (!CHECK(rules != NULL)) {
+        return;
+    }
+
+    /* Three tasks in D state, and one whose name has a '#' in it */
+    struct task tasks[5];
+    static const char states[] = "DDDRS";
+    for (int i = 0; i < 5; ++i) {
+        memset(&tasks[i], 0, sizeof(tasks[i]));
+        tasks[i].pid = i + 1;
+        tasks[i].state = states[i];
+        snprintf(tasks[i].name, sizeof(tasks[i].name), "worker-%d", i);
+    }
+    snprintf(tasks[3].name, sizeof(tasks[3].name), "worker-#3");
+
+    struct rule_input in = { .tasks = tasks, .ntasks = 5 };
+    for (int m = 0; m < RULE_METRICS; ++m) {
+        in.values[m] = -1;
+    }
+    in.values[METRIC_CPU] = 95;
+    in.values[METRIC_MEM_AVAILABLE] = 1024.0 * 1024 * 1024;
+    in.values[METRIC_LOAD1] = 4;
+    in.values[METRIC_PSI_IO] = 0;
+    in.values[METRIC_MEM_PCT] = 40;
+
+    /* Rules without a window fire on the first sample that meets them */
+    CHECK_EVAL(100, 5,
+            "{\"time\":100.000,\"event\":\"firing\",\"rule\":"
+            "\"mem_available < 2G\",\"metric\":\"mem_available\","
+            "\"value\":1073741824.00}\n"
+            "{\"time\":100.000,\"event\":\"firing\",\"rule\":"
+            "\"load1 >= 4\",\"metric\":\"load1\",\"value\":4.00}\n"
+            "{\"time\":100.000,\"event\":\"firing\",\"rule\":"
+            "\"tasks{state=D} > 2\",\"metric\":\"tasks\",\"value\":3.00}\n"
+            "{\"time\":100.000,\"event\":\"firing\",\"rule\":"
+            "\"tasks{name=^worker-#[0-9]+$,state=RS} != 0\","
+            "\"metric\":\"tasks\",\"value\":1.00}\n"
+            "{\"time\":100.000,\"event\":\"firing\",\"rule\":"
+            "\"psi_io == 0\",\"metric\":\"psi_io\",\"value\":0.00}\n");
+
+    in.values[METRIC_LOAD1] = 3.99;
+    CHECK_EVAL(101, 1,
+            "{\"time\":101.000,\"event\":\"resolved\",\"rule\":"
+            "\"load1 >= 4\",\"metric\":\"load1\",\"value\":3.99}\n");
+
+    /* mem_pct <= 50% for 1500ms holds from 100 s to 102 s */
+    CHECK_EVAL(102, 1,
+            "{\"time\":102.000,\"event\":\"firing\",\"rule\":"
+            "\"mem_pct <= 50% for 1500ms\",\"metric\":\"mem_pct\","
+            "\"value\":40.00}\n");
+
+    /* cpu > 90 for 3s has held in every sample from 100 s to 103 s */
+    CHECK_EVAL(103, 1,
+            "{\"time\":103.000,\"event\":\"firing\",\"rule\":"
+            "\"cpu > 90 for 3s\",\"metric\":\"cpu\",\"value\":95.00}\n");
+
+    /* One sample below the threshold resolves it, and it only fires again
+     * once a full window has passed without another */
+    in.values[METRIC_CPU] = 50;
+    CHECK_EVAL(104, 1,
+            "{\"time\":104.000,\"event\":\"resolved\",\"rule\":"
+            "\"cpu > 90 for 3s\",\"metric\":\"cpu\",\"value\":50.00}\n");
+    in.values[METRIC_CPU] = 99;
+    CHECK_EVAL(105, 0, "");
+    CHECK_EVAL(106, 0, "");
+    CHECK_EVAL(107, 0, "");
+    CHECK_EVAL(108, 1,
+            "{\"time\":108.000,\"event\":\"firing\",\"rule\":"
+            "\"cpu > 90 for 3s\",\"metric\":\"cpu\",\"value\":99.00}\n");
+
+    /* Missed samples do not reset a window whose samples all held, and an
+     * unmeasured value neither fires nor resolves */
+    CHECK_EVAL(120, 0, "");
+    in.values[METRIC_CPU] = -1;
+    in.values[METRIC_MEM_PCT] = -1;
+    in.values[METRIC_MEM_AVAILABLE] = -1;
+    CHECK_EVAL(121, 0, "");
+
+    /* A task leaving D state resolves the count rule, then the '#' task
+     * goes to sleep in a state the selector still accepts */
+    tasks[0].state = 'S';
+    tasks[3].state = 'S';
+    CHECK_EVAL(122, 1,
+            "{\"time\":122.000,\"event\":\"resolved\",\"rule\":"
+            "\"tasks{state=D} > 2\",\"metric\":\"tasks\",\"value\":2.00}\n");
+
+    /* A windowed rule that misses at 122.5 s must wait a full window */
+    in.values[METRIC_MEM_PCT] = 60;
+    CHECK_EVAL(122.5, 1,
+            "{\"time\":122.500,\"event\":\"resolved\",\"rule\":"
+            "\"mem_pct <= 50% for 1500ms\",\"metric\":\"mem_pct\","
+            "\"value\":60.00}\n");
+    in.values[METRIC_MEM_PCT] = 10;
+    CHECK_EVAL(123.5, 0, "");
+    CHECK_EVAL(124.5, 0, "");
+    CHECK_EVAL(125.5, 1,
+            "{\"time\":125.500,\"event\":\"firing\",\"rule\":"
+            "\"mem_pct <= 50% for 1500ms\",\"metric\":\"mem_pct\","
+            "\"value\":10.00}\n");
+
+    rules_free(rules);
+}
+
+int main(int argc, char *argv[])
+{
+    check_grammar();
+    check_windows();
+    return unit_report("test_rules");
+}
@@ -0,0 +1,231 @@
+/**
+ * @file
+ *
+ * Tests for sched.c: selection of the top waiters with the bounded heap,
+ * joining two scans for rates, including reused PIDs and new tasks, and the
+ * summary when the kernel provides no schedstat.
+ */
+
+#include "sched.h"
+#include "unit.h"
+
+#define NTASKS 12
+
+/**
+ * Sets up a task with the given PID and run queue wait rate.
+ */
+static void make_task(struct task *task, int pid, double wait_ms)
+{
+    memset(task, 0, sizeof(*task));
+    task->pid = pid;
+    snprintf(task->name, sizeof(task->name), "task-%d", pid);
+    task->rates.run_ms = -1;
+    task->rates.wait_ms = wait_ms;
+    task->rates.slices = -1;
+    task->rates.vcsw = -1;
+    task->rates.ivcsw = -1;
+}
+
+/**
+ * Checks that top holds the PIDs in expected, in order.
+ */
+static void check_top(const struct task *tasks, const size_t *top, size_t n,
+        const int *expected, size_t nexpected)
+{
+    if (!CHECK(n == nexpected)) {
+        return;
+    }
+    for (size_t i = 0; i < n; ++i) {
+        CHECK_INT(tasks[top[i]].pid, expected[i]);
+    }
+}
+
+static void check_top_waiters(void)
+{
+    /* Waits in no particular order, with ties, zeros, and tasks without a
+     * rate, which are never selected */
+    static const double waits[NTASKS] = {
+        3, -1, 7.5, 0, 12, 1, 7.5, 40, -1, 0.25, 20, 5,
+    };
+    struct task tasks[NTASKS];
+    for (int i = 0; i < NTASKS; ++i) {
+        make_task(&tasks[i], i + 1, waits[i]);
+    }
+    size_t top[NTASKS];
+
+    static const int top3[] = { 8, 11, 5 };
+    check_top(tasks, top, top_waiters(tasks, NTASKS, 3, top), top3, 3);
+
+    static const int top1[] = { 8 };
+    check_top(tasks, top, top_waiters(tasks, NTASKS, 1, top), top1, 1);
+    CHECK_INT(top_waiters(tasks, NTASKS, 0, top), 0);
+    CHECK_INT(top_waiters(tasks, 0, 3, top), 0);
+
+    /* Asking for more than have waited returns all of them, sorted */
+    size_t n = top_waiters(tasks, NTASKS, NTASKS, top);
+    if (CHECK(n == 9)) {
+        for (size_t i = 0; i < n; ++i) {
+            CHECK(tasks[top[i]].rates.wait_ms > 0);
+            if (i > 0) {
+                CHECK(tasks[top[i]].rates.wait_ms
+                        <= tasks[top[i - 1]].rates.wait_ms);
+            }
+        }
+        CHECK_INT(tasks[top[0]].pid, 8);
+        CHECK_INT(tasks[top[n - 1]].pid, 10);
+    }
+
+    /* Increasing and decreasing input, which exercise every heap path */
+    struct task many[100];
+    for (int i = 0; i < 100; ++i) {
+        make_task(&many[i], i + 1, i + 1);
+    }
+    static const int top4[] = { 100, 99, 98, 97 };
+    check_top(many, top, top_waiters(many, 100, 4, top), top4, 4);
+    for (int i = 0; i < 100; ++i) {
+        make_task(&many[i], i + 1, 100 - i);
+    }
+    static const int first4[] = { 1, 2, 3, 4 };
+    check_top(many, top, top_waiters(many, 100, 4, top), first4, 4);
+}
+
+/**
+ * Sets the scheduler counters of a task.
+ */
+static void set_counters(struct task *task, unsigned long long start_time,
+        long long run_ns, long long wait_ns, long long slices,
+        long long vcsw, long long ivcsw)
+{
+    task->start_time = start_time;
+    task->run_ns = run_ns;
+    task->wait_ns = wait_ns;
+    task->slices = slices;
+    task->vcsw = vcsw;
+    task->ivcsw = ivcsw;
+}
+
+static void check_rates(void)
+{
+    struct task before[3];
+    struct task after[4];
+    for (int i = 0; i < 3; ++i) {
+        make_task(&before[i], 10 + i, -1);
+    }
+    set_counters(&before[0], 500, 1000000000, 200000000, 100, 40, 4);
+    set_counters(&before[1], 600, 0, 0, 0, 0, 0);
+    set_counters(&before[2], 700, 5000000, 5000000, 5, 5, 5);
+
+    /* 10 is joined in a different order; 11 exited and its PID went to a
+     * new task; 12 exited; 20 and 21 are new, and 21 has no schedstat */
+    static const int pids[] = { 20, 11, 10, 21 };
+    for (int i = 0; i < 4; ++i) {
+        make_task(&after[i], pids[i], -1);
+    }
+    set_counters(&after[0], 900, 1000, 1000, 1, 1, 1);
+    set_counters(&after[1], 800, 9000000, 9000000, 9, 9, 9);
+    set_counters(&after[2], 500, 1500000000, 300000000, 300, 50, 10);
+    set_counters(&after[3], 950, -1, -1, -1, 3, 3);
+
+    struct task_sample prev = { before, 3, { 100, 0 } };
+    struct task_sample cur = { after, 4, { 102, 0 } };
+    CHECK_INT(task_rates(&prev, &cur), 0);
+
+    const struct task *t = &after[2];
+    CHECK_DBL(t->rates.run_ms, 250, 1e-9);
+    CHECK_DBL(t->rates.wait_ms, 50, 1e-9);
+    CHECK_DBL(t->rates.slices, 100, 1e-9);
+    CHECK_DBL(t->rates.vcsw, 5, 1e-9);
+    CHECK_DBL(t->rates.ivcsw, 3, 1e-9);
+    for (int i = 0; i < 4; ++i) {
+        if (i == 2) {
+            continue;
+        }
+        CHECK_DBL(after[i].rates.run_ms, -1, 0);
+        CHECK_DBL(after[i].rates.wait_ms, -1, 0);
+        CHECK_DBL(after[i].rates.vcsw, -1, 0);
+    }
+
+    /* Only 10 has waited, at 50 ms/s in 100 slices per second */
+    char *json;
+    size_t len;
+    FILE *out = open_memstream(&json, &len);
+    waiters_print_json(out, &cur, 5);
+    fclose(out);
+    CHECK_STR(json, "[{\"pid\":10,\"name\":\"task-10\",\"wait_ms\":50.00,"
+            "\"run_ms\":250.00,\"slices\":100.00,"
+            "\"wait_per_slice_ms\":0.50}]");
+    free(json);
+
+    out = open_memstream(&json, &len);
+    CHECK_INT(waiters_print(out, &cur, 5), 3);
+    fclose(out);
+    CHECK(strstr(json, "     10 | task-10                   |      50.0 |"
+            "     250.0 |    100.0 |     0.50\n") != NULL);
+    free(json);
+
+    /* Scans taken at the same time give no rates, so nothing waited */
+    prev.time = cur.time;
+    CHECK_INT(task_rates(&prev, &cur), 0);
+    CHECK_DBL(after[2].rates.wait_ms, -1, 0);
+    out = open_memstream(&json, &len);
+    waiters_print_json(out, &cur, 5);
+    fclose(out);
+    CHECK_STR(json, "null");
+    free(json);
+}
+
+/**
+ * Scans the tree, which has no schedstat files, twice and checks that only
+ * the context switch counts from status get rates.
+ */
+static void check_scan(int root)
+{
+    struct task_filter filter;
+    task_filter_init(&filter);
+    int sources = SRC_STAT | SRC_STATUS | SRC_SCHEDSTAT;
+    struct task_sample prev = { NULL, 0, { 100, 0 } };
+    struct task_sample cur = { NULL, 0, { 102, 0 } };
+    prev.n = tasks_scan(root, sources, &filter, IO_SYNC, &prev.tasks);
+    cur.n = tasks_scan(root, sources, &filter, IO_SYNC, &cur.tasks);
+    CHECK_INT(prev.n, UNIT_TASKS);
+    CHECK_INT(cur.n, UNIT_TASKS);
+    CHECK_INT(task_rates(&prev, &cur), 0);
+
+    for (size_t i = 0; i < cur.n; ++i) {
+        const struct task *t = &cur.tasks[i];
+        CHECK_INT(t->vcsw, t->pid * 3);
+        CHECK_INT(t->ivcsw, t->pid % 17);
+        CHECK_DBL(t->rates.vcsw, 0, 0);
+        CHECK_DBL(t->rates.ivcsw, 0, 0);
+        CHECK_DBL(t->rates.wait_ms, -1, 0);
+    }
+
+    char *text;
+    size_t len;
+    FILE *out = open_memstream(&text, &len);
+    CHECK_INT(waiters_print(out, &cur, WAITERS_DEFAULT), 1);
+    fclose(out);
+    CHECK_STR(text, "Not available\n");
+    free(text);
+
+    task_sample_free(&prev);
+    task_sample_free(&cur);
+    CHECK(cur.tasks == NULL && cur.n == 0);
+    task_filter_free(&filter);
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s <mkprocfs tree>\n", argv[0]);
+        return 1;
+    }
+    int root = unit_open_dir(argv[1]);
+
+    check_top_waiters();
+    check_rates();
+    check_scan(root);
+
+    close(root);
+    return unit_report("test_sched");
+}
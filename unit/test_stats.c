@@ -0,0 +1,141 @@
+/**
+ * @file
+ *
+ * Tests for stats.c: the work counters of a scan, with collection off and
+ * on, which tasks count as parsed, and the phase timings, which leave out
+ * time spent in stats_sleep().
+ */
+
+#include "stats.h"
+#include "tasks.h"
+#include "unit.h"
+
+/**
+ * Scans the tree and returns how much each counter grew.
+ */
+static void count_scan(int root, enum io_backend backend,
+        uint64_t delta[STAT_COUNTERS])
+{
+    uint64_t before[STAT_COUNTERS];
+    memcpy(before, stats_counters, sizeof(before));
+
+    struct task_filter filter;
+    task_filter_init(&filter);
+    struct task *tasks;
+    size_t n = tasks_scan(root, SRC_STAT | SRC_STATUS, &filter, backend,
+            &tasks);
+    CHECK_INT(n, UNIT_TASKS);
+    free(tasks);
+    task_filter_free(&filter);
+
+    for (int i = 0; i < STAT_COUNTERS; ++i) {
+        delta[i] = stats_counters[i] - before[i];
+    }
+}
+
+/**
+ * Scans the tree with a filter and returns how many tasks were counted as
+ * parsed.
+ */
+static uint64_t count_parsed(int root, const struct task_filter *filter)
+{
+    uint64_t before = stats_counters[STAT_TASKS_PARSED];
+    struct task *tasks;
+    tasks_scan(root, SRC_STAT, filter, IO_SYNC, &tasks);
+    free(tasks);
+    return stats_counters[STAT_TASKS_PARSED] - before;
+}
+
+/**
+ * Returns the wall time in ms stats_print() reports for a phase, or -1.
+ */
+static double phase_wall_ms(const char *name)
+{
+    char *text;
+    size_t len;
+    FILE *out = open_memstream(&text, &len);
+    stats_print(out);
+    fclose(out);
+
+    double ms = -1;
+    for (char *line = text; line != NULL; line = strchr(line, '\n')) {
+        line += *line == '\n';
+        if (strncmp(line, name, strlen(name)) == 0) {
+            sscanf(line, "%*s | %*u | %lf", &ms);
+        }
+    }
+    free(text);
+    return ms;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s <mkprocfs tree>\n", argv[0]);
+        return 1;
+    }
+    int root = unit_open_dir(argv[1]);
+    uint64_t delta[STAT_COUNTERS];
+
+    /* Off by default: nothing is counted or timed */
+    count_scan(root, IO_SYNC, delta);
+    for (int i = 0; i < STAT_COUNTERS; ++i) {
+        CHECK_INT(delta[i], 0);
+    }
+    struct stats_timer timer;
+    stats_begin(&timer);
+    stats_end(PHASE_TASK_INFO, &timer);
+    CHECK_DBL(phase_wall_ms("task_info"), -1, 0);
+
+    /* Synchronously, each of stat and status costs an open, a read, and a
+     * close per task, on top of listing the directory */
+    stats_enabled = true;
+    count_scan(root, IO_SYNC, delta);
+    CHECK_INT(delta[STAT_TASKS_PARSED], UNIT_TASKS);
+    CHECK_INT(delta[STAT_FILES_OPENED], 1 + 2 * UNIT_TASKS);
+    CHECK(delta[STAT_SYSCALLS] >= 2 + 3 * 2 * UNIT_TASKS);
+    CHECK(delta[STAT_BYTES_READ] > 2 * 200 * UNIT_TASKS);
+    uint64_t sync_syscalls = delta[STAT_SYSCALLS];
+    uint64_t sync_bytes = delta[STAT_BYTES_READ];
+
+    /* io_uring reads the same files with far fewer system calls */
+    struct io_batch *probe = io_batch_create(IO_URING, root, 1);
+    bool uring = strcmp(io_batch_backend_name(probe), "io_uring") == 0;
+    io_batch_destroy(probe);
+    count_scan(root, IO_URING, delta);
+    CHECK_INT(delta[STAT_TASKS_PARSED], UNIT_TASKS);
+    CHECK_INT(delta[STAT_BYTES_READ], sync_bytes);
+    if (uring) {
+        CHECK(delta[STAT_SYSCALLS] * 10 < sync_syscalls);
+    }
+
+    /* Tasks rejected by their owner have no file read; those rejected by
+     * state were parsed first */
+    struct task_filter filter;
+    task_filter_init(&filter);
+    char uid[16];
+    snprintf(uid, sizeof(uid), "%d", (int) getuid() + 1);
+    task_filter_set_user(&filter, uid);
+    CHECK_INT(count_parsed(root, &filter), 0);
+    task_filter_init(&filter);
+    task_filter_set_states(&filter, "D");
+    CHECK_INT(count_parsed(root, &filter), UNIT_TASKS);
+    task_filter_set_pid_range(&filter, "1-10");
+    CHECK_INT(count_parsed(root, &filter), 10);
+    task_filter_free(&filter);
+
+    /* A phase is charged for its work but not for sleeping */
+    stats_begin(&timer);
+    stats_sleep(1);
+    stats_end(PHASE_PSI, &timer);
+    double ms = phase_wall_ms("psi_info");
+    CHECK(ms >= 0 && ms < 500);
+
+    stats_begin(&timer);
+    usleep(200000);
+    stats_end(PHASE_DISKS, &timer);
+    CHECK(phase_wall_ms("disk_info") >= 200);
+
+    close(root);
+    return unit_report("test_stats");
+}
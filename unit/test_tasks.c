@@ -0,0 +1,263 @@
+/**
+ * @file
+ *
+ * Tests for tasks.c: scans of the synthetic tree from bench/mkprocfs with
+ * each I/O backend, checked against the values the generator writes, task
+ * filters, and column selection and formatting.
+ */
+
+#include "tasks.h"
+#include "unit.h"
+
+static const char states[] = "RSDI";
+
+/**
+ * Returns the task with the given PID, or NULL.
+ */
+static const struct task *find_task(const struct task *tasks, size_t n,
+        int pid)
+{
+    for (size_t i = 0; i < n; ++i) {
+        if (tasks[i].pid == pid) {
+            return &tasks[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Checks the fields parsed from stat, statm, and status (whichever of them
+ * were scanned) against what bench/mkprocfs writes for each PID.
+ */
+static void check_tasks(const struct task *tasks, size_t n,
+        unsigned int sources)
+{
+    long long page_kb = sysconf(_SC_PAGESIZE) / 1024;
+    CHECK_INT(n, UNIT_TASKS);
+
+    for (int pid = 1; pid <= UNIT_TASKS; ++pid) {
+        const struct task *t = find_task(tasks, n, pid);
+        if (!CHECK(t != NULL)) {
+            continue;
+        }
+
+        char name[32];
+        snprintf(name, sizeof(name), "worker-%d", pid);
+        if (sources & SRC_STAT) {
+            CHECK_STR(t->name, name);
+            CHECK_INT(t->state, states[pid % 4]);
+            CHECK_INT(t->ppid, pid > 1 ? pid / 2 : 0);
+            CHECK_INT(t->utime, pid % 97);
+            CHECK_INT(t->stime, pid % 31);
+            CHECK_INT(t->threads, 1 + pid % 8);
+            CHECK_INT(t->start_time, pid * 10);
+        } else {
+            CHECK_INT(t->state, '?');
+            CHECK_INT(t->ppid, -1);
+        }
+
+        if (sources & SRC_STATM) {
+            CHECK_INT(t->vsize_kb, 26382 * page_kb);
+            CHECK_INT(t->rss_kb, 2583 * page_kb);
+        } else {
+            CHECK_INT(t->rss_kb, -1);
+        }
+
+        if (sources & SRC_STATUS) {
+            CHECK_INT(t->swap_kb, 0);
+            CHECK_INT(t->vcsw, pid * 3);
+            CHECK_INT(t->ivcsw, pid % 17);
+        } else {
+            CHECK_INT(t->vcsw, -1);
+        }
+    }
+}
+
+/**
+ * Scans the tree with a backend, twice through the same scanner so that the
+ * reused buffers and batch context are exercised, then once more with a
+ * subset of the sources.
+ */
+static void check_scans(int root, enum io_backend backend)
+{
+    struct task_filter filter;
+    task_filter_init(&filter);
+    unsigned int all = SRC_STAT | SRC_STATM | SRC_STATUS;
+
+    struct task_scanner *scanner = task_scanner_create(root, backend);
+    CHECK(scanner != NULL);
+    for (int round = 0; round < 2; ++round) {
+        struct task *tasks;
+        size_t n = task_scanner_scan(scanner, all, &filter, &tasks);
+        check_tasks(tasks, n, all);
+        free(tasks);
+    }
+
+    struct task *tasks;
+    size_t n = task_scanner_scan(scanner, SRC_STATM, &filter, &tasks);
+    check_tasks(tasks, n, SRC_STATM);
+    free(tasks);
+    task_scanner_destroy(scanner);
+
+    task_filter_free(&filter);
+}
+
+/**
+ * Scans the tree with a filter and returns the number of tasks that passed.
+ * Every one of them must also pass task_filter_matches().
+ */
+static size_t filtered_scan(int root, enum io_backend backend,
+        const struct task_filter *filter)
+{
+    struct task *tasks;
+    size_t n = tasks_scan(root, SRC_STAT, filter, backend, &tasks);
+    for (size_t i = 0; i < n; ++i) {
+        CHECK(task_filter_matches(filter, &tasks[i]));
+    }
+    free(tasks);
+    return n;
+}
+
+/**
+ * Checks each kind of filter, alone and combined, on the generated tree.
+ */
+static void check_filters(int root, enum io_backend backend)
+{
+    struct task_filter filter;
+    task_filter_init(&filter);
+    CHECK_INT(task_filter_sources(&filter), 0);
+    CHECK_INT(filtered_scan(root, backend, &filter), UNIT_TASKS);
+
+    /* mkprocfs cycles through R, S, D, and I */
+    CHECK_INT(task_filter_set_states(&filter, "RD"), 0);
+    CHECK_INT(task_filter_sources(&filter), SRC_STAT);
+    CHECK_INT(filtered_scan(root, backend, &filter), UNIT_TASKS / 2);
+
+    CHECK_INT(task_filter_set_name(&filter, "^worker-1[0-9]$"), 0);
+    CHECK_INT(filtered_scan(root, backend, &filter), 5);
+
+    task_filter_free(&filter);
+    task_filter_init(&filter);
+    CHECK_INT(task_filter_set_pid_range(&filter, "10-19"), 0);
+    CHECK_INT(filtered_scan(root, backend, &filter), 10);
+    CHECK_INT(task_filter_set_pid_range(&filter, "-5"), 0);
+    CHECK_INT(filtered_scan(root, backend, &filter), 5);
+    CHECK_INT(task_filter_set_pid_range(&filter, "295-"), 0);
+    CHECK_INT(filtered_scan(root, backend, &filter), 6);
+    CHECK_INT(task_filter_set_pid_range(&filter, "42"), 0);
+    CHECK_INT(filtered_scan(root, backend, &filter), 1);
+
+    /* The tree belongs to whoever generated it */
+    char uid[16];
+    task_filter_init(&filter);
+    snprintf(uid, sizeof(uid), "%d", (int) getuid());
+    CHECK_INT(task_filter_set_user(&filter, uid), 0);
+    CHECK_INT(task_filter_sources(&filter), SRC_OWNER);
+    CHECK_INT(filtered_scan(root, backend, &filter), UNIT_TASKS);
+    snprintf(uid, sizeof(uid), "%d", (int) getuid() + 1);
+    CHECK_INT(task_filter_set_user(&filter, uid), 0);
+    CHECK_INT(filtered_scan(root, backend, &filter), 0);
+
+    CHECK_INT(task_filter_set_states(&filter, "Q"), -1);
+    CHECK_INT(task_filter_set_states(&filter, ""), -1);
+    CHECK_INT(task_filter_set_pid_range(&filter, "5-1"), -1);
+    CHECK_INT(task_filter_set_pid_range(&filter, "a-b"), -1);
+    CHECK_INT(task_filter_set_pid_range(&filter, "-"), -1);
+    CHECK_INT(task_filter_set_pid_range(&filter, ""), -1);
+    CHECK_INT(task_filter_set_name(&filter, "("), -1);
+    task_filter_free(&filter);
+}
+
+/**
+ * Checks column parsing and the sources and rows of a column selection.
+ */
+static void check_columns(int root)
+{
+    const struct column *cols[MAX_COLUMNS];
+    CHECK_INT(columns_parse("pid,name,,tasks,vsz", cols), 4);
+    CHECK_STR(cols[0]->name, "pid");
+    CHECK_STR(cols[3]->header, "VSZ");
+    CHECK_INT(columns_sources(cols, 4), SRC_STAT | SRC_STATM);
+    CHECK(!columns_rates(cols, 4));
+    CHECK_INT(columns_parse("pid,bogus", cols), -1);
+    CHECK_INT(columns_parse(",", cols), -1);
+
+    const struct column *many[MAX_COLUMNS + 1];
+    char spec[8 * (MAX_COLUMNS + 1)] = "pid";
+    for (int i = 0; i < MAX_COLUMNS; ++i) {
+        strcat(spec, ",pid");
+    }
+    CHECK_INT(columns_parse(spec, many), -1);
+
+    CHECK_INT(columns_default(cols), 5);
+    CHECK_INT(columns_sources(cols, 5), SRC_STAT | SRC_OWNER);
+    CHECK_INT(columns_parse("pid,wait", cols), 2);
+    CHECK(columns_rates(cols, 2));
+    CHECK_INT(columns_sources(cols, 2), SRC_SCHEDSTAT);
+
+    /* A scan for the selection reads only the columns' sources */
+    int ncols = columns_parse("pid,name,tasks,vsz", cols);
+    struct task_filter filter;
+    task_filter_init(&filter);
+    struct task *tasks;
+    size_t n = tasks_scan(root, columns_sources(cols, ncols), &filter,
+            IO_SYNC, &tasks);
+    const struct task *t = find_task(tasks, n, 7);
+    if (CHECK(t != NULL)) {
+        CHECK_INT(t->vcsw, -1);
+
+        char *row;
+        size_t len;
+        FILE *out = open_memstream(&row, &len);
+        struct uid_cache users = { 0 };
+        columns_print_row(out, &users, cols, ncols, t);
+        fclose(out);
+
+        char vsz[16], want[128];
+        format_kb(t->vsize_kb, vsz, sizeof(vsz));
+        snprintf(want, sizeof(want), "%5d | %25s | %5d | %8s \n", 7,
+                "worker-7", 8, vsz);
+        CHECK_STR(row, want);
+        free(row);
+    }
+    free(tasks);
+    task_filter_free(&filter);
+
+    char buf[16];
+    format_kb(-1, buf, sizeof(buf));
+    CHECK_STR(buf, "-");
+    format_kb(1000, buf, sizeof(buf));
+    CHECK_STR(buf, "1000K");
+    format_kb(10332, buf, sizeof(buf));
+    CHECK_STR(buf, "10.1M");
+    format_kb(3 * 1024 * 1024, buf, sizeof(buf));
+    CHECK_STR(buf, "3.0G");
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s <mkprocfs tree>\n", argv[0]);
+        return 1;
+    }
+    int root = unit_open_dir(argv[1]);
+
+    check_scans(root, IO_SYNC);
+    check_scans(root, IO_URING);
+    check_filters(root, IO_SYNC);
+    check_filters(root, IO_URING);
+    check_columns(root);
+
+    /* A root that cannot be listed fails the scan */
+    int file = open("unit/fixtures/batch/short", O_RDONLY);
+    struct task_filter filter;
+    task_filter_init(&filter);
+    struct task *tasks;
+    CHECK_INT(tasks_scan(file, SRC_STAT, &filter, IO_SYNC, &tasks), 0);
+    CHECK(tasks == NULL);
+    task_filter_free(&filter);
+    close(file);
+
+    close(root);
+    return unit_report("test_tasks");
+}
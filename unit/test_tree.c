@@ -0,0 +1,140 @@
+/**
+ * @file
+ *
+ * Tests for tree.c: the PID index, and the links, pre-order, depths, and
+ * subtree totals of task_tree_build() on a small hand-made forest and on the
+ * generated tree, where every task's parent is PID / 2.
+ */
+
+#include "tree.h"
+#include "unit.h"
+
+/**
+ * Fills in the fields the tree uses.
+ */
+static void set_task(struct task *task, int pid, int ppid, int threads,
+        unsigned long long ticks, long long rss_kb)
+{
+    memset(task, 0, sizeof(*task));
+    task->pid = pid;
+    task->ppid = ppid;
+    task->threads = threads;
+    task->utime = ticks;
+    task->rss_kb = rss_kb;
+}
+
+static void check_forest(void)
+{
+    /* 1 -> {5 -> 7 -> 13, 3}; 9's parent is not in the scan and 11 claims
+     * to be its own parent, so both are roots */
+    struct task tasks[7];
+    set_task(&tasks[0], 1, 0, 1, 10, 100);
+    set_task(&tasks[1], 5, 1, 2, 20, 200);
+    set_task(&tasks[2], 3, 1, 3, 30, -1);
+    set_task(&tasks[3], 7, 5, 4, 40, 400);
+    set_task(&tasks[4], 9, 42, 5, 50, 500);
+    set_task(&tasks[5], 11, 11, -1, 60, 600);
+    set_task(&tasks[6], 13, 7, 6, 70, 700);
+
+    struct task_tree tree;
+    CHECK_INT(task_tree_build(tasks, 7, &tree), 0);
+    CHECK_INT(tree.n, 7);
+    CHECK_INT(tree.norder, 7);
+
+    /* Siblings keep the scan order */
+    static const int order[] = { 0, 1, 3, 6, 2, 4, 5 };
+    static const int depth[] = { 0, 1, 2, 3, 1, 0, 0 };
+    for (int i = 0; i < 7; ++i) {
+        CHECK_INT(tree.order[i], order[i]);
+        CHECK_INT(tree.depth[tree.order[i]], depth[i]);
+    }
+    CHECK_INT(tree.first_child[0], 1);
+    CHECK_INT(tree.next_sibling[1], 2);
+    CHECK_INT(tree.next_sibling[2], -1);
+    CHECK_INT(tree.first_child[6], -1);
+
+    /* Unknown thread counts and RSS count as zero */
+    CHECK_INT(tree.sub_threads[0], 1 + 2 + 3 + 4 + 6);
+    CHECK_INT(tree.sub_ticks[0], 10 + 20 + 30 + 40 + 70);
+    CHECK_INT(tree.sub_rss_kb[0], 100 + 200 + 400 + 700);
+    CHECK_INT(tree.sub_threads[1], 2 + 4 + 6);
+    CHECK_INT(tree.sub_ticks[3], 40 + 70);
+    CHECK_INT(tree.sub_rss_kb[2], 0);
+    CHECK_INT(tree.sub_threads[5], 0);
+    CHECK_INT(tree.sub_ticks[4], 50);
+    task_tree_free(&tree);
+
+    CHECK_INT(task_tree_build(tasks, 0, &tree), 0);
+    CHECK_INT(tree.norder, 0);
+    task_tree_free(&tree);
+}
+
+static void check_generated(int root)
+{
+    struct task_filter filter;
+    task_filter_init(&filter);
+    struct task *tasks;
+    size_t n = tasks_scan(root, SRC_STAT | SRC_STATM, &filter, IO_SYNC,
+            &tasks);
+    CHECK_INT(n, UNIT_TASKS);
+
+    struct pid_index idx;
+    CHECK_INT(pid_index_build(&idx, tasks, n), 0);
+    for (int pid = 1; pid <= UNIT_TASKS; ++pid) {
+        int i = pid_index_find(&idx, tasks, pid);
+        if (CHECK(i != -1)) {
+            CHECK_INT(tasks[i].pid, pid);
+        }
+    }
+    CHECK_INT(pid_index_find(&idx, tasks, UNIT_TASKS + 1), -1);
+    pid_index_free(&idx);
+
+    long long threads = 0;
+    unsigned long long ticks = 0;
+    for (size_t i = 0; i < n; ++i) {
+        threads += tasks[i].threads;
+        ticks += tasks[i].utime + tasks[i].stime;
+    }
+
+    struct task_tree tree;
+    CHECK_INT(task_tree_build(tasks, n, &tree), 0);
+    CHECK_INT(tree.norder, n);
+
+    /* PID 1 is the only root and the parent of a task is PID / 2, so a
+     * task's depth is the position of the highest set bit of its PID */
+    int first = tree.order[0];
+    CHECK_INT(tasks[first].pid, 1);
+    CHECK_INT(tree.sub_threads[first], threads);
+    CHECK_INT(tree.sub_ticks[first], ticks);
+    CHECK_INT(tree.sub_rss_kb[first], n * tasks[first].rss_kb);
+    for (size_t k = 0; k < tree.norder; ++k) {
+        int i = tree.order[k];
+        int depth = 0;
+        for (int pid = tasks[i].pid; pid > 1; pid /= 2) {
+            depth++;
+        }
+        CHECK_INT(tree.depth[i], depth);
+        if (k > 0) {
+            /* A node follows its parent or a descendant of its parent */
+            CHECK(tree.depth[i] <= tree.depth[tree.order[k - 1]] + 1);
+        }
+    }
+    task_tree_free(&tree);
+    free(tasks);
+    task_filter_free(&filter);
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s <mkprocfs tree>\n", argv[0]);
+        return 1;
+    }
+    int root = unit_open_dir(argv[1]);
+
+    check_forest();
+    check_generated(root);
+
+    close(root);
+    return unit_report("test_tree");
+}
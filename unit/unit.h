@@ -0,0 +1,100 @@
+/**
+ * @file
+ *
+ * Check macros for the unit tests. Each test_<module>.c is a program of its
+ * own that runs its checks from main(), prints every failed check with its
+ * location and the values involved, and exits non-zero if any check failed.
+ *
+ * The programs are run from the top of the source tree by run_unit.sh, so
+ * fixture files are opened by their path relative to it (unit/fixtures/...).
+ * The first argument is a synthetic procfs tree generated by bench/mkprocfs
+ * with UNIT_TASKS tasks.
+ */
+
+#ifndef _UNIT_H_
+#define _UNIT_H_
+
+#include <fcntl.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* Number of tasks in the tree run_unit.sh generates */
+#define UNIT_TASKS 300
+
+static int unit_checks;
+static int unit_failures;
+
+/**
+ * Counts a check and reports it if it failed. Returns the outcome.
+ */
+static inline bool unit_check(bool ok, const char *file, int line,
+        const char *expr)
+{
+    unit_checks++;
+    if (!ok) {
+        unit_failures++;
+        fprintf(stderr, "%s:%d: check failed: %s\n", file, line, expr);
+    }
+    return ok;
+}
+
+#define CHECK(cond) unit_check((cond), __FILE__, __LINE__, #cond)
+
+#define CHECK_INT(actual, expected) do { \
+    long long a_ = (actual); \
+    long long e_ = (expected); \
+    if (!unit_check(a_ == e_, __FILE__, __LINE__, \
+                #actual " == " #expected)) { \
+        fprintf(stderr, "    got %lld, expected %lld\n", a_, e_); \
+    } \
+} while (0)
+
+/* Doubles are compared with an absolute tolerance */
+#define CHECK_DBL(actual, expected, tolerance) do { \
+    double a_ = (actual); \
+    double e_ = (expected); \
+    if (!unit_check(fabs(a_ - e_) <= (tolerance), __FILE__, __LINE__, \
+                #actual " == " #expected)) { \
+        fprintf(stderr, "    got %g, expected %g\n", a_, e_); \
+    } \
+} while (0)
+
+#define CHECK_STR(actual, expected) do { \
+    const char *a_ = (actual); \
+    const char *e_ = (expected); \
+    if (!unit_check(a_ != NULL && strcmp(a_, e_) == 0, __FILE__, __LINE__, \
+                #actual " == " #expected)) { \
+        fprintf(stderr, "    got \"%s\", expected \"%s\"\n", \
+                a_ != NULL ? a_ : "(null)", e_); \
+    } \
+} while (0)
+
+/**
+ * Opens a directory (e.g., a fixture procfs root) or exits the test.
+ */
+static inline int unit_open_dir(const char *path)
+{
+    int fd = open(path, O_RDONLY | O_DIRECTORY);
+    if (fd == -1) {
+        perror(path);
+        exit(1);
+    }
+    return fd;
+}
+
+/**
+ * Prints the number of checks run and failed. Returns the exit status of the
+ * test program.
+ */
+static inline int unit_report(const char *name)
+{
+    printf("%-20s %4d checks, %d failed\n", name, unit_checks,
+            unit_failures);
+    return unit_failures > 0 ? 1 : 0;
+}
+
+#endif